@@ -0,0 +1,258 @@
+/*
+  Canvas565.h
+
+  A display in RAM, for host builds. Stores RGB565 pixels the way the
+  ILI9341 does (240x320, rotated by setRotation), counts every pixel write,
+  and saves what is on screen as PPM or PNG.
+*/
+
+#pragma once
+
+#include <Adafruit_GFX.h>
+#include "PixelKernels.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class Canvas565 : public Adafruit_GFX {
+public:
+  uint64_t writes; // pixels written since the last resetWrites(), overdraw included
+
+  Canvas565(int16_t w = 240, int16_t h = 320)
+    : Adafruit_GFX(w, h), writes(0), buffer((size_t)w * h, 0) {}
+
+  void resetWrites() { writes = 0; }
+
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override {
+    if (x < 0 || y < 0 || x >= _width || y >= _height) return;
+    buffer[index(x, y)] = color;
+    writes++;
+  }
+
+  void writeFillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) override {
+    int32_t x0, y0, x1, y1;
+    if (!clipRect(x, y, w, h, x0, y0, x1, y1)) return;
+    // rotated, it is still a rect in display memory: fill it row by row
+    int32_t ax = x0, ay = y0, bx = x1 - 1, by = y1 - 1;
+    toMemory(ax, ay);
+    toMemory(bx, by);
+    if (ax > bx) std::swap(ax, bx);
+    if (ay > by) std::swap(ay, by);
+    for (int32_t j = ay; j <= by; j++) {
+      PixelKernels::fill16(&buffer[(size_t)j * WIDTH + ax], color, bx - ax + 1);
+    }
+    writes += (uint64_t)(x1 - x0) * (y1 - y0);
+  }
+
+  void writeFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) override {
+    writeFillRect(x, y, w, 1, color);
+  }
+
+  void writeFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) override {
+    writeFillRect(x, y, 1, h, color);
+  }
+
+  /**
+   * @brief Copies a w x h bitmap of RGB565 pixels to x, y, clipped to the screen.
+   */
+  void drawRGBBitmap(int16_t x, int16_t y, const uint16_t* pixels, int16_t w, int16_t h) {
+    blit(x, y, pixels, w, h, false, 0);
+  }
+
+  /**
+   * @brief As drawRGBBitmap, but pixels of the key colour are left as they were.
+   */
+  void drawRGBBitmapKeyed(int16_t x, int16_t y, const uint16_t* pixels, int16_t w, int16_t h,
+                          uint16_t key) {
+    blit(x, y, pixels, w, h, true, key);
+  }
+
+  /**
+   * @brief The pixel at x, y as seen on screen (after rotation), 0 if off screen.
+   */
+  uint16_t getPixel(int16_t x, int16_t y) const {
+    if (x < 0 || y < 0 || x >= _width || y >= _height) return 0;
+    return buffer[index(x, y)];
+  }
+
+  /**
+   * @brief The pixels in display memory order (unrotated, row by row).
+   */
+  const uint16_t* getBuffer() const { return buffer.data(); }
+
+  /**
+   * @brief FNV-1a hash of the display memory, to compare frames against a golden one.
+   */
+  uint64_t hash() const {
+    uint64_t h = 14695981039346656037ull;
+    for (uint16_t p : buffer) {
+      h = (h ^ (p & 0xFF)) * 1099511628211ull;
+      h = (h ^ (p >> 8)) * 1099511628211ull;
+    }
+    return h;
+  }
+
+  /**
+   * @brief Saves the screen as a binary PPM (P6).
+   */
+  bool writePPM(const char* path) const {
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+    fprintf(f, "P6\n%d %d\n255\n", _width, _height);
+    std::vector<uint8_t> row;
+    bool ok = true;
+    for (int16_t y = 0; y < _height && ok; y++) {
+      rgbRow(y, row);
+      ok = fwrite(row.data(), 1, row.size(), f) == row.size();
+    }
+    return (fclose(f) == 0) && ok;
+  }
+
+  /**
+   * @brief Saves the screen as an 8 bit RGB PNG. Not compressed, to keep this
+   * self contained (zlib "stored" blocks).
+   */
+  bool writePNG(const char* path) const {
+    std::vector<uint8_t> raw, row;
+    for (int16_t y = 0; y < _height; y++) {
+      raw.push_back(0); // no filter
+      rgbRow(y, row);
+      raw.insert(raw.end(), row.begin(), row.end());
+    }
+    std::vector<uint8_t> z = {0x78, 0x01};
+    for (size_t at = 0;;) {
+      size_t len = raw.size() - at < 65535 ? raw.size() - at : 65535;
+      bool last = at + len == raw.size();
+      z.push_back(last);
+      z.push_back(len & 0xFF);
+      z.push_back(len >> 8);
+      z.push_back(~len & 0xFF);
+      z.push_back((~len >> 8) & 0xFF);
+      z.insert(z.end(), raw.begin() + at, raw.begin() + at + len);
+      at += len;
+      if (last) break;
+    }
+    uint32_t a = 1, b = 0; // adler32
+    for (uint8_t v : raw) {
+      a = (a + v) % 65521;
+      b = (b + a) % 65521;
+    }
+    put32(z, (b << 16) | a);
+
+    std::vector<uint8_t> ihdr;
+    put32(ihdr, _width);
+    put32(ihdr, _height);
+    ihdr.insert(ihdr.end(), {8, 2, 0, 0, 0}); // 8 bit RGB
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    chunk(png, "IHDR", ihdr);
+    chunk(png, "IDAT", z);
+    chunk(png, "IEND", {});
+
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+    bool ok = fwrite(png.data(), 1, png.size(), f) == png.size();
+    return (fclose(f) == 0) && ok;
+  }
+
+  /**
+   * @brief Saves as PNG if the path ends in .png, PPM otherwise.
+   */
+  bool save(const std::string& path) const {
+    if (path.size() > 4 && path.compare(path.size() - 4, 4, ".png") == 0) {
+      return writePNG(path.c_str());
+    }
+    return writePPM(path.c_str());
+  }
+
+protected:
+  /**
+   * @brief Clips a rect (w or h may be negative) to the screen, giving its
+   * corners as x0, y0 (inside) to x1, y1 (outside).
+   * @return false if nothing is left
+   */
+  bool clipRect(int16_t x, int16_t y, int16_t w, int16_t h,
+                int32_t& x0, int32_t& y0, int32_t& x1, int32_t& y1) const {
+    x0 = x; y0 = y; x1 = (int32_t)x + w; y1 = (int32_t)y + h;
+    if (w < 0) { x0 = x1 + 1; x1 = x + 1; }
+    if (h < 0) { y0 = y1 + 1; y1 = y + 1; }
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > _width) x1 = _width;
+    if (y1 > _height) y1 = _height;
+    return x1 > x0 && y1 > y0;
+  }
+
+private:
+  std::vector<uint16_t> buffer;
+
+  // Screen (rotated) coordinates to display memory, as Adafruit's GFXcanvas16
+  void toMemory(int32_t& x, int32_t& y) const {
+    int32_t t;
+    switch (rotation) {
+      case 1: t = x; x = WIDTH - 1 - y; y = t; break;
+      case 2: x = WIDTH - 1 - x; y = HEIGHT - 1 - y; break;
+      case 3: t = x; x = y; y = HEIGHT - 1 - t; break;
+    }
+  }
+
+  size_t index(int32_t x, int32_t y) const {
+    toMemory(x, y);
+    return (size_t)y * WIDTH + x;
+  }
+
+  void blit(int16_t x, int16_t y, const uint16_t* pixels, int16_t w, int16_t h, bool keyed, uint16_t key) {
+    if (w <= 0 || h <= 0) return;
+    int32_t x0, y0, x1, y1;
+    if (!clipRect(x, y, w, h, x0, y0, x1, y1)) return;
+    for (int32_t j = y0; j < y1; j++) {
+      const uint16_t* src = pixels + (size_t)(j - y) * w + (x0 - x);
+      size_t n = x1 - x0;
+      if (rotation == 0) { // screen rows are memory rows
+        uint16_t* dst = &buffer[(size_t)j * WIDTH + x0];
+        if (keyed) {
+          PixelKernels::blitKey16(dst, src, n, key);
+        } else {
+          PixelKernels::copy16(dst, src, n);
+        }
+      } else {
+        for (size_t i = 0; i < n; i++) {
+          if (!keyed || src[i] != key) buffer[index(x0 + i, j)] = src[i];
+        }
+      }
+      writes += keyed ? n - std::count(src, src + n, key) : n;
+    }
+  }
+
+  void rgbRow(int16_t y, std::vector<uint8_t>& row) const {
+    row.resize((size_t)_width * 3);
+    for (int16_t x = 0; x < _width; x++) {
+      uint16_t p = buffer[index(x, y)];
+      uint8_t r = p >> 11, g = (p >> 5) & 0x3F, b = p & 0x1F;
+      row[3 * x] = (r << 3) | (r >> 2);
+      row[3 * x + 1] = (g << 2) | (g >> 4);
+      row[3 * x + 2] = (b << 3) | (b >> 2);
+    }
+  }
+
+  static void put32(std::vector<uint8_t>& v, uint32_t n) {
+    v.push_back(n >> 24);
+    v.push_back(n >> 16);
+    v.push_back(n >> 8);
+    v.push_back(n);
+  }
+
+  static void chunk(std::vector<uint8_t>& png, const char* type, const std::vector<uint8_t>& data) {
+    put32(png, data.size());
+    size_t start = png.size();
+    png.insert(png.end(), type, type + 4);
+    png.insert(png.end(), data.begin(), data.end());
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = start; i < png.size(); i++) {
+      crc ^= png[i];
+      for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    put32(png, ~crc);
+  }
+};
@@ -0,0 +1,116 @@
+/*
+  ChainSim.h
+
+  A daisy chain of MERGIF nodes on the PC (see src/ChainLink.h): each node
+  has its own parser, TouchManager and RAM display, and the serial lines
+  between them are byte queues. Used by host/chain.cpp and
+  test/test_host_chain.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include "CommandParser.h"
+#include "ChainLink.h"
+#include "Canvas565.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief One end of a serial line: reads one queue, writes the other.
+ */
+class QueueTransport : public Transport {
+public:
+  QueueTransport(std::deque<uint8_t>& in, std::deque<uint8_t>& out) : m_in(in), m_out(out) {}
+
+  const char* name() const override { return "queue"; }
+  int available() override { return m_in.size(); }
+  int read() override {
+    if (m_in.empty()) return -1;
+    uint8_t b = m_in.front();
+    m_in.pop_front();
+    return b;
+  }
+  int peek() override { return m_in.empty() ? -1 : m_in.front(); }
+  size_t write(uint8_t b) override {
+    m_out.push_back(b);
+    return 1;
+  }
+  using Print::write;
+
+private:
+  std::deque<uint8_t>& m_in;
+  std::deque<uint8_t>& m_out;
+};
+
+class ChainSim {
+public:
+  struct Node {
+    std::deque<uint8_t> fromUp, toUp;   //the line to the host or the node before
+    std::unique_ptr<QueueTransport> up, down;
+    std::unique_ptr<ChainLink> link;
+    Canvas565 canvas;
+    TouchManager manager;
+    std::unique_ptr<CommandParser> parser;
+  };
+
+  std::vector<std::unique_ptr<Node>> nodes;
+
+  explicit ChainSim(int count, uint8_t rotation = 1) {
+    for (int i = 0; i < count; i++) nodes.emplace_back(new Node());
+    for (int i = 0; i < count; i++) {
+      Node& n = *nodes[i];
+      n.up.reset(new QueueTransport(n.fromUp, n.toUp));
+      if (i + 1 < count) {
+        Node& next = *nodes[i + 1];
+        n.down.reset(new QueueTransport(next.toUp, next.fromUp)); //its Serial2 is the next one's Serial1
+      }
+      n.link.reset(new ChainLink(*n.up, n.down.get()));
+      n.canvas.setRotation(rotation);
+      n.manager.begin(&n.canvas);
+      n.parser.reset(new CommandParser(n.manager, &n.canvas, *n.link, rotation));
+    }
+  }
+
+  /**
+   * @brief The host sends, to the first node.
+   */
+  void send(const std::string& bytes) {
+    nodes[0]->fromUp.insert(nodes[0]->fromUp.end(), bytes.begin(), bytes.end());
+  }
+
+  /**
+   * @brief A touch on a node's screen, reported as main.cpp does.
+   */
+  int touch(size_t node, int x, int y) {
+    Node& n = *nodes[node];
+    int id = n.manager.findGroupIDAt(x, y);
+    n.parser->reportTouch(id, x, y, micros());
+    return id;
+  }
+
+  /**
+   * @brief Runs every node, a slice at a time as loop() would, until no
+   * bytes are moving.
+   * @return what came back to the host
+   */
+  std::string run(size_t slice = 64) {
+    bool moved = true;
+    while (moved) {
+      moved = false;
+      for (auto& n : nodes) {
+        if (n->parser->feed(*n->link, slice)) moved = true;
+        n->link->service();
+      }
+      for (size_t i = 0; i < nodes.size(); i++) { //on the lines, either way
+        if (!nodes[i]->fromUp.empty() || (i && !nodes[i]->toUp.empty())) moved = true;
+      }
+    }
+    std::string back(nodes[0]->toUp.begin(), nodes[0]->toUp.end());
+    nodes[0]->toUp.clear();
+    return back;
+  }
+};
@@ -0,0 +1,162 @@
+/*
+  FdTransport.h
+
+  Transports for host builds (see src/Transport.h): a pair of file
+  descriptors (stdio, a pipe, a socket), or a pseudo terminal that any
+  serial tool can open as if it were the device, e.g.
+
+    python3 tools/latency.py --port /dev/pts/3
+
+  Reads don't block. What is written is buffered until flush(), the buffer
+  fills, or the next available() (so replies go out before waiting for more).
+  Linux and macOS.
+*/
+
+#pragma once
+
+#include "Transport.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+class FdTransport : public Transport {
+public:
+  uint64_t bytesIn, bytesOut;
+
+  /**
+   * @param in read from, made non-blocking
+   * @param out written to
+   */
+  FdTransport(int in, int out, const char* name = "fd")
+    : bytesIn(0), bytesOut(0), m_in(in), m_out(out), m_name(name),
+      m_head(0), m_tail(0), m_outLength(0), m_eof(false) {
+    if (in >= 0) fcntl(in, F_SETFL, fcntl(in, F_GETFL) | O_NONBLOCK);
+  }
+
+  ~FdTransport() override { flush(); }
+
+  static FdTransport stdio() { return FdTransport(0, 1, "stdio"); }
+
+  const char* name() const override { return m_name; }
+
+  int available() override {
+    flush();
+    if (m_head == m_tail && !m_eof) fill();
+    return m_tail - m_head;
+  }
+
+  int read() override {
+    if (!available()) return -1;
+    bytesIn++;
+    return m_inBuffer[m_head++];
+  }
+
+  int peek() override { return available() ? m_inBuffer[m_head] : -1; }
+
+  size_t write(uint8_t b) override { return write(&b, 1); }
+
+  size_t write(const uint8_t* buffer, size_t size) override {
+    for (size_t i = 0; i < size; i++) {
+      if (m_outLength == sizeof(m_outBuffer)) flush();
+      m_outBuffer[m_outLength++] = buffer[i];
+    }
+    bytesOut += size;
+    return size;
+  }
+
+  void flush() override {
+    size_t done = 0;
+    while (done < m_outLength) {
+      ssize_t n = ::write(m_out, m_outBuffer + done, m_outLength - done);
+      if (n > 0) {
+        done += n;
+      } else if (n < 0 && errno == EAGAIN) {
+        usleep(100); //the reader is behind, as a UART would hold us up
+      } else {
+        break; //nobody to send to, drop it
+      }
+    }
+    m_outLength = 0;
+  }
+
+  /**
+   * @return true once the other end has closed and everything sent has been read
+   */
+  bool eof() const { return m_eof && m_head == m_tail; }
+
+  using Print::write;
+
+protected:
+  int m_in, m_out;
+  const char* m_name;
+
+  /**
+   * @brief Reads what is waiting, without blocking.
+   */
+  virtual void fill() {
+    ssize_t n = ::read(m_in, m_inBuffer, sizeof(m_inBuffer));
+    m_head = 0;
+    m_tail = n > 0 ? n : 0;
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) onEnd();
+  }
+
+  virtual void onEnd() { m_eof = true; }
+
+  uint8_t m_inBuffer[4096];
+  size_t m_head, m_tail;
+  uint8_t m_outBuffer[4096];
+  size_t m_outLength;
+  bool m_eof;
+};
+
+/**
+ * @brief The device end of a pseudo terminal, in raw mode. Open
+ * slaveName() in a serial tool to talk to it. The other end closing is
+ * the end of the input, once something had been read.
+ */
+class PtyTransport : public FdTransport {
+public:
+  PtyTransport() : FdTransport(-1, -1, "pty"), m_opened(false) {
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) || unlockpt(fd)) return;
+    termios raw;
+    if (!tcgetattr(fd, &raw)) {
+      cfmakeraw(&raw); //no echo, no newline translation: a plain byte stream
+      tcsetattr(fd, TCSANOW, &raw);
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    m_in = m_out = fd;
+  }
+
+  ~PtyTransport() override {
+    flush();
+    if (m_in >= 0) close(m_in);
+  }
+
+  PtyTransport(const PtyTransport&) = delete;
+  PtyTransport& operator=(const PtyTransport&) = delete;
+
+  /**
+   * @return the path to open, e.g. /dev/pts/3, or nullptr if there is no pty
+   */
+  const char* slaveName() const { return m_in >= 0 ? ptsname(m_in) : nullptr; }
+
+  bool connected() override { return m_opened; }
+
+protected:
+  void fill() override {
+    FdTransport::fill();
+    if (m_tail) m_opened = true;
+  }
+
+  // Before the other end opens it, reads fail too: only the end once it has
+  void onEnd() override {
+    if (m_opened) m_eof = true;
+  }
+
+private:
+  bool m_opened;
+};
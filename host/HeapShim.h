@@ -0,0 +1,157 @@
+/*
+  HeapShim.h
+
+  A small fixed size heap, for host builds to stand in for the RP2040's
+  (about 200KB once the core and stacks are in). Blocks have boundary tags
+  and are merged with free neighbours when freed; free blocks are kept in
+  lists by power of two size and the first that fits is taken, roughly
+  what newlib's malloc does. So fragmentation and running out show up on the
+  PC as they would on the device, and every allocation is counted.
+
+  host/soak.cpp routes operator new and delete here.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include "Soak.h"
+
+class HeapShim {
+public:
+  uint64_t allocs, frees;
+  uint64_t failed;   // allocations that didn't fit
+  size_t liveBytes;  // in blocks handed out, tags included
+
+  explicit HeapShim(size_t bytes)
+    : allocs(0), frees(0), failed(0), liveBytes(0), freeBytes(0), freeChunks(0) {
+    size = bytes & ~(ALIGN - 1);
+    base = (uint8_t*)aligned_alloc(ALIGN, size);
+    for (auto& b : bins) b = nullptr;
+    // a used tag either side, so blocks never merge past the ends
+    tag(base + ALIGN - sizeof(size_t)) = USED;
+    tag(base + size - ALIGN) = USED;
+    makeFree(base + ALIGN, size - 2 * ALIGN);
+  }
+
+  ~HeapShim() { free(base); }
+
+  HeapShim(const HeapShim&) = delete;
+  HeapShim& operator=(const HeapShim&) = delete;
+
+  bool owns(const void* p) const {
+    return p >= base && p < base + size;
+  }
+
+  /**
+   * @return nullptr if no free block is big enough
+   */
+  void* alloc(size_t n) {
+    size_t need = (n + OVERHEAD + ALIGN - 1) & ~(ALIGN - 1);
+    if (need < MIN_BLOCK) need = MIN_BLOCK;
+    for (int bin = binOf(need); bin < BINS; bin++) {
+      for (uint8_t* b = bins[bin]; b; b = next(b)) {
+        size_t have = sizeOf(b);
+        if (have < need) continue;
+        unlink(b);
+        if (have - need >= MIN_BLOCK) { // split, the rest stays free
+          makeFree(b + need, have - need);
+          have = need;
+        }
+        setTags(b, have, true);
+        allocs++;
+        liveBytes += have;
+        return b + ALIGN;
+      }
+    }
+    failed++;
+    return nullptr;
+  }
+
+  void release(void* p) {
+    uint8_t* b = (uint8_t*)p - ALIGN;
+    size_t s = sizeOf(b);
+    frees++;
+    liveBytes -= s;
+    size_t before = tag(b - sizeof(size_t));
+    if (!(before & USED)) { // merge with the block below
+      b -= before;
+      unlink(b);
+      s += before;
+    }
+    uint8_t* after = b + s;
+    if (!(tag(after) & USED)) { // and the one above
+      size_t more = sizeOf(after);
+      unlink(after);
+      s += more;
+    }
+    makeFree(b, s);
+  }
+
+  HeapStats stats() const {
+    HeapStats h = {};
+    h.freeBytes = freeBytes;
+    h.freeChunks = freeChunks;
+    h.liveBytes = liveBytes;
+    h.allocs = (uint32_t)allocs;
+    for (int bin = BINS - 1; bin >= 0 && !h.largestFree; bin--) {
+      for (uint8_t* b = bins[bin]; b; b = next(b)) {
+        size_t usable = sizeOf(b) - OVERHEAD;
+        if (usable > h.largestFree) h.largestFree = usable;
+      }
+    }
+    return h;
+  }
+
+private:
+  static const size_t ALIGN = 16;          // payload alignment, as operator new gives
+  static const size_t OVERHEAD = ALIGN + sizeof(size_t); // header, footer
+  static const size_t MIN_BLOCK = 48;      // room for the free list links
+  static const size_t USED = 1;
+  static const int BINS = 40;
+
+  uint8_t* base;
+  size_t size;
+  size_t freeBytes, freeChunks;
+  uint8_t* bins[BINS];
+
+  // block: size|used at the start, payload from +ALIGN, size|used again in the last word
+  static size_t& tag(uint8_t* at) { return *(size_t*)at; }
+  static size_t sizeOf(uint8_t* b) { return tag(b) & ~USED; }
+  static uint8_t*& next(uint8_t* b) { return *(uint8_t**)(b + ALIGN); }
+  static uint8_t*& prev(uint8_t* b) { return *(uint8_t**)(b + ALIGN + sizeof(void*)); }
+
+  static int binOf(size_t s) {
+    int bin = 0;
+    while (s >>= 1) bin++;
+    return bin < BINS ? bin : BINS - 1;
+  }
+
+  static void setTags(uint8_t* b, size_t s, bool used) {
+    tag(b) = s | (used ? USED : 0);
+    tag(b + s - sizeof(size_t)) = s | (used ? USED : 0);
+  }
+
+  void makeFree(uint8_t* b, size_t s) {
+    setTags(b, s, false);
+    uint8_t*& head = bins[binOf(s)];
+    next(b) = head;
+    prev(b) = nullptr;
+    if (head) prev(head) = b;
+    head = b;
+    freeBytes += s;
+    freeChunks++;
+  }
+
+  void unlink(uint8_t* b) {
+    if (prev(b)) {
+      next(prev(b)) = next(b);
+    } else {
+      bins[binOf(sizeOf(b))] = next(b);
+    }
+    if (next(b)) prev(next(b)) = prev(b);
+    freeBytes -= sizeOf(b);
+    freeChunks--;
+  }
+};
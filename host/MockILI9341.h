@@ -0,0 +1,214 @@
+/*
+  MockILI9341.h
+
+  A host stand-in for Adafruit_ILI9341 that keeps the picture (it is a
+  Canvas565) and counts what the real driver would put on the SPI bus. It
+  follows the write paths of Adafruit_SPITFT / Adafruit_ILI9341:
+
+  - startWrite / endWrite: chip select low / high (one transaction)
+  - setAddrWindow: CASET + 4 bytes, PASET + 4 bytes, RAMWR. As the library
+    does, CASET or PASET is skipped when that range didn't change.
+  - writePixel: a 1x1 window, then 2 bytes
+  - writeFillRect, writeFastHLine/VLine: one window, then 2 bytes a pixel
+  - drawPixel, fillRect, drawFastHLine/VLine: as above in their own
+    transaction, none at all when fully off screen
+
+  Every command byte also toggles D/C twice (low for the command, then high).
+*/
+
+#pragma once
+
+#include "Canvas565.h"
+
+#define ILI9341_CASET 0x2A
+#define ILI9341_PASET 0x2B
+#define ILI9341_RAMWR 0x2C
+
+/**
+ * @brief SPI traffic, in the units the bus sees it.
+ */
+struct SpiCost {
+  uint64_t commandBytes; // with D/C low
+  uint64_t dataBytes;    // window coordinates
+  uint64_t pixelBytes;   // colours
+  uint64_t windows;      // setAddrWindow calls
+  uint64_t csToggles;    // chip select edges
+  uint64_t dcToggles;    // data / command edges
+
+  uint64_t bytes() const { return commandBytes + dataBytes + pixelBytes; }
+
+  /**
+   * @brief Time on the bus at a given SPI clock, not counting gaps between transfers.
+   */
+  double micros(uint32_t hz) const { return bytes() * 8 * 1e6 / hz; }
+
+  SpiCost operator-(const SpiCost& o) const {
+    return {commandBytes - o.commandBytes, dataBytes - o.dataBytes, pixelBytes - o.pixelBytes,
+            windows - o.windows, csToggles - o.csToggles, dcToggles - o.dcToggles};
+  }
+  SpiCost& operator+=(const SpiCost& o) {
+    commandBytes += o.commandBytes; dataBytes += o.dataBytes; pixelBytes += o.pixelBytes;
+    windows += o.windows; csToggles += o.csToggles; dcToggles += o.dcToggles;
+    return *this;
+  }
+};
+
+class MockILI9341 : public Canvas565 {
+public:
+  SpiCost spi;
+
+  // Bounding box of the pixels written since resetDamage(), empty when x1 < x0
+  int16_t damageX0, damageY0, damageX1, damageY1;
+
+  MockILI9341() : Canvas565(240, 320), spi(), oldX1(0xFFFF), oldX2(0xFFFF), oldY1(0xFFFF), oldY2(0xFFFF) {
+    resetDamage();
+  }
+
+  void resetSpi() { spi = SpiCost(); }
+
+  void resetDamage() {
+    damageX0 = damageY0 = INT16_MAX;
+    damageX1 = damageY1 = INT16_MIN;
+  }
+
+  /**
+   * @brief What sending the damaged box as one bitmap (drawRGBBitmap) would cost.
+   */
+  SpiCost damageAsBitmap() const {
+    SpiCost c = SpiCost();
+    if (damageX1 < damageX0) return c;
+    c.csToggles = 2;
+    c.windows = 1;
+    c.commandBytes = 3;
+    c.dataBytes = 8;
+    c.dcToggles = 6;
+    c.pixelBytes = 2ull * (damageX1 - damageX0 + 1) * (damageY1 - damageY0 + 1);
+    return c;
+  }
+
+  void startWrite() override { spi.csToggles++; }
+  void endWrite() override { spi.csToggles++; }
+
+  void setAddrWindow(uint16_t x1, uint16_t y1, uint16_t w, uint16_t h) {
+    uint16_t x2 = x1 + w - 1, y2 = y1 + h - 1;
+    spi.windows++;
+    if (x1 != oldX1 || x2 != oldX2) {
+      command(ILI9341_CASET);
+      spi.dataBytes += 4;
+      oldX1 = x1;
+      oldX2 = x2;
+    }
+    if (y1 != oldY1 || y2 != oldY2) {
+      command(ILI9341_PASET);
+      spi.dataBytes += 4;
+      oldY1 = y1;
+      oldY2 = y2;
+    }
+    command(ILI9341_RAMWR);
+  }
+
+  void writePixel(int16_t x, int16_t y, uint16_t color) override {
+    if (x < 0 || y < 0 || x >= _width || y >= _height) return;
+    setAddrWindow(x, y, 1, 1);
+    spi.pixelBytes += 2;
+    store(x, y, 1, 1, color);
+  }
+
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override {
+    if (x < 0 || y < 0 || x >= _width || y >= _height) return;
+    startWrite();
+    writePixel(x, y, color);
+    endWrite();
+  }
+
+  void writeFillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) override {
+    if (!clip(x, y, w, h)) return;
+    setAddrWindow(x, y, w, h);
+    spi.pixelBytes += 2ull * w * h;
+    store(x, y, w, h, color);
+  }
+
+  void writeFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) override {
+    writeFillRect(x, y, w, 1, color);
+  }
+
+  void writeFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) override {
+    writeFillRect(x, y, 1, h, color);
+  }
+
+  void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) override {
+    calls[GFX_FILL_RECT]++;
+    if (!clip(x, y, w, h)) return;
+    startWrite();
+    writeFillRect(x, y, w, h, color);
+    endWrite();
+  }
+
+  void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) override {
+    calls[GFX_HLINE]++;
+    int16_t h = 1;
+    if (!clip(x, y, w, h)) return;
+    startWrite();
+    writeFillRect(x, y, w, h, color);
+    endWrite();
+  }
+
+  void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) override {
+    calls[GFX_VLINE]++;
+    int16_t w = 1;
+    if (!clip(x, y, w, h)) return;
+    startWrite();
+    writeFillRect(x, y, w, h, color);
+    endWrite();
+  }
+
+  /**
+   * @brief As Adafruit_SPITFT::drawRGBBitmap: one window for the whole bitmap.
+   */
+  void drawRGBBitmap(int16_t x, int16_t y, const uint16_t* pixels, int16_t w, int16_t h) {
+    int16_t cx = x, cy = y, cw = w, ch = h;
+    if (!clip(cx, cy, cw, ch)) return;
+    startWrite();
+    setAddrWindow(cx, cy, cw, ch);
+    spi.pixelBytes += 2ull * cw * ch;
+    Canvas565::drawRGBBitmap(x, y, pixels, w, h);
+    grow(cx, cy, cw, ch);
+    endWrite();
+  }
+
+private:
+  uint16_t oldX1, oldX2, oldY1, oldY2; // the last window, the library skips resending it
+
+  void command(uint8_t) {
+    spi.commandBytes++;
+    spi.dcToggles += 2;
+  }
+
+  // Clips to the screen, false if nothing is left (as Adafruit_SPITFT)
+  bool clip(int16_t& x, int16_t& y, int16_t& w, int16_t& h) const {
+    if (w < 0) { x += w + 1; w = -w; }
+    if (h < 0) { y += h + 1; h = -h; }
+    if (x >= _width || y >= _height || w == 0 || h == 0) return false;
+    int32_t x2 = (int32_t)x + w - 1, y2 = (int32_t)y + h - 1;
+    if (x2 < 0 || y2 < 0) return false;
+    if (x < 0) { x = 0; }
+    if (y < 0) { y = 0; }
+    if (x2 >= _width) x2 = _width - 1;
+    if (y2 >= _height) y2 = _height - 1;
+    w = x2 - x + 1;
+    h = y2 - y + 1;
+    return true;
+  }
+
+  void store(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+    Canvas565::writeFillRect(x, y, w, h, color);
+    grow(x, y, w, h);
+  }
+
+  void grow(int16_t x, int16_t y, int16_t w, int16_t h) {
+    if (x < damageX0) damageX0 = x;
+    if (y < damageY0) damageY0 = y;
+    if (x + w - 1 > damageX1) damageX1 = x + w - 1;
+    if (y + h - 1 > damageY1) damageY1 = y + h - 1;
+  }
+};
@@ -0,0 +1,187 @@
+/*
+  OverdrawCanvas.h
+
+  A RAM canvas that counts the writes to every pixel, and which shape made
+  them. Set it as the TouchManager observer, draw, then ask which shapes
+  wrote pixels that ended up hidden (by later shapes, or by themselves),
+  or save the counts as a heatmap.
+
+  It also measures regions: everything written between beginRegion() calls,
+  e.g. what one command damaged.
+*/
+
+#pragma once
+
+#include "Canvas565.h"
+#include "TouchManager.h"
+
+#include <algorithm>
+#include <vector>
+
+/**
+ * @brief The pixels one shape wrote.
+ */
+struct ShapeWrites {
+  const TouchShape* shape; // only valid while the shape exists
+  char type;               // command letter
+  int id;                  // group ID, 0 for none
+  uint64_t written;        // pixel writes
+  uint64_t visible;        // pixels it wrote last, see OverdrawCanvas::finish()
+  int16_t x0, y0, x1, y1;  // bounds of what it wrote
+
+  uint64_t wasted() const { return written - visible; }
+};
+
+class OverdrawCanvas : public Canvas565, public DrawObserver {
+public:
+  // Everything written since beginRegion()
+  uint64_t regionWrites; // pixel writes
+  uint64_t regionPixels; // distinct pixels
+  int16_t regionX0, regionY0, regionX1, regionY1; // bounds, empty when x1 < x0
+
+  OverdrawCanvas()
+    : Canvas565(240, 320), counts(240 * 320, 0), owner(240 * 320, -1), stamp(240 * 320, 0),
+      current(-1), generation(0) {
+    beginRegion();
+  }
+
+  /**
+   * @brief Forgets all counts and shapes (the picture stays).
+   */
+  void reset() {
+    std::fill(counts.begin(), counts.end(), 0);
+    std::fill(owner.begin(), owner.end(), -1);
+    stats.clear();
+    current = -1;
+    beginRegion();
+  }
+
+  void beginRegion() {
+    generation++;
+    regionWrites = regionPixels = 0;
+    regionX0 = regionY0 = INT16_MAX;
+    regionX1 = regionY1 = INT16_MIN;
+  }
+
+  void drawing(const TouchShape& shape) override {
+    for (size_t i = 0; i < stats.size(); i++) {
+      if (stats[i].shape == &shape) {
+        current = i;
+        return;
+      }
+    }
+    current = stats.size();
+    stats.push_back({&shape, shape.type(), shape.group ? shape.group->id : 0, 0, 0,
+                     INT16_MAX, INT16_MAX, INT16_MIN, INT16_MIN});
+  }
+
+  void drawn(const TouchShape&) override { current = -1; }
+
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override {
+    if (x < 0 || y < 0 || x >= _width || y >= _height) return;
+    account(x, y);
+    Canvas565::drawPixel(x, y, color);
+  }
+
+  void writeFillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) override {
+    int32_t x0, y0, x1, y1;
+    if (!clipRect(x, y, w, h, x0, y0, x1, y1)) return;
+    for (int32_t j = y0; j < y1; j++) {
+      for (int32_t i = x0; i < x1; i++) {
+        account(i, j);
+      }
+    }
+    Canvas565::writeFillRect(x, y, w, h, color);
+  }
+
+  /**
+   * @brief Writes to the pixel at x, y (screen coordinates).
+   */
+  uint16_t count(int16_t x, int16_t y) const {
+    if (x < 0 || y < 0 || x >= _width || y >= _height) return 0;
+    return counts[y * _width + x];
+  }
+
+  /**
+   * @brief Works out which shape each pixel was last written by.
+   * @return the shapes, in the order they were first drawn
+   */
+  const std::vector<ShapeWrites>& finish() {
+    for (auto& s : stats) s.visible = 0;
+    for (int32_t o : owner) {
+      if (o >= 0) stats[o].visible++;
+    }
+    return stats;
+  }
+
+  /**
+   * @brief The shapes, most wasted pixels first.
+   */
+  std::vector<ShapeWrites> ranking() {
+    std::vector<ShapeWrites> ranked = finish();
+    std::stable_sort(ranked.begin(), ranked.end(),
+                     [](const ShapeWrites& a, const ShapeWrites& b) { return a.wasted() > b.wasted(); });
+    return ranked;
+  }
+
+  /**
+   * @brief Pixels written at least `least` times.
+   */
+  uint64_t pixelsWritten(uint16_t least = 1) const {
+    uint64_t n = 0;
+    for (uint16_t c : counts) n += c >= least;
+    return n;
+  }
+
+  uint16_t maxCount() const {
+    return counts.empty() ? 0 : *std::max_element(counts.begin(), counts.end());
+  }
+
+  /**
+   * @brief Paints the counts into another canvas: black never written,
+   * then blue (once), cyan, green, yellow, orange, red for 6 or more.
+   */
+  void heatmap(Canvas565& out) const {
+    static const uint16_t ramp[] = {
+      C565_BLACK, 0x0010, 0x07FF, 0x07E0, 0xFFE0, 0xFD20, 0xF800
+    };
+    out.setRotation(rotation);
+    for (int16_t y = 0; y < _height; y++) {
+      for (int16_t x = 0; x < _width; x++) {
+        uint16_t c = counts[y * _width + x];
+        out.drawPixel(x, y, ramp[c < 6 ? c : 6]);
+      }
+    }
+  }
+
+private:
+  std::vector<uint16_t> counts; // writes per pixel, by screen position
+  std::vector<int32_t> owner;   // the stats index that wrote each pixel last, -1 for none
+  std::vector<uint32_t> stamp;  // region generation each pixel was last written in
+  std::vector<ShapeWrites> stats;
+  int32_t current;              // stats index of the shape being drawn, -1 for none
+  uint32_t generation;
+
+  void account(int32_t x, int32_t y) {
+    size_t p = (size_t)y * _width + x;
+    if (counts[p] < UINT16_MAX) counts[p]++;
+    owner[p] = current;
+    if (current >= 0) {
+      ShapeWrites& s = stats[current];
+      s.written++;
+      if (x < s.x0) s.x0 = x;
+      if (y < s.y0) s.y0 = y;
+      if (x > s.x1) s.x1 = x;
+      if (y > s.y1) s.y1 = y;
+    }
+    regionWrites++;
+    if (stamp[p] != generation) {
+      stamp[p] = generation;
+      regionPixels++;
+    }
+    if (x < regionX0) regionX0 = x;
+    if (y < regionY0) regionY0 = y;
+    if (x > regionX1) regionX1 = x;
+    if (y > regionY1) regionY1 = y;
+  }
+};
@@ -0,0 +1,28 @@
+/*
+  PrintSinks.h
+
+  Where the parser's output goes in host tools and tests: nowhere
+  (NullPrint, src/NullPrint.h), into a string to look at (StringPrint), or
+  to stdout (StdoutPrint).
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include "NullPrint.h"
+
+#include <cstdio>
+#include <string>
+
+class StringPrint : public Print {
+public:
+  std::string data;
+  size_t write(uint8_t b) override { data += (char)b; return 1; }
+  using Print::write;
+};
+
+class StdoutPrint : public Print {
+public:
+  size_t write(uint8_t b) override { return fputc(b, stdout) == EOF ? 0 : 1; }
+  using Print::write;
+};
@@ -0,0 +1,177 @@
+/*
+  Replay.h
+
+  Loads session captures (see src/SessionRecorder.h) and plays them into a
+  parser, TouchManager and RAM canvas, timing every command and touch.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include "Canvas565.h"
+#include "TouchManager.h"
+#include "CommandParser.h"
+#include "PrintSinks.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief One record of a capture.
+ */
+struct CaptureRecord {
+  uint32_t time; // device micros()
+  char type;     // 'R' received bytes, 't' touch
+  std::string data;
+};
+
+struct Capture {
+  std::vector<CaptureRecord> records;
+
+  /**
+   * @brief Reads the last capture ("MREC") in data, which can be a whole
+   * serial log. Anything else is taken as a plain command stream, all
+   * received at once.
+   * @return false (with error set) if the capture is cut short
+   */
+  bool load(const std::string& data, std::string* error = nullptr) {
+    records.clear();
+    size_t at = data.rfind("MREC");
+    if (at == std::string::npos || at + 9 > data.size() || data[at + 4] != 1) {
+      if (!data.empty()) records.push_back({0, 'R', data});
+      return true;
+    }
+    const uint8_t* p = (const uint8_t*)data.data() + at + 5;
+    uint32_t length = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    size_t end = at + 9 + length;
+    if (end > data.size()) {
+      if (error) *error = "capture is cut short";
+      return false;
+    }
+    for (size_t i = at + 9; i < end; ) {
+      if (i + 6 > end) {
+        if (error) *error = "bad record";
+        return false;
+      }
+      const uint8_t* r = (const uint8_t*)data.data() + i;
+      uint8_t n = r[5];
+      if (i + 6 + n > end) {
+        if (error) *error = "bad record";
+        return false;
+      }
+      uint32_t t = r[0] | (r[1] << 8) | (r[2] << 16) | ((uint32_t)r[3] << 24);
+      records.push_back({t, (char)r[4], data.substr(i + 6, n)});
+      i += 6 + n;
+    }
+    return true;
+  }
+
+  size_t bytes() const {
+    size_t n = 0;
+    for (const auto& r : records) n += r.type == 'R' ? r.data.size() : 0;
+    return n;
+  }
+};
+
+/**
+ * @brief Latencies of one kind of event, in microseconds.
+ */
+struct Latencies {
+  std::vector<double> us;
+
+  void add(double v) { us.push_back(v); }
+
+  /**
+   * @brief Nearest rank percentile, p from 0 to 100.
+   */
+  double percentile(double p) {
+    if (us.empty()) return 0;
+    std::sort(us.begin(), us.end());
+    size_t rank = (size_t)(p / 100 * us.size() + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > us.size()) rank = us.size();
+    return us[rank - 1];
+  }
+};
+
+struct ReplayResult {
+  uint64_t bytes;
+  uint64_t commands;
+  uint64_t touches;
+  double wallSeconds;  // start to finish, including waiting at original speed
+  double busySeconds;  // in the parser and hit tests
+  std::map<char, Latencies> commandLatency; // by command letter
+  Latencies touchLatency;
+  uint64_t hash;       // Canvas565::hash() of the final frame
+  uint64_t pixels;     // pixels written
+
+  double bytesPerSecond() const { return busySeconds > 0 ? bytes / busySeconds : 0; }
+};
+
+/**
+ * @brief Plays a capture into a fresh parser and TouchManager drawing on canvas.
+ * @param speed 0 for as fast as possible, 1 for the original timing, 2 for
+ * twice as fast and so on. At speed 0 a command's latency is the time to
+ * carry it out; otherwise it is from when its bytes arrived, so it includes
+ * waiting behind earlier commands (as on the device).
+ * @param rotation display rotation, as main.cpp
+ */
+inline ReplayResult replay(const Capture& capture, Canvas565& canvas, double speed = 0,
+                           uint8_t rotation = 1) {
+  using Clock = std::chrono::steady_clock;
+  auto us = [](Clock::duration d) { return std::chrono::duration<double, std::micro>(d).count(); };
+
+  canvas.setRotation(rotation);
+  TouchManager manager;
+  manager.begin(&canvas);
+  NullPrint echo;
+  CommandParser parser(manager, &canvas, echo, rotation);
+
+  ReplayResult result = ReplayResult();
+  Clock::time_point start = Clock::now();
+  Clock::duration busy = Clock::duration::zero();
+  uint32_t base = capture.records.empty() ? 0 : capture.records[0].time;
+
+  for (const CaptureRecord& record : capture.records) {
+    Clock::time_point arrival = Clock::now();
+    if (speed > 0) {
+      // micros() wraps every ~71 minutes, times are taken relative to the first record
+      arrival = start + std::chrono::microseconds((int64_t)((uint32_t)(record.time - base) / speed));
+      std::this_thread::sleep_until(arrival);
+    }
+    if (record.type == 't' && record.data.size() == 4) {
+      const uint8_t* d = (const uint8_t*)record.data.data();
+      int16_t x = d[0] | (d[1] << 8), y = d[2] | (d[3] << 8);
+      Clock::time_point t0 = Clock::now();
+      manager.findGroupIDAt(x, y);
+      Clock::time_point t1 = Clock::now();
+      busy += t1 - t0;
+      result.touchLatency.add(us(t1 - (speed > 0 ? arrival : t0)));
+      result.touches++;
+      continue;
+    }
+    if (record.type != 'R') continue;
+    for (unsigned char ch : record.data) {
+      bool wasBinary = parser.binary();
+      Clock::time_point t0 = Clock::now();
+      bool done = parser.feed(ch);
+      Clock::time_point t1 = Clock::now();
+      busy += t1 - t0;
+      result.bytes++;
+      done = done && (isupper(parser.c) || parser.c == '?'); // not separators
+      if (done || (wasBinary && !parser.binary())) { // a command, or the end of a 'V' packet
+        result.commandLatency[parser.c].add(us(t1 - (speed > 0 ? arrival : t0)));
+        result.commands++;
+      }
+    }
+  }
+  result.wallSeconds = us(Clock::now() - start) / 1e6;
+  result.busySeconds = us(busy) / 1e6;
+  result.hash = canvas.hash();
+  result.pixels = canvas.writes;
+  return result;
+}
@@ -0,0 +1,167 @@
+/*
+  SocketTcp.h
+
+  The parts of the Arduino WiFiServer and WiFiClient that
+  src/TcpTransport.h uses, on POSIX sockets, so the TCP link runs on the
+  PC (over loopback for the tests, see host/link.cpp -t). Non-blocking
+  throughout. Linux and macOS.
+*/
+
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 //macOS: SO_NOSIGPIPE instead, set on each socket
+#endif
+
+/**
+ * @brief Closes a socket when the last client copy is gone.
+ */
+struct SocketFd {
+  int fd;
+  explicit SocketFd(int fd) : fd(fd) {}
+  ~SocketFd() { if (fd >= 0) close(fd); }
+};
+
+class PosixClient {
+public:
+  PosixClient() {}
+
+  explicit PosixClient(int fd) : m_socket(std::make_shared<SocketFd>(fd)) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); //replies are small
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+  }
+
+  /**
+   * @brief Connects, waiting until it does (the host side, e.g. tests).
+   * @return a client that tests false if it couldn't
+   */
+  static PosixClient connect(const char* host, uint16_t port) {
+    addrinfo hints = {}, *found = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, std::to_string(port).c_str(), &hints, &found)) return PosixClient();
+    int fd = -1;
+    for (addrinfo* a = found; a && fd < 0; a = a->ai_next) {
+      fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+      if (fd >= 0 && ::connect(fd, a->ai_addr, a->ai_addrlen)) {
+        close(fd);
+        fd = -1;
+      }
+    }
+    freeaddrinfo(found);
+    return fd < 0 ? PosixClient() : PosixClient(fd);
+  }
+
+  explicit operator bool() const { return m_socket && m_socket->fd >= 0; }
+
+  int fd() const { return m_socket ? m_socket->fd : -1; }
+
+  /**
+   * @brief Open, or closed by the other end with bytes still to read.
+   */
+  bool connected() {
+    if (!*this) return false;
+    char b;
+    ssize_t n = recv(fd(), &b, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
+  }
+
+  int available() {
+    int n = 0;
+    return *this && !ioctl(fd(), FIONREAD, &n) ? n : 0;
+  }
+
+  int read(uint8_t* buffer, size_t size) {
+    if (!*this) return -1;
+    ssize_t n = recv(fd(), buffer, size, MSG_DONTWAIT);
+    return n < 0 ? -1 : (int)n;
+  }
+
+  /**
+   * @brief The kernel's send buffer takes what it can, see write.
+   */
+  int availableForWrite() { return *this ? 65536 : 0; }
+
+  /**
+   * @return the bytes taken, fewer (maybe 0) if the send buffer is full
+   */
+  size_t write(const uint8_t* buffer, size_t size) {
+    if (!*this) return 0;
+    ssize_t n = send(fd(), buffer, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+    return n < 0 ? 0 : (size_t)n;
+  }
+
+  void stop() { m_socket.reset(); }
+
+private:
+  std::shared_ptr<SocketFd> m_socket;
+};
+
+class PosixServer {
+public:
+  /**
+   * @param port 0 for any free one, see port()
+   */
+  explicit PosixServer(uint16_t port) : m_port(port), m_fd(-1) {}
+  ~PosixServer() { if (m_fd >= 0) close(m_fd); }
+
+  PosixServer(const PosixServer&) = delete;
+  PosixServer& operator=(const PosixServer&) = delete;
+
+  /**
+   * @brief Listens on every address.
+   * @return false if the port couldn't be had
+   */
+  bool begin() {
+    m_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_fd < 0) return false;
+    int one = 1;
+    setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(m_port);
+    if (bind(m_fd, (sockaddr*)&addr, sizeof(addr)) || listen(m_fd, 4)) {
+      close(m_fd);
+      m_fd = -1;
+      return false;
+    }
+    fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_NONBLOCK);
+    socklen_t length = sizeof(addr);
+    getsockname(m_fd, (sockaddr*)&addr, &length);
+    m_port = ntohs(addr.sin_port);
+    return true;
+  }
+
+  uint16_t port() const { return m_port; }
+
+  /**
+   * @return a host waiting to connect, or a client that tests false
+   */
+  PosixClient accept() {
+    if (m_fd < 0) return PosixClient();
+    int fd = ::accept(m_fd, nullptr, nullptr);
+    return fd < 0 ? PosixClient() : PosixClient(fd);
+  }
+
+private:
+  uint16_t m_port;
+  int m_fd;
+};
@@ -0,0 +1,82 @@
+/*
+  WorkStealingPool.h
+
+  Runs a batch of independent jobs on all cores. Each thread starts with its
+  own share of the jobs and takes them from the back of its queue; when it
+  runs out it steals from the front of another thread's, so a few slow jobs
+  don't leave the other cores idle.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool {
+public:
+  explicit WorkStealingPool(unsigned threads = 0)
+    : count(threads ? threads : std::max(1u, std::thread::hardware_concurrency())), stolen(0) {}
+
+  unsigned threads() const { return count; }
+
+  // Jobs taken from another thread's queue in the last run()
+  uint64_t steals() const { return stolen; }
+
+  /**
+   * @brief Calls job(index, thread) for every index below jobs, and returns
+   * when they are all done. Jobs must not depend on each other.
+   */
+  void run(size_t jobs, const std::function<void(size_t index, unsigned thread)>& job) {
+    std::vector<Queue> queues(count);
+    // contiguous shares, so neighbouring jobs tend to run on the same thread
+    for (size_t i = 0; i < jobs; i++) {
+      queues[i * count / (jobs ? jobs : 1)].tasks.push_back(i);
+    }
+    stolen = 0;
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < count; t++) {
+      workers.emplace_back([&, t]() {
+        size_t index;
+        while (next(queues, t, index)) job(index, t);
+      });
+    }
+    for (auto& w : workers) w.join();
+  }
+
+private:
+  struct Queue {
+    std::mutex lock;
+    std::deque<size_t> tasks;
+  };
+
+  unsigned count;
+  std::atomic<uint64_t> stolen;
+
+  bool next(std::vector<Queue>& queues, unsigned self, size_t& index) {
+    {
+      Queue& own = queues[self];
+      std::lock_guard<std::mutex> hold(own.lock);
+      if (!own.tasks.empty()) {
+        index = own.tasks.back();
+        own.tasks.pop_back();
+        return true;
+      }
+    }
+    for (unsigned k = 1; k < count; k++) {
+      Queue& victim = queues[(self + k) % count];
+      std::lock_guard<std::mutex> hold(victim.lock);
+      if (!victim.tasks.empty()) {
+        index = victim.tasks.front();
+        victim.tasks.pop_front();
+        stolen++;
+        return true;
+      }
+    }
+    return false; // nothing is added during a run, so empty everywhere means done
+  }
+};
@@ -0,0 +1,175 @@
+/*
+  batch.cpp
+
+  Replays a whole corpus of recorded sessions (captures or plain command
+  streams) at once, each in its own parser, TouchManager and RAM canvas,
+  spread over all cores. Prints one JSON line per stream: timing, pixels
+  written and the frame hash. Given the output of an earlier run as a
+  baseline, it lists the streams whose frames changed, so a new build can be
+  checked against every stream before it goes out.
+
+    pio run -e batch && .pio/build/batch/program [-j threads] [-o frames/]
+        [-b baseline.jsonl] captures/ more.bin ... > results.jsonl
+
+  Directories are searched for files. Exits with 1 if any stream failed to
+  load or a frame differs from the baseline.
+*/
+
+#include "Replay.h"
+#include "WorkStealingPool.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+struct StreamResult {
+  std::string error;
+  ReplayResult replay;
+  double p50, p99; // command latency, us
+};
+
+static std::string jsonEscape(const std::string& s) {
+  std::string out;
+  for (char ch : s) {
+    if (ch == '"' || ch == '\\') out += '\\';
+    if ((unsigned char)ch < 0x20) continue;
+    out += ch;
+  }
+  return out;
+}
+
+/**
+ * @brief Reads file to hash from the JSON lines of an earlier run.
+ */
+static bool loadBaseline(const char* path, std::unordered_map<std::string, std::string>& hashes) {
+  std::ifstream f(path);
+  if (!f) return false;
+  std::string line;
+  auto field = [](const std::string& line, const char* name) {
+    std::string key = std::string("\"") + name + "\": \"";
+    size_t at = line.find(key);
+    if (at == std::string::npos) return std::string();
+    at += key.size();
+    std::string value;
+    for (; at < line.size() && line[at] != '"'; at++) {
+      if (line[at] == '\\' && at + 1 < line.size()) at++;
+      value += line[at];
+    }
+    return value;
+  };
+  while (std::getline(f, line)) {
+    std::string file = field(line, "file"), hash = field(line, "hash");
+    if (!file.empty() && !hash.empty()) hashes[file] = hash;
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  unsigned threads = 0;
+  const char* frames = nullptr;
+  const char* baselinePath = nullptr;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      frames = argv[++i];
+    } else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+      baselinePath = argv[++i];
+    } else if (argv[i][0] == '-') {
+      fprintf(stderr, "usage: %s [-j threads] [-o frames_dir] [-b baseline.jsonl] streams_or_dirs...\n", argv[0]);
+      return 2;
+    } else if (fs::is_directory(argv[i])) {
+      for (const auto& entry : fs::recursive_directory_iterator(argv[i])) {
+        if (entry.is_regular_file()) files.push_back(entry.path().string());
+      }
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+  std::sort(files.begin(), files.end());
+
+  std::unordered_map<std::string, std::string> baseline;
+  if (baselinePath && !loadBaseline(baselinePath, baseline)) {
+    fprintf(stderr, "can't read %s\n", baselinePath);
+    return 2;
+  }
+  if (frames) fs::create_directories(frames);
+
+  std::vector<StreamResult> results(files.size());
+  WorkStealingPool pool(threads);
+  auto start = std::chrono::steady_clock::now();
+  pool.run(files.size(), [&](size_t i, unsigned) {
+    StreamResult& r = results[i];
+    std::ifstream f(files[i], std::ios::binary);
+    if (!f) {
+      r.error = "can't read";
+      return;
+    }
+    std::stringstream data;
+    data << f.rdbuf();
+    Capture capture;
+    if (!capture.load(data.str(), &r.error)) return;
+    Canvas565 canvas;
+    r.replay = replay(capture, canvas);
+    Latencies all;
+    for (auto& it : r.replay.commandLatency) {
+      all.us.insert(all.us.end(), it.second.us.begin(), it.second.us.end());
+    }
+    r.p50 = all.percentile(50);
+    r.p99 = all.percentile(99);
+    if (frames) {
+      std::string name = files[i];
+      for (char& ch : name) {
+        if (ch == '/' || ch == '\\') ch = '_';
+      }
+      canvas.writePNG((fs::path(frames) / (name + ".png")).string().c_str());
+    }
+  });
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  size_t failed = 0, changed = 0, unknown = 0;
+  uint64_t bytes = 0;
+  double busy = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    const StreamResult& r = results[i];
+    if (!r.error.empty()) {
+      printf("{\"file\": \"%s\", \"error\": \"%s\"}\n", jsonEscape(files[i]).c_str(), r.error.c_str());
+      failed++;
+      continue;
+    }
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)r.replay.hash);
+    const char* status = "";
+    if (baselinePath) {
+      auto it = baseline.find(files[i]);
+      if (it == baseline.end()) {
+        status = ", \"baseline\": \"new\"";
+        unknown++;
+      } else if (it->second != hash) {
+        status = ", \"baseline\": \"changed\"";
+        changed++;
+      } else {
+        status = ", \"baseline\": \"same\"";
+      }
+    }
+    printf("{\"file\": \"%s\", \"bytes\": %llu, \"commands\": %llu, \"busy_us\": %.0f, "
+           "\"p50_us\": %.2f, \"p99_us\": %.2f, \"pixels\": %llu, \"hash\": \"%s\"%s}\n",
+           jsonEscape(files[i]).c_str(), (unsigned long long)r.replay.bytes,
+           (unsigned long long)r.replay.commands, r.replay.busySeconds * 1e6, r.p50, r.p99,
+           (unsigned long long)r.replay.pixels, hash, status);
+    bytes += r.replay.bytes;
+    busy += r.replay.busySeconds;
+  }
+  fprintf(stderr, "%zu streams, %llu bytes in %.2f s on %u threads (%.1f s of work, %llu stolen), "
+          "%zu failed", files.size(), (unsigned long long)bytes, wall, pool.threads(), busy,
+          (unsigned long long)pool.steals(), failed);
+  if (baselinePath) fprintf(stderr, ", %zu changed, %zu not in the baseline", changed, unknown);
+  fprintf(stderr, "\n");
+  return failed || changed ? 1 : 0;
+}
@@ -0,0 +1,398 @@
+/*
+  bench.cpp
+
+  Host benchmarks for TouchManager, the command parser and the pixel kernels.
+  Prints JSON, so builds can be compared before firmware goes out.
+
+    pio run -e bench && .pio/build/bench/program [stream files...] > bench.json
+
+  Each stream file given is also run through the parser, as a recorded stream,
+  on one thread and as the dual core pipeline (src/Pipeline.h) on two.
+  Times are the best of several runs. "pixels_per_op" is what the run wrote to the
+  (null) display, per op. A kernel op is one row of the span length, run with
+each implementation this CPU has.
+*/
+
+#include <Arduino.h>
+#include <Adafruit_GFX.h>
+#include "TouchManager.h"
+#include "CommandParser.h"
+#include "PixelKernels.h"
+#include "Pipeline.h"
+#include "PrintSinks.h"
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A 320x240 display that only counts what is written to it.
+ * Rects and lines are counted as fills, like the real controller.
+ */
+class NullDisplay : public Adafruit_GFX {
+public:
+  uint64_t pixels;
+
+  NullDisplay() : Adafruit_GFX(240, 320), pixels(0) { setRotation(1); }
+
+  void drawPixel(int16_t x, int16_t y, uint16_t) override {
+    if (x >= 0 && y >= 0 && x < _width && y < _height) pixels++;
+  }
+  void writeFillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t) override {
+    count(x, y, w, h);
+  }
+  void writeFastHLine(int16_t x, int16_t y, int16_t w, uint16_t) override { count(x, y, w, 1); }
+  void writeFastVLine(int16_t x, int16_t y, int16_t h, uint16_t) override { count(x, y, 1, h); }
+
+private:
+  void count(int32_t x, int32_t y, int32_t w, int32_t h) {
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > _width) w = _width - x;
+    if (y + h > _height) h = _height - y;
+    if (w > 0 && h > 0) pixels += w * h;
+  }
+};
+
+// Deterministic pseudo random numbers, so every build sees the same scenes
+static uint32_t rngState = 1;
+static void seed(uint32_t s) { rngState = s ? s : 1; }
+static int rnd(int n) {
+  rngState = rngState * 1664525u + 1013904223u;
+  return (rngState >> 8) % n;
+}
+
+enum Mix { RECTS, CIRCLES, POLYGONS, TEXT, MIXED };
+static const char* mixName[] = {"rects", "circles", "polygons", "text", "mixed"};
+
+static void addShape(TouchManager& tm, Mix mix, int i) {
+  int kind = mix == MIXED ? i % 4 : mix;
+  int x = rnd(300), y = rnd(220), id = 1 + i % 50;
+  uint16_t color = rnd(0x10000);
+  switch (kind) {
+    case RECTS:
+      tm.addRect(x, y, 5 + rnd(60), 5 + rnd(40), color, true, id);
+      break;
+    case CIRCLES:
+      tm.addCircle(x, y, 5 + rnd(40), color, true, id);
+      break;
+    case POLYGONS: {
+      std::vector<GFXPoint> pts;
+      for (int k = 0; k < 6; k++) {
+        pts.push_back({(int16_t)(x + rnd(50)), (int16_t)(y + rnd(50))});
+      }
+      tm.addPolygon(pts, color, true, id);
+      break;
+    }
+    default:
+      tm.addText(x, y, "Label 12", 0, color, 1 + rnd(2), 1, id);
+      break;
+  }
+}
+
+static void buildScene(TouchManager& tm, Mix mix, int count) {
+  seed(count * 7 + mix);
+  for (int i = 0; i < count; i++) addShape(tm, mix, i);
+}
+
+struct Result {
+  std::string name;
+  uint64_t ops;
+  double seconds;
+  uint64_t pixels;
+};
+
+static std::vector<Result> results;
+
+/**
+ * @brief Runs fn (which does `ops` operations and returns pixels written)
+ * a few times, and keeps the fastest.
+ */
+static void measure(const std::string& name, uint64_t ops, const std::function<uint64_t()>& fn,
+                    int runs = 5) {
+  Result best = {name, ops, 1e30, 0};
+  for (int r = 0; r < runs; r++) {
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t px = fn();
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (s < best.seconds) {
+      best.seconds = s;
+      best.pixels = px;
+    }
+  }
+  results.push_back(best);
+  fprintf(stderr, "%-32s %10.1f ns/op\n", name.c_str(), best.seconds * 1e9 / ops);
+}
+
+// ---- Benchmarks ----
+
+static void benchInsert() {
+  for (int mix = RECTS; mix <= MIXED; mix++) {
+    for (int count : {100, 1000}) {
+      std::string suffix = std::string(mixName[mix]) + "/" + std::to_string(count);
+      measure("insert/" + suffix, count, [&]() -> uint64_t {
+        TouchManager tm;
+        buildScene(tm, (Mix)mix, count);
+        return 0;
+      });
+      measure("insert_draw/" + suffix, count, [&]() -> uint64_t {
+        NullDisplay gfx;
+        TouchManager tm;
+        tm.begin(&gfx);
+        buildScene(tm, (Mix)mix, count);
+        return gfx.pixels;
+      });
+    }
+  }
+}
+
+static void benchHitTest() {
+  for (int mix = RECTS; mix <= MIXED; mix++) {
+    for (int count : {10, 100, 1000}) {
+      NullDisplay gfx;
+      TouchManager tm;
+      tm.begin(&gfx); // text needs drawing once to know its bounds
+      buildScene(tm, (Mix)mix, count);
+      const int probes = 32 * 24;
+      measure("findGroupIDAt/" + std::string(mixName[mix]) + "/" + std::to_string(count), probes,
+              [&]() -> uint64_t {
+        volatile int sink = 0;
+        for (int y = 0; y < 240; y += 10) {
+          for (int x = 0; x < 320; x += 10) {
+            sink += tm.findGroupIDAt(x, y);
+          }
+        }
+        return 0;
+      });
+    }
+  }
+}
+
+static void benchDrawAll() {
+  for (int mix = RECTS; mix <= MIXED; mix++) {
+    for (int count : {10, 100, 1000}) {
+      TouchManager tm;
+      buildScene(tm, (Mix)mix, count);
+      measure("drawAll/" + std::string(mixName[mix]) + "/" + std::to_string(count), 1,
+              [&]() -> uint64_t {
+        NullDisplay gfx;
+        tm.drawAll(&gfx);
+        return gfx.pixels;
+      });
+    }
+  }
+}
+
+static void benchPolygonContains() {
+  for (int vertices : {4, 16, 64}) {
+    std::vector<GFXPoint> star;
+    for (int i = 0; i < vertices; i++) {
+      double a = 2 * M_PI * i / vertices;
+      int r = (i & 1) ? 40 : 100;
+      star.push_back({(int16_t)(160 + r * cos(a)), (int16_t)(120 + r * sin(a))});
+    }
+    TouchPolygon poly(star.data(), star.size(), C565_WHITE, true, nullptr);
+    const int probes = 64 * 48;
+    measure("polygon_contains/" + std::to_string(vertices), probes, [&]() -> uint64_t {
+      volatile int sink = 0;
+      for (int y = 0; y < 240; y += 5) {
+        for (int x = 0; x < 320; x += 5) {
+          sink += poly.contains(x, y);
+        }
+      }
+      return 0;
+    });
+  }
+}
+
+static void benchGraph() {
+  for (int count : {1, 4}) {
+    const int columns = 10000;
+    std::string suffix = std::to_string(count) + "series";
+    measure("graph_append/" + suffix, columns, [&]() -> uint64_t {
+      TouchManager tm;
+      tm.beginGraph(10, 10, 300, 200, C565_GREEN, true, 1, 10);
+      int16_t column[4];
+      for (int i = 0; i < columns; i++) {
+        for (int k = 0; k < count; k++) column[k] = (i * (k + 3)) % 1000;
+        tm.appendGraph(1, column, count);
+      }
+      return 0;
+    });
+    const int drawn = 300;
+    measure("graph_add_draw/" + suffix, drawn, [&]() -> uint64_t {
+      NullDisplay gfx;
+      TouchManager tm;
+      tm.begin(&gfx);
+      std::vector<int> column(count);
+      for (int i = 0; i < drawn; i++) {
+        for (int k = 0; k < count; k++) column[k] = (i * (k + 3)) % 1000;
+        tm.addGraph(10, 10, 300, 200, C565_GREEN, true, 1, column, 10);
+      }
+      return gfx.pixels;
+    }, 3);
+  }
+}
+
+static void benchKernels() {
+  using namespace PixelKernels;
+  for (size_t span : {16, 240, 76800}) {
+    const size_t rows = 2000000 / span + 1;
+    std::vector<uint16_t> src(span), dst(span);
+    seed(span);
+    for (auto& p : src) p = rnd(4) ? rnd(0x10000) : 0xF81F;
+    for (const Kernels* const* k = available(); *k; k++) {
+      const Kernels& kn = **k;
+      std::string suffix = std::string(kn.name) + "/" + std::to_string(span);
+      auto run = [&](const std::function<void()>& op) -> uint64_t {
+        for (size_t r = 0; r < rows; r++) op();
+        volatile uint16_t sink = dst[span / 2];
+        (void)sink;
+        return rows * span;
+      };
+      measure("kernel_fill16/" + suffix, rows, [&]() {
+        return run([&]() { kn.fill16(dst.data(), 0x1234, span); });
+      });
+      measure("kernel_copy16/" + suffix, rows, [&]() {
+        return run([&]() { kn.copy16(dst.data(), src.data(), span); });
+      });
+      measure("kernel_blitKey16/" + suffix, rows, [&]() {
+        return run([&]() { kn.blitKey16(dst.data(), src.data(), span, 0xF81F); });
+      });
+      measure("kernel_swap16/" + suffix, rows, [&]() {
+        return run([&]() { kn.swap16(dst.data(), src.data(), span); });
+      });
+    }
+  }
+}
+
+// ---- Parser streams ----
+
+static std::string sceneStream() {
+  std::ostringstream s;
+  seed(42);
+  s << "Z\n";
+  for (int i = 0; i < 200; i++) {
+    s << (1 + i % 20) << "i " << rnd(300) << "x " << rnd(220) << "y ";
+    switch (i % 4) {
+      case 0: s << rnd(60) << "w " << rnd(40) << "h #" << std::hex << rnd(0x10000) << std::dec << "C R\n"; break;
+      case 1: s << rnd(40) << "d #f800C O\n"; break;
+      case 2: s << "P " << rnd(300) << "x " << rnd(220) << "y P " << rnd(300) << "x P #ffe0C S\n"; break;
+      default: s << "#ffffC 1h \"Label " << i << "\" T\n"; break;
+    }
+  }
+  return s.str();
+}
+
+static std::string graphAsciiStream() {
+  std::ostringstream s;
+  s << "Z 1i 10x 10y 300w 200h #07e0C 10a\n";
+  for (int i = 0; i < 2000; i++) {
+    s << (i * 7) % 1000 << "," << (i * 13) % 1000 << "G\n";
+  }
+  return s.str();
+}
+
+static std::string graphBinaryStream() {
+  std::string s = "Z 1i 10x 10y 300w 200h #07e0C 10a ";
+  for (int packet = 0; packet < 20; packet++) {
+    const int columns = 100;
+    s += "V";
+    s += (char)0; // int16
+    s += (char)2; // series
+    s += (char)(columns & 0xFF);
+    s += (char)(columns >> 8);
+    for (int i = 0; i < columns; i++) {
+      for (int k = 0; k < 2; k++) {
+        int16_t v = ((packet * columns + i) * (k == 0 ? 7 : 13)) % 1000;
+        s += (char)(v & 0xFF);
+        s += (char)(v >> 8);
+      }
+    }
+  }
+  return s;
+}
+
+static void benchParser(const std::string& name, const std::string& stream) {
+  measure("parse/" + name, stream.size(), [&]() -> uint64_t {
+    NullDisplay gfx;
+    NullPrint out;
+    TouchManager tm;
+    tm.begin(&gfx);
+    CommandParser parser(tm, &gfx, out);
+    for (unsigned char ch : stream) parser.feed(ch);
+    return gfx.pixels;
+  });
+}
+
+/**
+ * @brief As benchParser, with the drawing on a second thread through a Pipeline.
+ */
+static void benchPipeline(const std::string& name, const std::string& stream) {
+  measure("pipeline/" + name, stream.size(), [&]() -> uint64_t {
+    NullDisplay gfx;
+    NullPrint out;
+    TouchManager tm;
+    tm.begin(&gfx);
+    CommandParser parser(tm, &gfx, out);
+    Pipeline pipeline;
+    parser.pipeline = &pipeline;
+    RenderLoop render(pipeline, tm, &gfx);
+    std::atomic<bool> stop(false);
+    std::thread core1([&]() { render.run(stop); });
+    for (unsigned char ch : stream) parser.feed(ch);
+    pipeline.drain();
+    stop = true;
+    core1.join();
+    return gfx.pixels;
+  });
+}
+
+static std::string jsonEscape(const std::string& s) {
+  std::string out;
+  for (char ch : s) {
+    if (ch == '"' || ch == '\\') out += '\\';
+    out += ch;
+  }
+  return out;
+}
+
+int main(int argc, char** argv) {
+  benchInsert();
+  benchHitTest();
+  benchDrawAll();
+  benchPolygonContains();
+  benchGraph();
+  benchKernels();
+  benchParser("scene", sceneStream());
+  benchParser("graph_ascii", graphAsciiStream());
+  benchParser("graph_binary", graphBinaryStream());
+  benchPipeline("scene", sceneStream());
+  benchPipeline("graph_ascii", graphAsciiStream());
+  benchPipeline("graph_binary", graphBinaryStream());
+  for (int i = 1; i < argc; i++) {
+    std::ifstream f(argv[i], std::ios::binary);
+    if (!f) {
+      fprintf(stderr, "can't read %s\n", argv[i]);
+      return 1;
+    }
+    std::stringstream data;
+    data << f.rdbuf();
+    benchParser(argv[i], data.str());
+    benchPipeline(argv[i], data.str());
+  }
+
+  printf("{\n  \"compiler\": \"%s\",\n  \"benchmarks\": [\n", jsonEscape(__VERSION__).c_str());
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result& r = results[i];
+    printf("    {\"name\": \"%s\", \"ops\": %llu, \"ns_per_op\": %.1f, \"ops_per_sec\": %.0f, \"pixels_per_op\": %.1f}%s\n",
+           jsonEscape(r.name).c_str(), (unsigned long long)r.ops, r.seconds * 1e9 / r.ops,
+           r.ops / r.seconds, (double)r.pixels / r.ops, i + 1 < results.size() ? "," : "");
+  }
+  printf("  ]\n}\n");
+  return 0;
+}
@@ -0,0 +1,103 @@
+/*
+  chain.cpp
+
+  A daisy chain of MERGIF nodes on the PC (src/ChainLink.h, host/ChainSim.h):
+  a framed command stream goes in at the first node, each node parses what
+  is addressed to it, and what comes back to the host is printed to stdout,
+  tagged with the node it came from.
+
+    pio run -e chain && .pio/build/chain/program -n 4 -o node scene.txt
+      (saves node0.png .. node3.png)
+    printf '~*:Z\n~1:1i 10x 10y 40w 30h R\n' | .pio/build/chain/program -t 1,20,20
+
+  -t touches a node's screen at x,y after the input is run, as the touch
+  task would. Prints a JSON line per node to stderr: the bytes passed along
+  each way, the shapes and the frame hash.
+*/
+
+#include <Arduino.h>
+#include "ChainSim.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct Touch {
+  int node, x, y;
+};
+
+int main(int argc, char** argv) {
+  int count = 4;
+  int rotation = 1;
+  const char* out = nullptr;
+  std::vector<Touch> touches;
+  std::vector<const char*> inputs;
+  for (int i = 1; i < argc; i++) {
+    Touch t;
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+      count = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+      rotation = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      out = argv[++i];
+    } else if (!strcmp(argv[i], "-t") && i + 1 < argc && sscanf(argv[++i], "%d,%d,%d", &t.node, &t.x, &t.y) == 3) {
+      touches.push_back(t);
+    } else if (argv[i][0] != '-') {
+      inputs.push_back(argv[i]);
+    } else {
+      fprintf(stderr, "usage: %s [-n nodes] [-r rotation] [-o prefix] [-t node,x,y]... [streams...]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (count < 1) {
+    fprintf(stderr, "-n: at least one node\n");
+    return 2;
+  }
+
+  ChainSim chain(count, rotation);
+  std::string back;
+  auto feedFile = [&](FILE* f) {
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+      chain.send(std::string(buffer, n));
+      back += chain.run(); //as the UART would, not all at once
+    }
+  };
+  if (inputs.empty()) feedFile(stdin);
+  for (const char* name : inputs) {
+    FILE* f = fopen(name, "rb");
+    if (!f) {
+      fprintf(stderr, "can't open %s\n", name);
+      return 1;
+    }
+    feedFile(f);
+    fclose(f);
+  }
+  for (const Touch& t : touches) {
+    if (t.node < 0 || t.node >= count) {
+      fprintf(stderr, "-t: no node %d\n", t.node);
+      return 2;
+    }
+    chain.touch(t.node, t.x, t.y);
+  }
+  back += chain.run();
+  fwrite(back.data(), 1, back.size(), stdout);
+
+  for (int i = 0; i < count; i++) {
+    ChainSim::Node& n = *chain.nodes[i];
+    if (out) {
+      std::string name = std::string(out) + std::to_string(i) + ".png";
+      if (!n.canvas.save(name.c_str())) {
+        fprintf(stderr, "can't write %s\n", name.c_str());
+        return 1;
+      }
+    }
+    fprintf(stderr, "{\"node\":%d,\"down\":%u,\"up\":%u,\"dropped\":%u,\"shapes\":%zu,\"hash\":\"%016llx\"}\n",
+            i, n.link->forwardedDown, n.link->forwardedUp, n.link->outDropped,
+            n.manager.shapes().size(), (unsigned long long)n.canvas.hash());
+  }
+  return 0;
+}
@@ -0,0 +1,108 @@
+/*
+  link.cpp
+
+  The firmware's command path on the PC, over a live link: the parser,
+  TouchManager and a RAM canvas, fed from stdin (replies on stdout) or a
+  pseudo terminal that serial tools open as if it were the device, or TCP
+  as on the Pico W. For end to end throughput, with the same tools used on
+  the real link.
+
+    pio run -e link && .pio/build/link/program < scene.txt > replies.txt
+    pio run -e link && .pio/build/link/program -p
+      (prints the pty to open, e.g. python3 tools/latency.py --port /dev/pts/3)
+    pio run -e link && .pio/build/link/program -t 2323
+      (then e.g. nc localhost 2323 < scene.txt)
+
+  Runs until the input ends (the pty or connection is closed), then prints a
+  JSON line to stderr with the bytes in and out, the time and the frame hash.
+  -o saves the final frame.
+*/
+
+#include <Arduino.h>
+#include "CommandParser.h"
+#include "Canvas565.h"
+#include "FdTransport.h"
+#include "SocketTcp.h"
+#include "TcpTransport.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+int main(int argc, char** argv) {
+  bool pty = false;
+  int tcp = -1;
+  const char* out = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-p")) {
+      pty = true;
+    } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+      tcp = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      out = argv[++i];
+    } else {
+      fprintf(stderr, "usage: %s [-p | -t port] [-o frame.ppm|frame.png]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  std::unique_ptr<Transport> link;
+  std::unique_ptr<PosixServer> server;
+  FdTransport* fdLink = nullptr;
+  TcpTransport<PosixServer, PosixClient>* tcpLink = nullptr;
+  if (tcp >= 0) {
+    server.reset(new PosixServer(tcp));
+    if (!server->begin()) {
+      fprintf(stderr, "can't listen on port %d\n", tcp);
+      return 1;
+    }
+    link.reset(tcpLink = new TcpTransport<PosixServer, PosixClient>(*server));
+    fprintf(stderr, "tcp: %u\n", server->port());
+  } else if (pty) {
+    PtyTransport* p = new PtyTransport();
+    link.reset(fdLink = p);
+    if (!p->slaveName()) {
+      fprintf(stderr, "can't open a pseudo terminal\n");
+      return 1;
+    }
+    fprintf(stderr, "pty: %s\n", p->slaveName());
+  } else {
+    link.reset(fdLink = new FdTransport(0, 1, "stdio"));
+  }
+  auto ended = [&]() { return fdLink ? fdLink->eof() : tcpLink->closed(); };
+
+  Canvas565 canvas;
+  canvas.setRotation(1);
+  TouchManager tm;
+  tm.begin(&canvas);
+  CommandParser parser(tm, &canvas, *link);
+
+  auto t0 = std::chrono::steady_clock::now();
+  bool started = false;
+  while (!ended()) {
+    if (!parser.feed(*link, 4096)) {
+      std::this_thread::sleep_for(std::chrono::microseconds(200)); //nothing came in
+    } else if (!started) {
+      t0 = std::chrono::steady_clock::now(); //from the first byte
+      started = true;
+    }
+  }
+  link->flush();
+  uint64_t in = fdLink ? fdLink->bytesIn : tcpLink->bytesIn;
+  uint64_t sent = fdLink ? fdLink->bytesOut : tcpLink->bytesOut;
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  if (out && !canvas.save(out)) {
+    fprintf(stderr, "can't write %s\n", out);
+    return 1;
+  }
+  fprintf(stderr, "{\"link\":\"%s\",\"in\":%llu,\"out\":%llu,\"seconds\":%.3f,\"bytes_per_s\":%.0f,"
+          "\"shapes\":%zu,\"hash\":\"%016llx\"}\n",
+          link->name(), (unsigned long long)in, (unsigned long long)sent, seconds,
+          seconds > 0 ? in / seconds : 0.0, tm.shapes().size(),
+          (unsigned long long)canvas.hash());
+  return 0;
+}
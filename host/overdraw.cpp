@@ -0,0 +1,136 @@
+/*
+  overdraw.cpp
+
+  Finds where a scene repaints the same pixels. Runs MERGIF command streams
+  as the display would (each command drawing as it comes in), then redraws
+  the final scene with drawAll, and reports:
+
+  - the regions single commands damaged, most overdrawn first
+  - for drawAll, how many pixels were written more than once, and which
+    shapes wrote the most pixels that ended up hidden
+  - a heatmap of writes per pixel for drawAll (see OverdrawCanvas::heatmap)
+
+    pio run -e overdraw && .pio/build/overdraw/program -o heat.png scene.txt
+*/
+
+#include <Arduino.h>
+#include "OverdrawCanvas.h"
+#include "TouchManager.h"
+#include "CommandParser.h"
+#include "PrintSinks.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+struct Region {
+  char command;
+  long offset; // in the stream
+  int16_t x0, y0, x1, y1;
+  uint64_t writes, pixels;
+};
+
+int main(int argc, char** argv) {
+  const char* out = "overdraw.ppm";
+  int rotation = 1;
+  size_t top = 10;
+  std::vector<const char*> inputs;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      out = argv[++i];
+    } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+      rotation = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+      top = atoi(argv[++i]);
+    } else if (argv[i][0] == '-' && argv[i][1]) {
+      fprintf(stderr, "usage: %s [-o heat.ppm|heat.png] [-n top] [-r rotation] [streams...]\n", argv[0]);
+      return 2;
+    } else {
+      inputs.push_back(argv[i]);
+    }
+  }
+
+  OverdrawCanvas live;
+  live.setRotation(rotation);
+  TouchManager manager;
+  manager.begin(&live);
+  manager.observer = &live;
+  NullPrint echo;
+  CommandParser parser(manager, &live, echo, rotation);
+
+  std::vector<Region> regions;
+  long offset = 0;
+  if (inputs.empty()) inputs.push_back("-");
+  for (const char* name : inputs) {
+    FILE* f = strcmp(name, "-") ? fopen(name, "rb") : stdin;
+    if (!f) {
+      fprintf(stderr, "can't read %s\n", name);
+      return 1;
+    }
+    int ch;
+    while ((ch = fgetc(f)) != EOF) {
+      bool command = !parser.binary() && !parser.quoting && isupper(ch);
+      live.beginRegion();
+      parser.feed(ch);
+      if (command && ch == 'Z') { // a new scene
+        regions.clear();
+        live.reset();
+        live.resetWrites();
+      } else if (live.regionWrites) {
+        regions.push_back({parser.c, offset, live.regionX0, live.regionY0, live.regionX1,
+                           live.regionY1, live.regionWrites, live.regionPixels});
+      }
+      offset++;
+    }
+    if (f != stdin) fclose(f);
+  }
+
+  uint64_t drawn = live.pixelsWritten(1);
+  printf("As sent: %zu damaged regions, %llu writes to %llu pixels (%.2fx)\n", regions.size(),
+         (unsigned long long)live.writes, (unsigned long long)drawn,
+         drawn ? (double)live.writes / drawn : 0.0);
+  std::stable_sort(regions.begin(), regions.end(), [](const Region& a, const Region& b) {
+    return a.writes - a.pixels > b.writes - b.pixels;
+  });
+  printf("%-4s %8s  %-21s %8s %8s %6s\n", "cmd", "offset", "region", "writes", "pixels", "x");
+  for (size_t i = 0; i < regions.size() && i < top; i++) {
+    const Region& r = regions[i];
+    if (r.writes == r.pixels) break;
+    printf("%-4c %8ld  %3d,%3d - %3d,%3d %8llu %8llu %6.2f\n", r.command, r.offset, r.x0, r.y0,
+           r.x1, r.y1, (unsigned long long)r.writes, (unsigned long long)r.pixels,
+           (double)r.writes / r.pixels);
+  }
+
+  OverdrawCanvas full;
+  full.setRotation(rotation);
+  manager.observer = &full;
+  manager.drawAll(&full);
+  manager.observer = nullptr;
+
+  uint64_t covered = full.pixelsWritten(1);
+  printf("\ndrawAll: %zu shapes, %llu writes to %llu pixels (%.2fx), %llu written more than once, "
+         "most %u times\n", manager.shapes().size(), (unsigned long long)full.writes,
+         (unsigned long long)covered, covered ? (double)full.writes / covered : 0.0,
+         (unsigned long long)full.pixelsWritten(2), full.maxCount());
+  printf("%-5s %-4s %5s  %-21s %8s %8s %8s\n", "shape", "type", "id", "bounds", "written", "visible",
+         "wasted");
+  const auto& shapes = manager.shapes();
+  std::vector<ShapeWrites> ranked = full.ranking();
+  for (size_t i = 0; i < ranked.size() && i < top; i++) {
+    const ShapeWrites& s = ranked[i];
+    if (!s.wasted()) break;
+    size_t index = 0;
+    while (index < shapes.size() && shapes[index].get() != s.shape) index++;
+    printf("%-5zu %-4c %5d  %3d,%3d - %3d,%3d %8llu %8llu %8llu\n", index, s.type, s.id, s.x0, s.y0,
+           s.x1, s.y1, (unsigned long long)s.written, (unsigned long long)s.visible,
+           (unsigned long long)s.wasted());
+  }
+
+  Canvas565 heat;
+  full.heatmap(heat);
+  if (!heat.save(out)) {
+    fprintf(stderr, "can't write %s\n", out);
+    return 1;
+  }
+  return 0;
+}
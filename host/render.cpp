@@ -0,0 +1,70 @@
+/*
+  render.cpp
+
+  Runs MERGIF command streams through the parser on the host, and saves the
+  screen as it would look on the display.
+
+    pio run -e render && .pio/build/render/program -o frame.png scene.txt
+    echo '1i 10x 10y 50w 50h #07e0C R' | .pio/build/render/program -o frame.ppm
+
+  Prints the pixels written and the frame hash (as used by the golden tests
+  in test/test_host_render) to stderr.
+*/
+
+#include <Arduino.h>
+#include "Canvas565.h"
+#include "TouchManager.h"
+#include "CommandParser.h"
+#include "PrintSinks.h"
+
+#include <cstdlib>
+#include <cstring>
+
+static void feedFile(CommandParser& parser, FILE* f) {
+  int ch;
+  while ((ch = fgetc(f)) != EOF) parser.feed(ch);
+}
+
+int main(int argc, char** argv) {
+  const char* out = "frame.ppm";
+  int rotation = 1;
+  std::vector<const char*> inputs;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      out = argv[++i];
+    } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+      rotation = atoi(argv[++i]);
+    } else if (argv[i][0] == '-' && argv[i][1]) {
+      fprintf(stderr, "usage: %s [-o frame.ppm|frame.png] [-r rotation] [streams...]\n", argv[0]);
+      return 2;
+    } else {
+      inputs.push_back(argv[i]);
+    }
+  }
+
+  Canvas565 canvas;
+  canvas.setRotation(rotation);
+  TouchManager manager;
+  manager.begin(&canvas);
+  NullPrint echo;
+  CommandParser parser(manager, &canvas, echo, rotation);
+
+  if (inputs.empty()) inputs.push_back("-");
+  for (const char* name : inputs) {
+    FILE* f = strcmp(name, "-") ? fopen(name, "rb") : stdin;
+    if (!f) {
+      fprintf(stderr, "can't read %s\n", name);
+      return 1;
+    }
+    feedFile(parser, f);
+    if (f != stdin) fclose(f);
+  }
+
+  if (!canvas.save(out)) {
+    fprintf(stderr, "can't write %s\n", out);
+    return 1;
+  }
+  fprintf(stderr, "%s: %llu pixels written, hash %016llx\n", out,
+          (unsigned long long)canvas.writes, (unsigned long long)canvas.hash());
+  return 0;
+}
@@ -0,0 +1,90 @@
+/*
+  replay.cpp
+
+  Plays session captures (`4?`, see src/SessionRecorder.h, or
+  tools/record.py) into the parser and TouchManager on the PC, and reports
+  throughput, command and touch latency percentiles, and a hash of the final
+  frame, so the same session can be compared across builds.
+
+    pio run -e replay && .pio/build/replay/program [-s speed] [-o frame.png] capture.bin
+
+  -s 0 (the default) runs as fast as possible, -s 1 at the original timing.
+  A plain command stream (no capture header) is played as if it all arrived at once.
+*/
+
+#include "Replay.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+static void row(const char* name, Latencies& l) {
+  printf("%-6s %8zu %9.1f %9.1f %9.1f %9.1f\n", name, l.us.size(), l.percentile(50),
+         l.percentile(90), l.percentile(99), l.percentile(100));
+}
+
+int main(int argc, char** argv) {
+  double speed = 0;
+  const char* out = nullptr;
+  int rotation = 1;
+  const char* input = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+      speed = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      out = argv[++i];
+    } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+      rotation = atoi(argv[++i]);
+    } else if (argv[i][0] == '-' || input) {
+      fprintf(stderr, "usage: %s [-s speed] [-o frame.ppm|frame.png] [-r rotation] capture\n", argv[0]);
+      return 2;
+    } else {
+      input = argv[i];
+    }
+  }
+  if (!input) {
+    fprintf(stderr, "usage: %s [-s speed] [-o frame.ppm|frame.png] [-r rotation] capture\n", argv[0]);
+    return 2;
+  }
+
+  std::ifstream f(input, std::ios::binary);
+  if (!f) {
+    fprintf(stderr, "can't read %s\n", input);
+    return 1;
+  }
+  std::stringstream data;
+  data << f.rdbuf();
+  Capture capture;
+  std::string error;
+  if (!capture.load(data.str(), &error)) {
+    fprintf(stderr, "%s: %s\n", input, error.c_str());
+    return 1;
+  }
+
+  Canvas565 canvas;
+  ReplayResult r = replay(capture, canvas, speed, rotation);
+
+  printf("%zu records, %llu bytes, %llu commands, %llu touches\n", capture.records.size(),
+         (unsigned long long)r.bytes, (unsigned long long)r.commands, (unsigned long long)r.touches);
+  printf("%.3f s wall, %.3f s busy, %.0f bytes/s, %.0f commands/s\n", r.wallSeconds, r.busySeconds,
+         r.bytesPerSecond(), r.busySeconds > 0 ? r.commands / r.busySeconds : 0);
+  printf("\nlatency %s(us)\n", speed > 0 ? "from arrival " : "");
+  printf("%-6s %8s %9s %9s %9s %9s\n", "event", "count", "p50", "p90", "p99", "max");
+  Latencies all;
+  for (auto& it : r.commandLatency) {
+    char name[2] = {it.first, 0};
+    row(name, it.second);
+    all.us.insert(all.us.end(), it.second.us.begin(), it.second.us.end());
+  }
+  if (r.touches) row("touch", r.touchLatency);
+  row("all", all);
+  printf("\nframe hash %016llx, %llu pixels written\n", (unsigned long long)r.hash,
+         (unsigned long long)r.pixels);
+
+  if (out && !canvas.save(out)) {
+    fprintf(stderr, "can't write %s\n", out);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,119 @@
+/*
+  soak.cpp
+
+  Runs src/Soak.h for millions of commands on the PC, with every C++
+  allocation going to a model of the device's heap (host/HeapShim.h), and
+  prints its #soak lines. At the end it compares the first and last windows:
+  if the largest free block keeps shrinking, or latency keeps growing, it will
+  get worse on a panel left running for months.
+
+    pio run -e soak && .pio/build/soak/program [-n commands] [-m heap_bytes] [-s seed]
+
+  Exits with 1 if the heap ran out (the device would have crashed).
+*/
+
+#include <Arduino.h>
+#include <Adafruit_GFX.h>
+#include "Soak.h"
+#include "HeapShim.h"
+#include "PrintSinks.h"
+
+#include <cstring>
+#include <new>
+
+static HeapShim* shim = nullptr;
+static bool shimActive = false;
+
+void* operator new(size_t n) {
+  if (shimActive) {
+    void* p = shim->alloc(n);
+    if (p) return p;
+    // out of the modelled heap: counted, and carry on from the real one
+  }
+  void* p = malloc(n ? n : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t n) { return operator new(n); }
+void* operator new(size_t n, const std::nothrow_t&) noexcept {
+  try { return operator new(n); } catch (...) { return nullptr; }
+}
+void* operator new[](size_t n, const std::nothrow_t&) noexcept {
+  try { return operator new(n); } catch (...) { return nullptr; }
+}
+
+void operator delete(void* p) noexcept {
+  if (!p) return;
+  if (shim && shim->owns(p)) {
+    shim->release(p);
+  } else {
+    free(p);
+  }
+}
+
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+
+static HeapStats shimStats() { return shim->stats(); }
+
+/**
+ * @brief Swallows drawing, so only the shapes use the heap.
+ */
+class NullDisplay : public Adafruit_GFX {
+public:
+  NullDisplay() : Adafruit_GFX(240, 320) { setRotation(1); }
+  void drawPixel(int16_t, int16_t, uint16_t) override {}
+  void writeFillRect(int16_t, int16_t, int16_t, int16_t, uint16_t) override {}
+};
+
+int main(int argc, char** argv) {
+  uint32_t commands = 2000000, seed = 1;
+  size_t heapBytes = 200 * 1024;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+      commands = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+      heapBytes = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+      seed = strtoul(argv[++i], nullptr, 10);
+    } else {
+      fprintf(stderr, "usage: %s [-n commands] [-m heap_bytes] [-s seed]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  shim = new HeapShim(heapBytes); // never freed, shapes go back to it until the very end
+  HeapShim& heap = *shim;
+  static NullDisplay gfx;
+  static StdoutPrint out;
+  shimActive = true; // from here on, as on the device
+  static TouchManager tm;
+  tm.begin(&gfx);
+  static SoakTest soak(tm, &gfx, out, shimStats, seed);
+
+  bool first = true;
+  HeapStats firstHeap = {};
+  uint32_t firstP99 = 0, minLargest = UINT32_MAX, maxChunks = 0;
+  while (soak.ops() < commands) {
+    if (!soak.step()) continue;
+    if (first) {
+      firstHeap = soak.heap;
+      firstP99 = soak.p99;
+      first = false;
+    }
+    if (soak.heap.largestFree < minLargest) minLargest = soak.heap.largestFree;
+    if (soak.heap.freeChunks > maxChunks) maxChunks = soak.heap.freeChunks;
+  }
+  shimActive = false;
+
+  fprintf(stderr, "%u commands, %llu allocations (%.1f per command), %llu out of memory\n",
+          soak.ops(), (unsigned long long)heap.allocs, (double)heap.allocs / (soak.ops() ? soak.ops() : 1),
+          (unsigned long long)heap.failed);
+  fprintf(stderr, "largest free block %u at first, %u at last, %u at least; free chunks %u to %u (most %u)\n",
+          firstHeap.largestFree, soak.heap.largestFree, minLargest, firstHeap.freeChunks,
+          soak.heap.freeChunks, maxChunks);
+  fprintf(stderr, "p99 %u us at first, %u us at last\n", firstP99, soak.p99);
+  return heap.failed ? 1 : 0;
+}
@@ -0,0 +1,104 @@
+/*
+  spicost.cpp
+
+  Runs MERGIF command streams into the mock ILI9341 and reports what each
+  command letter cost on the SPI bus, and how long that takes at a given
+  SPI clock (24MHz, the Adafruit_ILI9341 default on the RP2040).
+
+    pio run -e spicost && .pio/build/spicost/program [-c hz] scene.txt
+
+  "as bitmap" is what sending the box each command drew in as one RGB bitmap
+  would have cost instead, to see when a bitmap would be cheaper.
+*/
+
+#include <Arduino.h>
+#include "MockILI9341.h"
+#include "TouchManager.h"
+#include "CommandParser.h"
+#include "PrintSinks.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+struct CommandCost {
+  uint32_t count;
+  SpiCost spi;
+  SpiCost bitmap;
+};
+
+static void row(const char* name, const CommandCost& c, uint32_t hz) {
+  uint32_t n = c.count ? c.count : 1;
+  printf("%-6s %6u %10llu %9llu %7llu %7llu %10.1f %9.1f %10.1f\n", name, c.count,
+         (unsigned long long)c.spi.bytes(), (unsigned long long)(c.spi.bytes() / n),
+         (unsigned long long)c.spi.windows, (unsigned long long)c.spi.csToggles,
+         c.spi.micros(hz), c.spi.micros(hz) / n, c.bitmap.micros(hz));
+}
+
+int main(int argc, char** argv) {
+  uint32_t hz = 24000000;
+  int rotation = 1;
+  std::vector<const char*> inputs;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+      hz = strtoul(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+      rotation = atoi(argv[++i]);
+    } else if (argv[i][0] == '-' && argv[i][1]) {
+      fprintf(stderr, "usage: %s [-c spi_hz] [-r rotation] [streams...]\n", argv[0]);
+      return 2;
+    } else {
+      inputs.push_back(argv[i]);
+    }
+  }
+  if (!hz) hz = 24000000;
+
+  MockILI9341 tft;
+  tft.setRotation(rotation);
+  TouchManager manager;
+  manager.begin(&tft);
+  NullPrint echo;
+  CommandParser parser(manager, &tft, echo, rotation);
+
+  std::map<char, CommandCost> costs;
+  if (inputs.empty()) inputs.push_back("-");
+  for (const char* name : inputs) {
+    FILE* f = strcmp(name, "-") ? fopen(name, "rb") : stdin;
+    if (!f) {
+      fprintf(stderr, "can't read %s\n", name);
+      return 1;
+    }
+    int ch;
+    while ((ch = fgetc(f)) != EOF) {
+      bool command = !parser.binary() && !parser.quoting && isupper(ch);
+      SpiCost before = tft.spi;
+      tft.resetDamage();
+      parser.feed(ch);
+      // drawing at the end of a 'V' packet is charged to the 'V'
+      CommandCost& cost = costs[command ? ch : parser.c];
+      if (command) cost.count++;
+      cost.spi += tft.spi - before;
+      cost.bitmap += tft.damageAsBitmap();
+    }
+    if (f != stdin) fclose(f);
+  }
+
+  CommandCost total = {};
+  printf("SPI at %.1f MHz\n", hz / 1e6);
+  printf("%-6s %6s %10s %9s %7s %7s %10s %9s %10s\n", "cmd", "count", "bytes", "bytes/cmd",
+         "windows", "cs", "us", "us/cmd", "as bitmap");
+  for (auto& it : costs) {
+    if (!it.second.spi.bytes()) continue; // attributes, points and the like
+    char name[2] = {it.first, 0};
+    row(name, it.second, hz);
+    total.count += it.second.count;
+    total.spi += it.second.spi;
+    total.bitmap += it.second.bitmap;
+  }
+  row("total", total, hz);
+  printf("command %llu, window %llu, pixel %llu bytes, %llu D/C toggles\n",
+         (unsigned long long)total.spi.commandBytes, (unsigned long long)total.spi.dataBytes,
+         (unsigned long long)total.spi.pixelBytes, (unsigned long long)total.spi.dcToggles);
+  return 0;
+}
@@ -0,0 +1,352 @@
+/*
+  Adafruit_GFX.h (host)
+
+  A stand-in for the Adafruit GFX library on Linux. The drawing algorithms
+  follow the library (Bresenham lines, midpoint circles, 6x8 classic text
+  cells), all ending in drawPixel / the write* calls, so a subclass only has
+  to store pixels. Every public drawing call (but drawPixel, which belongs to
+  the subclass) is counted in `calls`.
+
+  There are no font bitmaps here: each character is drawn as a 5x7 pattern
+  made from its code, so text has a realistic size and pixel count, and
+  different text looks different, but it isn't readable.
+*/
+
+#pragma once
+
+#include "Arduino.h"
+#include <cstdlib>
+
+typedef struct {
+  uint16_t bitmapOffset;
+  uint8_t width;
+  uint8_t height;
+  uint8_t xAdvance;
+  int8_t xOffset;
+  int8_t yOffset;
+} GFXglyph;
+
+typedef struct {
+  uint8_t* bitmap;
+  GFXglyph* glyph;
+  uint16_t first;
+  uint16_t last;
+  uint8_t yAdvance;
+} GFXfont;
+
+/**
+ * @brief Kinds of drawing call, for Adafruit_GFX::calls.
+ */
+enum GFXPrimitive {
+  GFX_HLINE,
+  GFX_VLINE,
+  GFX_LINE,
+  GFX_RECT,
+  GFX_FILL_RECT,
+  GFX_CIRCLE,
+  GFX_FILL_CIRCLE,
+  GFX_CHAR,
+  GFX_SCREEN,
+  GFX_PRIMITIVES
+};
+
+#ifndef _swap_int16_t
+#define _swap_int16_t(a, b) { int16_t t = a; a = b; b = t; }
+#endif
+
+class Adafruit_GFX : public Print {
+public:
+  uint32_t calls[GFX_PRIMITIVES]; // public drawing calls, by GFXPrimitive
+
+  Adafruit_GFX(int16_t w, int16_t h)
+    : WIDTH(w), HEIGHT(h), _width(w), _height(h), cursor_x(0), cursor_y(0),
+      textcolor(0xFFFF), textbgcolor(0xFFFF), textsize_x(1), textsize_y(1),
+      rotation(0), wrap(true), gfxFont(nullptr) {
+    resetCalls();
+  }
+  virtual ~Adafruit_GFX() {}
+
+  void resetCalls() { memset(calls, 0, sizeof(calls)); }
+
+  // The one thing a display has to do
+  virtual void drawPixel(int16_t x, int16_t y, uint16_t color) = 0;
+
+  virtual void startWrite() {}
+  virtual void endWrite() {}
+
+  virtual void writePixel(int16_t x, int16_t y, uint16_t color) { drawPixel(x, y, color); }
+
+  virtual void writeFillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+    for (int16_t i = x; i < x + w; i++) writeFastVLine(i, y, h, color);
+  }
+
+  virtual void writeFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) {
+    writeLine(x, y, x, y + h - 1, color);
+  }
+
+  virtual void writeFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) {
+    writeLine(x, y, x + w - 1, y, color);
+  }
+
+  virtual void writeLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) {
+    int16_t steep = abs(y1 - y0) > abs(x1 - x0);
+    if (steep) {
+      _swap_int16_t(x0, y0);
+      _swap_int16_t(x1, y1);
+    }
+    if (x0 > x1) {
+      _swap_int16_t(x0, x1);
+      _swap_int16_t(y0, y1);
+    }
+    int16_t dx = x1 - x0;
+    int16_t dy = abs(y1 - y0);
+    int16_t err = dx / 2;
+    int16_t ystep = y0 < y1 ? 1 : -1;
+    for (; x0 <= x1; x0++) {
+      if (steep) {
+        writePixel(y0, x0, color);
+      } else {
+        writePixel(x0, y0, color);
+      }
+      err -= dy;
+      if (err < 0) {
+        y0 += ystep;
+        err += dx;
+      }
+    }
+  }
+
+  virtual void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) {
+    calls[GFX_VLINE]++;
+    startWrite();
+    writeFastVLine(x, y, h, color);
+    endWrite();
+  }
+
+  virtual void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) {
+    calls[GFX_HLINE]++;
+    startWrite();
+    writeFastHLine(x, y, w, color);
+    endWrite();
+  }
+
+  virtual void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+    calls[GFX_FILL_RECT]++;
+    startWrite();
+    writeFillRect(x, y, w, h, color);
+    endWrite();
+  }
+
+  virtual void fillScreen(uint16_t color) {
+    calls[GFX_SCREEN]++;
+    fillRect(0, 0, _width, _height, color);
+  }
+
+  virtual void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) {
+    calls[GFX_LINE]++;
+    startWrite();
+    if (x0 == x1) {
+      if (y0 > y1) _swap_int16_t(y0, y1);
+      writeFastVLine(x0, y0, y1 - y0 + 1, color);
+    } else if (y0 == y1) {
+      if (x0 > x1) _swap_int16_t(x0, x1);
+      writeFastHLine(x0, y0, x1 - x0 + 1, color);
+    } else {
+      writeLine(x0, y0, x1, y1, color);
+    }
+    endWrite();
+  }
+
+  virtual void drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+    calls[GFX_RECT]++;
+    startWrite();
+    writeFastHLine(x, y, w, color);
+    writeFastHLine(x, y + h - 1, w, color);
+    writeFastVLine(x, y, h, color);
+    writeFastVLine(x + w - 1, y, h, color);
+    endWrite();
+  }
+
+  void drawCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color) {
+    calls[GFX_CIRCLE]++;
+    int16_t f = 1 - r;
+    int16_t ddF_x = 1;
+    int16_t ddF_y = -2 * r;
+    int16_t x = 0;
+    int16_t y = r;
+    startWrite();
+    writePixel(x0, y0 + r, color);
+    writePixel(x0, y0 - r, color);
+    writePixel(x0 + r, y0, color);
+    writePixel(x0 - r, y0, color);
+    while (x < y) {
+      if (f >= 0) {
+        y--;
+        ddF_y += 2;
+        f += ddF_y;
+      }
+      x++;
+      ddF_x += 2;
+      f += ddF_x;
+      writePixel(x0 + x, y0 + y, color);
+      writePixel(x0 - x, y0 + y, color);
+      writePixel(x0 + x, y0 - y, color);
+      writePixel(x0 - x, y0 - y, color);
+      writePixel(x0 + y, y0 + x, color);
+      writePixel(x0 - y, y0 + x, color);
+      writePixel(x0 + y, y0 - x, color);
+      writePixel(x0 - y, y0 - x, color);
+    }
+    endWrite();
+  }
+
+  void fillCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color) {
+    calls[GFX_FILL_CIRCLE]++;
+    startWrite();
+    writeFastVLine(x0, y0 - r, 2 * r + 1, color);
+    fillCircleHelper(x0, y0, r, 3, 0, color);
+    endWrite();
+  }
+
+  void fillCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t corners, int16_t delta, uint16_t color) {
+    int16_t f = 1 - r;
+    int16_t ddF_x = 1;
+    int16_t ddF_y = -2 * r;
+    int16_t x = 0;
+    int16_t y = r;
+    int16_t px = x;
+    int16_t py = y;
+    delta++;
+    while (x < y) {
+      if (f >= 0) {
+        y--;
+        ddF_y += 2;
+        f += ddF_y;
+      }
+      x++;
+      ddF_x += 2;
+      f += ddF_x;
+      if (x < (y + 1)) {
+        if (corners & 1) writeFastVLine(x0 + x, y0 - y, 2 * y + delta, color);
+        if (corners & 2) writeFastVLine(x0 - x, y0 - y, 2 * y + delta, color);
+      }
+      if (y != py) {
+        if (corners & 1) writeFastVLine(x0 + py, y0 - px, 2 * px + delta, color);
+        if (corners & 2) writeFastVLine(x0 - py, y0 - px, 2 * px + delta, color);
+        py = y;
+      }
+      px = x;
+    }
+  }
+
+  /**
+   * @brief Draws one 6x8 character cell (5x7 pattern, see above).
+   */
+  void drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg,
+                uint8_t size_x, uint8_t size_y) {
+    calls[GFX_CHAR]++;
+    uint32_t bits = c == ' ' ? 0 : (c * 2654435761u) ^ (c << 3);
+    startWrite();
+    for (int8_t i = 0; i < 5; i++) {
+      for (int8_t j = 0; j < 8; j++) {
+        bool on = j < 7 && ((bits >> ((i * 7 + j) % 32)) & 1);
+        if (on || bg != color) {
+          uint16_t px = on ? color : bg;
+          if (size_x == 1 && size_y == 1) {
+            writePixel(x + i, y + j, px);
+          } else {
+            writeFillRect(x + i * size_x, y + j * size_y, size_x, size_y, px);
+          }
+        }
+      }
+    }
+    if (bg != color) {
+      writeFillRect(x + 5 * size_x, y, size_x, 8 * size_y, bg);
+    }
+    endWrite();
+  }
+
+  size_t write(uint8_t c) override {
+    if (c == '\n') {
+      cursor_x = 0;
+      cursor_y += textsize_y * 8;
+    } else if (c != '\r') {
+      if (wrap && ((cursor_x + textsize_x * 6) > _width)) {
+        cursor_x = 0;
+        cursor_y += textsize_y * 8;
+      }
+      drawChar(cursor_x, cursor_y, c, textcolor, textbgcolor, textsize_x, textsize_y);
+      cursor_x += textsize_x * 6;
+    }
+    return 1;
+  }
+  using Print::write;
+
+  /**
+   * @brief Bounds of a string as the classic font would print it.
+   */
+  void getTextBounds(const char* str, int16_t x, int16_t y,
+                     int16_t* x1, int16_t* y1, uint16_t* w, uint16_t* h) {
+    int16_t minx = _width, miny = _height, maxx = -1, maxy = -1;
+    int16_t cx = x, cy = y;
+    for (; *str; str++) {
+      if (*str == '\n') {
+        cx = 0;
+        cy += textsize_y * 8;
+        continue;
+      }
+      if (*str == '\r') continue;
+      if (wrap && ((cx + textsize_x * 6) > _width)) {
+        cx = 0;
+        cy += textsize_y * 8;
+      }
+      int16_t x2 = cx + textsize_x * 6 - 1, y2 = cy + textsize_y * 8 - 1;
+      if (x2 > maxx) maxx = x2;
+      if (y2 > maxy) maxy = y2;
+      if (cx < minx) minx = cx;
+      if (cy < miny) miny = cy;
+      cx += textsize_x * 6;
+    }
+    *x1 = x;
+    *y1 = y;
+    *w = *h = 0;
+    if (maxx >= minx) {
+      *x1 = minx;
+      *w = maxx - minx + 1;
+    }
+    if (maxy >= miny) {
+      *y1 = miny;
+      *h = maxy - miny + 1;
+    }
+  }
+
+  virtual void setRotation(uint8_t r) {
+    rotation = r & 3;
+    _width = (rotation & 1) ? HEIGHT : WIDTH;
+    _height = (rotation & 1) ? WIDTH : HEIGHT;
+  }
+  uint8_t getRotation() const { return rotation; }
+
+  void setCursor(int16_t x, int16_t y) { cursor_x = x; cursor_y = y; }
+  void setTextColor(uint16_t c) { textcolor = textbgcolor = c; }
+  void setTextColor(uint16_t c, uint16_t bg) { textcolor = c; textbgcolor = bg; }
+  void setTextSize(uint8_t s) { setTextSize(s, s); }
+  void setTextSize(uint8_t sx, uint8_t sy) { textsize_x = sx ? sx : 1; textsize_y = sy ? sy : 1; }
+  void setTextWrap(bool w) { wrap = w; }
+  void setFont(const GFXfont* f) { gfxFont = f; }
+
+  int16_t width() const { return _width; }
+  int16_t height() const { return _height; }
+  int16_t getCursorX() const { return cursor_x; }
+  int16_t getCursorY() const { return cursor_y; }
+
+protected:
+  const int16_t WIDTH, HEIGHT; // as built, without rotation
+  int16_t _width, _height;     // with rotation
+  int16_t cursor_x, cursor_y;
+  uint16_t textcolor, textbgcolor;
+  uint8_t textsize_x, textsize_y;
+  uint8_t rotation;
+  bool wrap;
+  const GFXfont* gfxFont;
+};
@@ -0,0 +1,144 @@
+/*
+  BlockPool.h
+
+  Recycles the memory of shapes, groups, graph buffers, polygon points and
+  label text. Blocks are kept on a free list per size class when freed, and
+  handed out again for the next request of that size, so once a scene has been
+  built (and cleared with 'Z') building it again takes nothing from the heap.
+  It also keeps the heap from being chopped up by blocks of odd sizes coming
+  and going (see Soak.h).
+
+  Sizes up to 256 bytes are rounded up to 16, up to 8K to a power of two;
+  anything bigger goes straight to the heap. Free blocks past BLOCKPOOL_MAX_IDLE
+  bytes go back to the heap too, so a big scene once doesn't hold on to memory
+  for good; a scene that fits in it rebuilds without allocating.
+
+  Not thread safe: one per TouchManager.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#define BLOCKPOOL_MAX_IDLE (64 * 1024) //bytes kept in free blocks, at most
+
+class BlockPool {
+public:
+  uint32_t heapBlocks; // blocks taken from the heap, ever
+
+  explicit BlockPool(size_t maxIdle = BLOCKPOOL_MAX_IDLE)
+    : heapBlocks(0), m_maxIdle(maxIdle), m_idle(0) {
+    for (auto& f : m_free) f = nullptr;
+  }
+
+  ~BlockPool() { release(); }
+
+  BlockPool(const BlockPool&) = delete;
+  BlockPool& operator=(const BlockPool&) = delete;
+
+  void* allocate(size_t n) {
+    int k = classOf(n);
+    if (k < 0) return ::operator new(n);
+    if (FreeBlock* b = m_free[k]) {
+      m_free[k] = b->next;
+      m_idle -= sizeOf(k);
+      return b;
+    }
+    heapBlocks++;
+    return ::operator new(sizeOf(k));
+  }
+
+  /**
+   * @param n the size it was allocated with
+   */
+  void deallocate(void* p, size_t n) {
+    if (!p) return;
+    int k = classOf(n);
+    if (k < 0 || m_idle + sizeOf(k) > m_maxIdle) {
+      ::operator delete(p);
+      return;
+    }
+    FreeBlock* b = static_cast<FreeBlock*>(p);
+    b->next = m_free[k];
+    m_free[k] = b;
+    m_idle += sizeOf(k);
+  }
+
+  /**
+   * @brief Gives the free blocks back to the heap.
+   */
+  void release() {
+    for (auto& f : m_free) {
+      while (f) {
+        FreeBlock* b = f;
+        f = b->next;
+        ::operator delete(b);
+      }
+    }
+    m_idle = 0;
+  }
+
+  /**
+   * @return bytes in free blocks, waiting to be reused
+   */
+  size_t idleBytes() const { return m_idle; }
+
+private:
+  struct FreeBlock { FreeBlock* next; };
+
+  static const int SMALL = 16;      // classes of 16, 32 .. 256 bytes
+  static const int LARGE = 5;       // then 512 .. 8192
+  static const int CLASSES = SMALL + LARGE;
+
+  size_t m_maxIdle;
+  size_t m_idle;
+  FreeBlock* m_free[CLASSES];
+
+  static int classOf(size_t n) {
+    if (n <= 256) return n ? (int)((n - 1) >> 4) : 0;
+    int k = SMALL;
+    for (size_t s = 512; s < n; s <<= 1) {
+      if (++k == CLASSES) return -1;
+    }
+    return k;
+  }
+
+  static size_t sizeOf(int k) {
+    return k < SMALL ? (size_t)(k + 1) << 4 : (size_t)512 << (k - SMALL);
+  }
+};
+
+/**
+ * @brief A standard allocator over a BlockPool, for std::allocate_shared and
+ * the containers inside shapes. With no pool it uses the heap.
+ */
+template <typename T>
+class PoolAllocator {
+public:
+  typedef T value_type;
+
+  BlockPool* pool;
+
+  explicit PoolAllocator(BlockPool* p = nullptr) : pool(p) {}
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>& other) : pool(other.pool) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(pool ? pool->allocate(n * sizeof(T)) : ::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n) {
+    if (pool) {
+      pool->deallocate(p, n * sizeof(T));
+    } else {
+      ::operator delete(p);
+    }
+  }
+
+  template <typename U>
+  bool operator==(const PoolAllocator<U>& other) const { return pool == other.pool; }
+  template <typename U>
+  bool operator!=(const PoolAllocator<U>& other) const { return pool != other.pool; }
+};
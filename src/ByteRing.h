@@ -0,0 +1,71 @@
+/*
+  ByteRing.h
+
+  A fixed size byte buffer for links (see TcpTransport.h, ChainLink.h),
+  with access to contiguous pieces for reading from or writing to a socket
+  or UART in one go. One thread.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief A byte ring that takes and gives what it can.
+ */
+template <size_t N>
+class ByteRing {
+public:
+  ByteRing() : m_head(0), m_count(0) {}
+
+  size_t size() const { return m_count; }
+  size_t space() const { return N - m_count; }
+  void clear() { m_head = m_count = 0; }
+
+  size_t write(const uint8_t* data, size_t n) {
+    if (n > space()) n = space();
+    for (size_t i = 0; i < n; i++) m_data[(m_head + m_count + i) % N] = data[i];
+    m_count += n;
+    return n;
+  }
+
+  int peek() const { return m_count ? m_data[m_head] : -1; }
+
+  int read() {
+    if (!m_count) return -1;
+    uint8_t b = m_data[m_head];
+    m_head = (m_head + 1) % N;
+    m_count--;
+    return b;
+  }
+
+  /**
+   * @brief The bytes that can be read in one piece, from the front.
+   */
+  const uint8_t* front(size_t& n) const {
+    n = m_count < N - m_head ? m_count : N - m_head;
+    return m_data + m_head;
+  }
+
+  /**
+   * @brief Room that can be written in one piece, at the back. Call
+   * commit() with what was put there.
+   */
+  uint8_t* back(size_t& n) {
+    size_t tail = (m_head + m_count) % N;
+    n = tail >= m_head && m_count < N ? N - tail : space();
+    return m_data + tail;
+  }
+
+  void commit(size_t n) { m_count += n; }
+
+  void drop(size_t n) {
+    m_head = (m_head + n) % N;
+    m_count -= n;
+  }
+
+private:
+  uint8_t m_data[N];
+  size_t m_head, m_count;
+};
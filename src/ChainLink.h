@@ -0,0 +1,282 @@
+/*
+  ChainLink.h
+
+  Several displays on one serial line: each node's Serial1 goes to the host
+  (or the node before it), its Serial2 to the next node. The host puts a
+  frame header in front of what is for each node:
+
+    ~2:1i 10x 10y 40w 30h R        to the end of the line, for node 2
+    ~2,12:<12 bytes>                exactly that many bytes (binary safe)
+    ~*:Z                            every node
+
+  Addresses are relative: 0 is this node. A node takes frames for 0 (and
+  *) and sends every other frame on to the next node with the address one
+  less, without looking at what is in it. So the same firmware runs on every
+  node, and a node's number is how far along the chain it is. Bytes outside
+  any frame are for the first node, so a single display works as before.
+
+  Going back, everything a node prints (replies, touch reports) goes up in
+  frames `~0,<length>:...`, and each node passing a frame on up adds one to
+  its address, so the host sees which node it came from. A node's output
+  goes up a line at a time (or when its buffer is half full), not a frame
+  per echoed byte. Until the host has sent a frame, a node prints without
+  them, as it is written.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include "Transport.h"
+#include "ByteRing.h"
+
+#define CHAIN_RX 1024     //bytes for this node, not parsed yet
+#define CHAIN_OUT 512     //this node's output, waiting to go up as a frame
+#define CHAIN_HEADER 16   //longest header: ~65535,65535:
+
+/**
+ * @brief Follows the frames in one direction of the chain, a byte at a time.
+ */
+class ChainFrames {
+public:
+  enum Step {
+    PLAIN,  // not in a frame
+    HOLD,   // part of a header, held back until it is known to be one
+    START,  // a header ended, see address, all and length
+    BODY,   // in a frame
+    LAST,   // the last byte of a frame
+    BAD     // not a header after all: the held bytes and this one are plain
+  };
+
+  bool all;            // '*', every node
+  uint32_t address;
+  bool hasLength;      // else to the end of the line
+  uint32_t length;     // the whole frame, when hasLength
+  char held[CHAIN_HEADER];
+  uint8_t heldLength;
+
+  ChainFrames() : all(false), address(0), hasLength(false), length(0), heldLength(0),
+                  m_state(OUTSIDE), m_left(0), m_digits(0) {}
+
+  bool inFrame() const { return m_state != OUTSIDE; }
+
+  Step step(uint8_t b) {
+    switch (m_state) {
+      case OUTSIDE:
+        if (b != '~') return PLAIN;
+        all = hasLength = false;
+        address = length = 0;
+        m_digits = 0;
+        heldLength = 0;
+        held[heldLength++] = b;
+        m_state = HEADER;
+        return HOLD;
+
+      case HEADER:
+        if (b == ':' && m_digits) {
+          m_state = IN_FRAME;
+          m_left = length;
+          if (hasLength && !length) m_state = OUTSIDE; //empty
+          return START;
+        }
+        if (heldLength < CHAIN_HEADER) {
+          if (b == '*' && heldLength == 1) {
+            all = true;
+            m_digits = 1;
+            held[heldLength++] = b;
+            return HOLD;
+          }
+          if (b == ',' && !hasLength && m_digits) {
+            hasLength = true;
+            m_digits = 0;
+            held[heldLength++] = b;
+            return HOLD;
+          }
+          if (b >= '0' && b <= '9' && !(all && !hasLength)) {
+            if (hasLength) length = length * 10 + (b - '0');
+            else address = address * 10 + (b - '0');
+            m_digits++;
+            held[heldLength++] = b;
+            return HOLD;
+          }
+        }
+        m_state = OUTSIDE;
+        return BAD;
+
+      default: //IN_FRAME
+        if (hasLength ? --m_left == 0 : b == '\n') {
+          m_state = OUTSIDE;
+          return LAST;
+        }
+        return BODY;
+    }
+  }
+
+  /**
+   * @brief Writes the header of the current frame, with another address.
+   * @param address -1 for all
+   */
+  void writeHeader(Print& out, long address) const {
+    out.print('~');
+    if (address < 0) out.print('*');
+    else out.print(address);
+    if (hasLength) {
+      out.print(',');
+      out.print(length);
+    }
+    out.print(':');
+  }
+
+private:
+  enum { OUTSIDE, HEADER, IN_FRAME };
+  uint8_t m_state;
+  uint32_t m_left;
+  uint8_t m_digits;
+};
+
+/**
+ * @brief The Transport a node's parser uses in a chain: the bytes for this
+ * node in, and its output framed, up. Passes the rest along both ways.
+ */
+class ChainLink : public Transport {
+public:
+  uint32_t forwardedDown, forwardedUp; //bytes passed along
+  uint32_t outDropped;                 //this node's output lost, the frame buffer was full
+
+  /**
+   * @param up to the host, or the node before
+   * @param down to the next node, nullptr at the end of the chain
+   */
+  ChainLink(Transport& up, Transport* down = nullptr)
+    : forwardedDown(0), forwardedUp(0), outDropped(0), m_up(up), m_down(down),
+      m_framed(false), m_mine(false), m_forward(false), m_outLines(0) {}
+
+  const char* name() const override { return "chain"; }
+
+  /**
+   * @brief Moves bytes: from the host, to this node or on down; from the
+   * next node, up; and this node's output, up in a frame when nothing else
+   * is going up. Call it often; available() does.
+   */
+  void service() {
+    // the room for a header given back keeps any byte from being lost
+    while (m_rx.space() > CHAIN_HEADER && m_up.available() > 0) fromUp(m_up.read());
+    while (m_down && m_down->available() > 0) fromDown(m_down->read());
+    if (m_out.size() && !m_fromDown.inFrame()) sendOut(m_framed && m_out.size() < CHAIN_OUT / 2 ? m_outLines : m_out.size());
+  }
+
+  int available() override {
+    service();
+    return m_rx.size();
+  }
+
+  int read() override { return m_rx.read(); }
+  int peek() override { return m_rx.peek(); }
+
+  size_t write(uint8_t b) override { return write(&b, 1); }
+
+  size_t write(const uint8_t* buffer, size_t size) override {
+    size_t n = m_out.write(buffer, size);
+    if (n < size && !m_fromDown.inFrame()) {
+      sendOut(m_out.size()); //make room, not in the middle of a frame going up
+      n += m_out.write(buffer + n, size - n);
+    }
+    outDropped += size - n;
+    for (size_t i = n; i > 0; i--) {
+      if (buffer[i - 1] == '\n') {
+        m_outLines = m_out.size() - (n - i);
+        break;
+      }
+    }
+    return size;
+  }
+
+  void flush() override {
+    service();
+    m_up.flush();
+  }
+
+  bool overflow() override { return m_up.overflow() || (m_down && m_down->overflow()); }
+  bool connected() override { return m_up.connected(); }
+
+  /**
+   * @return true once the host has sent a frame, so output goes up in frames
+   */
+  bool framed() const { return m_framed; }
+
+  using Print::write;
+
+private:
+  Transport& m_up;
+  Transport* m_down;
+  ChainFrames m_fromUp, m_fromDown;
+  bool m_framed;   //the host speaks in frames
+  bool m_mine;     //the frame coming down is for this node
+  bool m_forward;  //and/or goes on down
+  ByteRing<CHAIN_RX> m_rx;
+  ByteRing<CHAIN_OUT> m_out;
+  size_t m_outLines; //bytes of m_out up to the end of its last whole line
+
+  void fromUp(uint8_t b) {
+    switch (m_fromUp.step(b)) {
+      case ChainFrames::PLAIN:
+        m_rx.write(&b, 1);
+        break;
+      case ChainFrames::HOLD:
+        break;
+      case ChainFrames::BAD:
+        m_rx.write((const uint8_t*)m_fromUp.held, m_fromUp.heldLength);
+        m_rx.write(&b, 1);
+        break;
+      case ChainFrames::START:
+        m_framed = true;
+        m_mine = m_fromUp.all || m_fromUp.address == 0;
+        m_forward = m_down && (m_fromUp.all || m_fromUp.address > 0);
+        if (m_forward) m_fromUp.writeHeader(*m_down, m_fromUp.all ? -1 : (long)m_fromUp.address - 1);
+        break;
+      default: //BODY, LAST
+        if (m_mine) m_rx.write(&b, 1);
+        if (m_forward) {
+          m_down->write(b);
+          forwardedDown++;
+        }
+        break;
+    }
+  }
+
+  void fromDown(uint8_t b) {
+    switch (m_fromDown.step(b)) {
+      case ChainFrames::HOLD:
+        break;
+      case ChainFrames::BAD:
+        m_up.write((const uint8_t*)m_fromDown.held, m_fromDown.heldLength);
+        m_up.write(b);
+        break;
+      case ChainFrames::START:
+        m_fromDown.writeHeader(m_up, m_fromDown.all ? -1 : (long)m_fromDown.address + 1);
+        break;
+      default: //PLAIN, BODY, LAST
+        m_up.write(b);
+        forwardedUp++;
+        break;
+    }
+  }
+
+  // The first size bytes of this node's output, as one frame (or as they are before the host uses frames)
+  void sendOut(size_t size) {
+    if (!size) return;
+    if (m_framed) {
+      m_up.print("~0,");
+      m_up.print((unsigned)size);
+      m_up.print(':');
+    }
+    m_outLines = m_outLines > size ? m_outLines - size : 0;
+    size_t n;
+    while (size) {
+      const uint8_t* p = m_out.front(n);
+      if (n > size) n = size;
+      m_up.write(p, n);
+      m_out.drop(n);
+      size -= n;
+    }
+  }
+};
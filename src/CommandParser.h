@@ -0,0 +1,593 @@
+/*
+  CommandParser.h
+
+  The MERGIF command interpreter. Takes in the postfix text commands one byte
+  at a time and drives a TouchManager. Everything it prints (the echo, errors
+  and queries) goes to the Print it is given, so it can run on any link, or
+  on a host build. Commands that change the scene are decoded into
+  DrawCommands and run straight away, or sent to the other core through a
+  Pipeline if one is set.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include <vector>
+#include <string>
+#include "TouchManager.h"
+#include "PerfCounters.h"
+#include "Trace.h"
+#include "SessionRecorder.h"
+#include "DrawCommand.h"
+#include "Pipeline.h"
+
+#define LTR(x) (x - 'a')
+
+// Group IDs a host can use, 1 to GROUP_NAMESPACE - 1; each link with its own
+// (see HostLinks.h) has them stored above a multiple of this
+#define GROUP_NAMESPACE 10000
+
+// Binary graph append ('V'). See README
+#define BIN_MAX_SERIES GRAPH_MAX_SERIES
+
+inline void selfBench(TouchManager& manager, Adafruit_GFX* gfx, Print& out); //'J', SelfBench.h
+
+class CommandParser {
+public:
+  uint16_t radix;
+  char c; //the last character taken in
+  int n; //accumulated digits as a number
+  bool number; //digits were given for n since the last opcode, so 0 can be told from none
+  int attr[('Z' - 'A' + 1)]; //attributes are an array of letters
+  bool quoting; //track quoting state
+  std::string text; //track quoted text
+  std::vector<GFXPoint> points;
+  std::vector<int> series; //one value per graph series, collected by ','
+  bool record; //bytes fed go in the session recording (with MERGIF_RECORD)
+  Pipeline* pipeline; //scene changes go to the render core through this, nullptr to run them here
+  uint8_t link; //which host link this is, below PIPELINE_LINKS (see HostLinks.h)
+  int groupBase; //added to group IDs, to keep this link's apart from others', 0 to share them
+
+  /**
+   * @param manager the shapes to build
+   * @param gfx the display, cleared by 'Z'
+   * @param out where the echo, errors and query replies go
+   * @param orientation display rotation, text direction is relative to it
+   */
+  CommandParser(TouchManager& manager, Adafruit_GFX* gfx, Print& out, uint8_t orientation = 1)
+    : radix(10), c(0), n(0), number(false), quoting(false), record(true), pipeline(nullptr), link(0), groupBase(0),
+      m_manager(manager), m_gfx(gfx), m_out(out), m_orientation(orientation), m_runner(manager, gfx),
+      m_hostOffset(0), m_synced(false), m_inCommand(false),
+      m_startUs(0), m_startRenderUs(0), m_lastStartUs(0), m_lastEndUs(0), m_lastRenderUs(0),
+      m_startSent(0), m_lastStartRenderUs(0), m_lastStartSent(0), m_lastSent(0),
+      binActive(false) {
+    for (int i = 0; i < (int)(sizeof(attr)/sizeof(attr[0])); i++) {
+      attr[i] = 0;
+    }
+    // cleared, never shrunk, so after the first few commands these don't allocate
+    text.reserve(64);
+    points.reserve(16);
+    series.reserve(BIN_MAX_SERIES);
+  }
+
+  /**
+   * @brief Forgets a command half taken in (a number, quoted text, a 'V'
+   * packet) and the host's clock, for a new host on the same link. The
+   * scene stays.
+   */
+  void reset() {
+    if (binActive && binHeaderLen == sizeof(binHeader)) submit(command(DrawCommand::FLUSH)); //draw what came
+    binActive = false;
+    for (int i = 0; i < (int)(sizeof(attr)/sizeof(attr[0])); i++) {
+      attr[i] = 0;
+    }
+    for (int i = 0; i < BIN_MAX_SERIES; i++) {
+      binColumn[i] = 0;
+    }
+    radix = 10; c = 0; n = 0; number = false;
+    quoting = false;
+    text.clear(); points.clear(); series.clear();
+    m_hostOffset = 0;
+    m_synced = false;
+    m_inCommand = false;
+  }
+
+  /**
+   * @brief True while a binary 'V' packet is being taken in.
+   * The caller can then feed bytes as fast as they come.
+   */
+  bool binary() const { return binActive; }
+
+  /**
+   * @brief True once the host has set its clock offset with 'N'.
+   */
+  bool timeSynced() const { return m_synced; }
+
+  /**
+   * @brief A micros() time on the host's clock (microseconds, modulo 2^31)
+   * once synced, the device's own before.
+   */
+  uint32_t hostTime(uint32_t deviceUs) const {
+    return m_synced ? (deviceUs + m_hostOffset) & 0x7FFFFFFF : deviceUs;
+  }
+
+  /**
+   * @brief Reports a touch to this link's host: `id@ X:x Y:y`, and ` T:when`
+   * on the host's clock once synced.
+   * @param id the group ID found, as stored (this link's groupBase is taken off)
+   * @param us micros() at the touch
+   */
+  void reportTouch(int id, int x, int y, uint32_t us) {
+    TRACE_SCOPE(TRACE_TX, 't');
+    m_out.print(id > groupBase ? id - groupBase : id);
+    m_out.print("@ X:"); m_out.print(x);
+    m_out.print("Y:"); m_out.print(y);
+    if (m_synced) { //when, on the host's clock (see 'N')
+      m_out.print(" T:"); m_out.print(hostTime(us));
+    }
+    m_out.println();
+  }
+
+  /**
+   * @brief Prints the errors for commands that failed on the render core.
+   * Done on every byte, call it now and then when none are coming in.
+   */
+  void poll() {
+    char op;
+    while (pipeline && pipeline->errors[link].pop(op)) {
+      m_out.println(CommandRunner::error(op));
+    }
+  }
+
+  /**
+   * @brief Takes in what has arrived on a link (see Transport.h), up to most bytes.
+   * @return the bytes taken
+   */
+  size_t feed(Stream& in, size_t most) {
+    size_t taken = 0;
+    while (taken < most && in.available() > 0) {
+      feed(in.read());
+      taken++;
+    }
+    return taken;
+  }
+
+  /**
+   * @brief Takes in one byte from the host.
+   * @return true if the byte was a command or separator, false if it was part
+   * of a number, attribute, quoted text or binary packet (so more is expected soon).
+   */
+  bool feed(uint8_t ch) {
+    if (record) RECORD_RX(ch);
+    poll();
+    if (!m_inCommand && !isspace(ch)) { //first byte since the last command, for 'Q'
+      m_inCommand = true;
+      m_startUs = micros();
+      m_startRenderUs = m_manager.perf.totalRenderUs();
+      m_startSent = pipeline ? pipeline->sent() : 0;
+    }
+    ParseTimer timer(m_manager.perf);
+    m_manager.perf.bytesRx++;
+    if (binActive) { //binary packet, no parsing or echo
+      readBinary(ch);
+      return false;
+    }
+    if (ch == 34) { //getting a quote
+      if (c == 34) { //getting a double quote
+        if (quoting) {// just two quotes
+          text = ""; //empty string
+        } else { // three quotes
+          text += '"'; //this is an escaped quote
+          quoting = true; //keep quoting
+        }
+      } else { //single quote
+        if (quoting) { //end the quoted string
+          quoting = false;
+        } else {
+          quoting = true;
+          text = ""; //start a new string
+        }
+      }
+      c = ch;
+      TRACE_SCOPE(TRACE_TX, 'e');
+      m_out.print(c); //quote managed
+      return false;
+    }
+    c = ch;
+    {
+      TRACE_SCOPE(TRACE_TX, 'e');
+      m_out.print(c);
+    }
+    if (quoting) {
+      text += c;
+      return false;
+    }
+    if (isdigit(c) || (radix > 10 && c >= 'a' && c <= 'f')) {
+      //Note: don't use isHexadecimalDigit(c) so that 'C' (or whatever) can pop us out
+      n *= radix;
+      if (radix > 10 && c >= 'a' && c <= 'f') { //a-f are numbers now
+        n += (int)(c - 'a' + 10);
+      } else {
+        n += (int)(c - '0');
+      }
+      number = true;
+      return false;
+    }
+
+    m_manager.perf.command(c);
+    TRACE_SCOPE(TRACE_PARSE, c);
+    switch (c) {
+
+      case 'Z': //Zero out the display and objects
+        submit(command('Z'));
+        for (int i = 0; i < (int)(sizeof(attr)/sizeof(attr[0])); i++) {
+          attr[i] = 0;
+        }
+        points.clear(); n = 0; radix = 10;
+        for (int i = 0; i < BIN_MAX_SERIES; i++) {
+          binColumn[i] = 0;
+        }
+        break;
+
+      case 'R': //Rectangle
+        submit(command('R'));
+        n = 0; radix = 10;
+        break;
+
+      case 'O': //Circle
+        submit(command('O'));
+        n = 0; radix = 10;
+        break;
+
+      case 'P': //Point
+        points.push_back(
+          (GFXPoint){(int16_t)attr[LTR('x')], (int16_t)attr[LTR('y')]}
+        );
+        break;
+
+      case 'L': //Line, not closed, no group ID
+      case 'S': //Shape
+        if (!tooLong(c, points.size() * sizeof(GFXPoint))) {
+          submit(command(c, points.size() * sizeof(GFXPoint)), points.data());
+        }
+        points.clear(); n = 0; radix = 10;
+        break;
+
+      case '#': //Hex set radix to 16
+        radix = (0 == n ? 16 : n);
+        n = 0;
+        break;
+
+      case 'C': //Color (also 'c' if not in hex)
+        attr[LTR('c')] = n;
+        n = 0; radix = 10;
+        break;
+
+      case 'T': { //Text
+        m_out.println(text.c_str());
+        if (tooLong('T', text.size())) break;
+        DrawCommand cmd = command('T', text.size());
+        cmd.arg[0] = attr[LTR('f')];
+        cmd.arg[1] = attr[LTR('h')] + 1; //size (height) default is 1
+        cmd.arg[2] = (attr[LTR('d')] + m_orientation) % 4; //orentation; relate to display orientation
+        submit(cmd, text.c_str());
+        break;
+      }
+
+      case ',': //series
+        series.push_back(n);
+        n = 0; radix = 10;
+        break;
+
+      case 'G': //Graph
+        series.push_back(n);
+        n = 0; radix = 10;
+        //width is both pixel width and number of samples kept per series
+        //'a' is the autoscale margin in percent, 0 for raw values
+        if (!tooLong('G', series.size() * sizeof(int))) {
+          submit(command('G', series.size() * sizeof(int)), series.data());
+        }
+        series.clear();
+        break;
+
+      case 'V': //binary Values for a graph, the packet follows
+        submit(command('V'));
+        binActive = true; //still take in the packet, so we stay in sync
+        binHeaderLen = 0;
+        n = 0; radix = 10;
+        return false;
+
+      case 'K': { //trigger for a graph
+        DrawCommand cmd = command('K');
+        cmd.arg[0] = attr[LTR('k')]; //edge: 0 off, 1 rising, 2 falling, 3 either
+        cmd.arg[1] = attr[LTR('l')]; //level
+        cmd.arg[2] = attr[LTR('o')]; //holdoff in samples
+        cmd.arg[3] = attr[LTR('p')]; //pre-trigger samples
+        submit(cmd);
+        n = 0; radix = 10;
+        break;
+      }
+
+      case 'U': { //Use a style for one series of a graph
+        DrawCommand cmd = command('U'); //color 0 for the graph's
+        cmd.arg[0] = attr[LTR('n')]; //series number
+        cmd.arg[1] = attr[LTR('m')]; //mode: 0 graph's, 1 pixels, 2 lines
+        cmd.arg[2] = attr[LTR('v')]; //overlays: 1 min, 2 max, 4 mean, 8 last value
+        submit(cmd);
+        n = 0; radix = 10;
+        break;
+      }
+
+      case 'Q': //ping: echo the token with when the last command came in and finished, see README
+        if (pipeline && m_lastSent != m_lastStartSent) finishQueued();
+        m_out.print("Q:"); m_out.print(n);
+        m_out.print(" s:"); m_out.print(hostTime(m_lastStartUs));
+        m_out.print(" e:"); m_out.print(hostTime(m_lastEndUs));
+        m_out.print(" r:"); m_out.print(m_lastRenderUs);
+        m_out.print(" d:"); m_out.println(hostTime(micros()));
+        n = 0; radix = 10;
+        break;
+
+      case 'J': //self benchmark on the reference scene, see SelfBench.h
+        if (pipeline) pipeline->drain(); //the render core is idle until we send more
+        selfBench(m_manager, m_gfx, m_out);
+        n = 0; radix = 10;
+        break;
+
+      case 'N': //time sync: set the host clock offset (if given, 0 too), reply with the device clock
+        if (number) {
+          m_hostOffset = (uint32_t)n;
+          m_synced = true;
+        }
+        m_out.print("N:"); m_out.println(micros());
+        n = 0; radix = 10;
+        break;
+
+      case '?':
+        if (1 == n) { //performance counters
+          m_manager.perf.print(m_out);
+        } else if (2 == n) { //reset them, once the render core has stopped adding to its own
+          if (pipeline) pipeline->drain();
+          m_manager.perf.reset();
+        } else if (3 == n) { //binary trace, see Trace.h
+#ifdef MERGIF_TRACE
+          if (pipeline) pipeline->drain(); //core 1 stops adding to its ring
+          traceDump(m_out);
+#else
+          m_out.println("Error: not built with MERGIF_TRACE");
+#endif
+        } else if (4 == n) { //binary session recording, see SessionRecorder.h
+#ifdef MERGIF_RECORD
+          sessionRecorder().dump(m_out);
+          sessionRecorder().clear();
+#else
+          m_out.println("Error: not built with MERGIF_RECORD");
+#endif
+        } else {
+          printAttrib();
+          printPoints();
+        }
+        n = 0; radix = 10;
+        break;
+
+      default:
+        break;
+    }
+    if (!isspace(c)) number = false;
+
+    if ('a' <= c && c <= 'z') {
+      if ('i' == c && n >= GROUP_NAMESPACE) { //would be another link's
+        m_out.println("Error: group id over 9999");
+        n = 0;
+      }
+      attr[LTR(c)] = n;
+      radix = 10; //back to decimal
+      n = 0;
+      return false;
+    }
+    if (endsCommand(c)) endCommand();
+    return true;
+  }
+
+  /**
+   * @brief True for the opcodes that finish a command, for 'Q': the scene
+   * changes and queries. 'C', '#', 'P' and ',' only set up the next one.
+   */
+  static bool endsCommand(char op) {
+    switch (op) {
+      case 'Z': case 'R': case 'O': case 'L': case 'S': case 'T': case 'G': case 'K': case 'U':
+      case 'Q': case 'J': case 'N': case '?':
+        return true;
+    }
+    return false; //'V' ends with its packet
+  }
+
+  void printAttrib() {
+    for (int i = 0; i < (int)(sizeof(attr)/sizeof(attr[0])); i++) {
+      m_out.print((char)(i + 'a'));
+      m_out.print("=");
+      if ('c' == i + 'a') {
+        m_out.print("#");
+        m_out.print(attr[i], HEX);
+      } else {
+        m_out.print(attr[i]);
+      }
+      m_out.print(", ");
+    }
+    m_out.println(".");
+  }
+
+  void printPoints() {
+    for (int i = 0; i < (int)points.size(); i++) {
+      m_out.print(i); m_out.print("=(");
+      m_out.print(points[i].x); m_out.print(", ");
+      m_out.print(points[i].y); m_out.print(") ");
+    }
+    m_out.println(".");
+  }
+
+private:
+  TouchManager& m_manager;
+  Adafruit_GFX* m_gfx;
+  Print& m_out;
+  uint8_t m_orientation;
+  CommandRunner m_runner;      //runs scene changes here when there is no pipeline
+
+  uint32_t m_hostOffset;       //added to micros() for the host's clock, set by 'N'
+  bool m_synced;
+  bool m_inCommand;            //bytes of a command have come in since the last one ended
+  uint32_t m_startUs;          //when its first byte came in
+  uint32_t m_startRenderUs;    //render time total then
+  uint32_t m_lastStartUs, m_lastEndUs, m_lastRenderUs; //the last whole command, for 'Q'
+  uint32_t m_startSent;        //commands sent through the pipeline before it
+  uint32_t m_lastStartRenderUs, m_lastStartSent, m_lastSent; //the last whole command's, if it was queued
+
+  bool binActive;              //taking in a binary packet
+  uint8_t binHeader[4];        //format, series per column, column count (little endian)
+  uint8_t binHeaderLen;        //header bytes received so far
+  uint8_t binBytesPerColumn;
+  uint32_t binRemaining;       //payload bytes still to come
+  uint8_t binBuf[BIN_MAX_SERIES * 2]; //the column being received
+  uint8_t binBufLen;
+  int16_t binColumn[BIN_MAX_SERIES] = {}; //last decoded column, the base for int8 deltas
+
+  /**
+   * @brief Adds the time spent taking in a byte to the parse counter when it
+   * goes out of scope, less any rendering done on this core in the mean time
+   * (a drawing command without a pipeline, or with sameCore). Drawing on the
+   * other core goes on alongside, so it isn't taken off.
+   */
+  struct ParseTimer {
+    PerfCounters& perf;
+    int core;
+    uint32_t t0, r0;
+    explicit ParseTimer(PerfCounters& p)
+      : perf(p), core(thisCore()), t0(micros()), r0(p.coreRenderUs(core)) {}
+    ~ParseTimer() {
+      perf.parseUs += (micros() - t0) - (perf.coreRenderUs(core) - r0);
+    }
+  };
+
+  /**
+   * @brief A command for op, with the attributes it could use.
+   * @param length payload bytes to follow it
+   */
+  DrawCommand command(char op, size_t length = 0) {
+    DrawCommand cmd = {};
+    cmd.op = op;
+    cmd.autoscale = attr[LTR('a')];
+    cmd.color = attr[LTR('c')];
+    cmd.id = attr[LTR('i')] > 0 ? attr[LTR('i')] + groupBase : attr[LTR('i')];
+    cmd.x = attr[LTR('x')];
+    cmd.y = attr[LTR('y')];
+    cmd.w = attr[LTR('w')];
+    cmd.h = attr[LTR('h')];
+    cmd.d = attr[LTR('d')];
+    cmd.length = length;
+    cmd.link = link;
+    return cmd;
+  }
+
+  /**
+   * @brief Refuses a payload that can't be queued in one piece, rather than
+   * cut it short (and a point in half), and says so on this link.
+   */
+  bool tooLong(char op, size_t length) {
+    if (length <= PIPELINE_PAYLOAD) return false;
+    m_out.print("Error: ");
+    m_out.print(op);
+    m_out.println(" too long");
+    return true;
+  }
+
+  /**
+   * @brief Runs a scene change now, or sends it to the render core.
+   */
+  void submit(const DrawCommand& cmd, const void* payload = nullptr) {
+    if (pipeline) {
+      pipeline->send(cmd, payload);
+    } else if (!m_runner.run(cmd, payload)) {
+      m_out.println(CommandRunner::error(cmd.op));
+    }
+  }
+
+  /**
+   * @brief Notes when the command just done started and ended, and how long
+   * it spent drawing, for the next 'Q'.
+   */
+  void endCommand() {
+    m_lastStartUs = m_startUs;
+    m_lastEndUs = micros();
+    m_lastRenderUs = m_manager.perf.totalRenderUs() - m_startRenderUs;
+    m_lastStartRenderUs = m_startRenderUs;
+    m_lastStartSent = m_startSent;
+    m_lastSent = pipeline ? pipeline->sent() : 0;
+    m_inCommand = false;
+  }
+
+  /**
+   * @brief When the last command was queued, waits for it to be drawn, and
+   * takes its end and render time from the render side. Only 'Q' waits, so
+   * commands still stream; the render time includes anything queued before
+   * it that was still being drawn (none, when the host waits for each 'Q').
+   */
+  void finishQueued() {
+    pipeline->drain();
+    m_lastEndUs = pipeline->doneUs();
+    m_lastRenderUs = m_manager.perf.totalRenderUs() - m_lastStartRenderUs;
+    m_lastStartSent = m_lastSent; //once
+    m_startRenderUs = m_manager.perf.totalRenderUs(); //that drawing isn't part of the ping's own time
+  }
+
+  /**
+   * @brief Takes in one byte of a binary 'V' packet.
+   * Whole columns are appended to the graph as they arrive,
+   * and it is drawn once at the end of the packet.
+   */
+  void readBinary(uint8_t b) {
+    if (binHeaderLen < sizeof(binHeader)) {
+      binHeader[binHeaderLen++] = b;
+      if (binHeaderLen < sizeof(binHeader)) return;
+      uint8_t format = binHeader[0];
+      uint8_t count = binHeader[1];
+      uint16_t columns = binHeader[2] | (binHeader[3] << 8);
+      if (format > 1 || count == 0 || count > BIN_MAX_SERIES) {
+        m_out.println("Error: bad V header");
+        binActive = false;
+        endCommand();
+        return;
+      }
+      binBytesPerColumn = count * (format ? 1 : 2);
+      binRemaining = (uint32_t)columns * binBytesPerColumn;
+      binBufLen = 0;
+      if (!binRemaining) {
+        binActive = false;
+        endCommand();
+      }
+      return;
+    }
+    binBuf[binBufLen++] = b;
+    binRemaining--;
+    if (binBufLen == binBytesPerColumn) {
+      uint8_t count = binHeader[1];
+      for (int i = 0; i < count; i++) {
+        if (binHeader[0]) { //int8 delta from the last column
+          binColumn[i] += (int8_t)binBuf[i];
+        } else { //int16 little endian
+          binColumn[i] = (int16_t)(binBuf[2 * i] | (binBuf[2 * i + 1] << 8));
+        }
+      }
+      DrawCommand cmd = command(DrawCommand::COLUMN, count * sizeof(int16_t));
+      submit(cmd, binColumn);
+      binBufLen = 0;
+    }
+    if (!binRemaining) {
+      DrawCommand cmd = command(DrawCommand::FLUSH);
+      submit(cmd);
+      binActive = false;
+      endCommand();
+    }
+  }
+};
+
+#include "SelfBench.h"
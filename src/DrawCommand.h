@@ -0,0 +1,130 @@
+/*
+  DrawCommand.h
+
+  The part of a command that changes the scene, decoded by the parser into a
+  fixed size record: the opcode and the attributes it uses. Text, points,
+  graph values and binary columns follow it as a payload. A CommandRunner
+  applies them to a TouchManager, either straight away (one core) or on the
+  other end of a Pipeline (see Pipeline.h).
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include "TouchManager.h"
+
+/**
+ * @brief One scene changing command.
+ */
+struct DrawCommand {
+  // Opcodes beyond the command letters, for binary 'V' packets
+  static const char COLUMN = 'v'; // append one column, the payload is int16 values
+  static const char FLUSH = 'w';  // end of the packet, draw if anything changed
+
+  char op;           // 'Z', 'R', 'O', 'L', 'S', 'T', 'G', 'V', 'K', 'U', COLUMN or FLUSH
+  uint8_t autoscale; // 'a'
+  uint16_t color;    // 'c'
+  int id;            // 'i'
+  int x, y, w, h, d;
+  int arg[4];        // T: font, size, direction. K: edge, level, holdoff, pre-trigger. U: series, mode, overlays
+  uint16_t length;   // payload bytes: text (T), GFXPoints (L, S), ints (G), int16s (COLUMN)
+  uint8_t link;      // the host link it came from, for errors (see HostLinks.h)
+};
+
+class CommandRunner {
+public:
+  CommandRunner(TouchManager& manager, Adafruit_GFX* gfx)
+    : m_manager(manager), m_gfx(gfx), m_binID(0), m_binDirty(false) {}
+
+  /**
+   * @brief Applies a command to the scene.
+   * @param payload cmd.length bytes, aligned for its type. Text must also
+   * have a 0 after it.
+   * @return false if it failed, see error()
+   */
+  bool run(const DrawCommand& cmd, const void* payload) {
+    switch (cmd.op) {
+      case 'Z':
+        if (m_gfx) m_gfx->fillScreen(C565_BLACK);
+        m_manager.clearAll();
+        return true;
+
+      case 'R':
+        m_manager.addRect(cmd.x, cmd.y, cmd.w, cmd.h, cmd.color, true, cmd.id);
+        return true;
+
+      case 'O':
+        m_manager.addCircle(cmd.x, cmd.y, cmd.d, cmd.color, true, cmd.id);
+        return true;
+
+      case 'L': //not closed, no group ID
+        m_manager.addPolygon((const GFXPoint*)payload, cmd.length / sizeof(GFXPoint), cmd.color, false, 0);
+        return true;
+
+      case 'S':
+        m_manager.addPolygon((const GFXPoint*)payload, cmd.length / sizeof(GFXPoint), cmd.color, true, cmd.id);
+        return true;
+
+      case 'T':
+        m_manager.addText(cmd.x, cmd.y, (const char*)payload, cmd.arg[0], cmd.color,
+                          cmd.arg[1], cmd.arg[2], cmd.id);
+        return true;
+
+      case 'G':
+        m_manager.addGraph(cmd.x, cmd.y, cmd.w, cmd.h, cmd.color, true, cmd.id,
+                           (const int*)payload, cmd.length / sizeof(int), cmd.autoscale);
+        return true;
+
+      case 'V':
+        binGraph(cmd.id);
+        return m_manager.beginGraph(cmd.x, cmd.y, cmd.w, cmd.h, cmd.color, true, cmd.id, cmd.autoscale);
+
+      case DrawCommand::COLUMN:
+        binGraph(cmd.id);
+        m_binDirty |= m_manager.appendGraph(m_binID, (const int16_t*)payload, cmd.length / sizeof(int16_t));
+        return true;
+
+      case DrawCommand::FLUSH:
+        binGraph(cmd.id);
+        if (m_binDirty) m_manager.drawGraph(m_binID);
+        m_binDirty = false;
+        return true;
+
+      case 'K':
+        return m_manager.beginGraph(cmd.x, cmd.y, cmd.w, cmd.h, cmd.color, true, cmd.id, cmd.autoscale) &&
+               m_manager.triggerGraph(cmd.id, cmd.arg[0], cmd.arg[1], cmd.arg[2], cmd.arg[3]);
+
+      case 'U':
+        return m_manager.styleGraph(cmd.id, cmd.arg[0], cmd.color, cmd.arg[1], cmd.arg[2]);
+    }
+    return true;
+  }
+
+  /**
+   * @brief The message for a command that failed.
+   */
+  static const char* error(char op) {
+    switch (op) {
+      case 'V': return "Error: V needs a group id and width";
+      case 'K': return "Error: K needs a group id and width";
+      case 'U': return "Error: U needs a graph id and a series n from 0 to 15";
+    }
+    return "Error: command failed";
+  }
+
+private:
+  TouchManager& m_manager;
+
+  // Packets from different links may take turns: draw what one changed
+  // before going on to another's graph
+  void binGraph(int id) {
+    if (id == m_binID) return;
+    if (m_binDirty) m_manager.drawGraph(m_binID);
+    m_binID = id;
+    m_binDirty = false;
+  }
+
+  Adafruit_GFX* m_gfx;
+  int m_binID;      //graph the binary packet goes to
+  bool m_binDirty;  //it has something new to draw
+};
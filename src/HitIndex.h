@@ -0,0 +1,198 @@
+/*
+  HitIndex.h
+
+  What findGroupIDAt searches: the shapes in drawing order with their group
+  IDs, published so touch lookups on one core never wait for, or see half of,
+  a scene change on the other (see Pipeline.h).
+
+  The entries live in a block that is only appended to: an entry is written,
+  then the count is bumped, so a reader sees the old count or the new one.
+  When the block is full, or the scene is cleared, a new block is published
+  and the old one, with any shapes cleared, is retired. Retired memory is
+  freed (epoch based reclamation) once no reader can still be looking at it:
+  each reader notes the epoch when it starts, the writer bumps the epoch on
+  every publish, and anything retired before the oldest epoch a reader holds
+  can go.
+
+  One writer (the core changing the scene), and up to HIT_READERS readers,
+  each with its own number. Only loads and stores are used, as the M0+ has no
+  read-modify-write instructions. Readers never block; the writer never
+  waits, it frees what it can each time it publishes.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <vector>
+#include <utility>
+
+#define HIT_READERS 4 //threads or cores that may call find, numbered from 0
+
+/**
+ * @tparam Shape has bool contains(int, int) const (TouchShape)
+ */
+template <typename Shape>
+class HitIndex {
+public:
+  HitIndex() : m_epoch(1), m_spare(nullptr) {
+    for (auto& r : m_readers) r.store(0, std::memory_order_relaxed);
+    m_current.store(makeBlock(16), std::memory_order_relaxed);
+  }
+
+  ~HitIndex() {
+    freeBlock(m_current.load(std::memory_order_relaxed));
+    freeBlock(m_spare);
+    for (auto& r : m_retiredBlocks) freeBlock(r.second);
+  }
+
+  HitIndex(const HitIndex&) = delete;
+  HitIndex& operator=(const HitIndex&) = delete;
+
+  // ---- Writer side ----
+
+  /**
+   * @brief Adds a shape on top. Call once it has been drawn, so it is
+   * complete (text knows its bounds) before a reader can see it.
+   */
+  void append(const Shape* shape, int groupID) {
+    if (retired()) reclaim(); //what a reader held up last time
+    Block* b = m_current.load(std::memory_order_relaxed);
+    uint32_t n = b->count.load(std::memory_order_relaxed);
+    if (n == b->capacity) {
+      Block* bigger = takeBlock(2 * n);
+      for (uint32_t i = 0; i < n; i++) bigger->entries[i] = b->entries[i];
+      bigger->count.store(n, std::memory_order_relaxed);
+      publish(bigger);
+      b = bigger;
+    }
+    b->entries[n].shape = shape;
+    b->entries[n].id = groupID;
+    b->count.store(n + 1, std::memory_order_release);
+  }
+
+  /**
+   * @brief Empties the index. The shapes are kept alive (moved out of
+   * shapes) until no reader can be looking at them.
+   */
+  void clear(std::vector<std::shared_ptr<Shape>>& shapes) {
+    publish(takeBlock(0));
+    uint32_t retiredAt = m_epoch.load(std::memory_order_relaxed) - 1;
+    for (auto& s : shapes) m_retiredShapes.emplace_back(retiredAt, std::move(s));
+    shapes.clear();
+    reclaim();
+  }
+
+  /**
+   * @return blocks and shapes retired, but not freed yet
+   */
+  size_t retired() const { return m_retiredBlocks.size() + m_retiredShapes.size(); }
+
+  // ---- Reader side ----
+
+  /**
+   * @brief The group ID of the top shape containing (px, py).
+   * @param reader this thread's or core's number, below HIT_READERS
+   * @return -1 for none, or a shape with no group
+   */
+  int find(int px, int py, unsigned reader = 0) const {
+    enter(reader);
+    const Block* b = m_current.load(std::memory_order_seq_cst);
+    int id = -1;
+    // Iterate in reverse order (Z-order: last-added is checked first)
+    for (uint32_t i = b->count.load(std::memory_order_acquire); i-- > 0;) {
+      if (b->entries[i].shape->contains(px, py)) {
+        id = b->entries[i].id ? b->entries[i].id : -1; //no group is a "dead" shape
+        break;
+      }
+    }
+    leave(reader);
+    return id;
+  }
+
+  /**
+   * @brief Marks a reader as looking, until leave. find does this itself.
+   */
+  void enter(unsigned reader) const {
+    m_readers[reader].store(m_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+  }
+
+  void leave(unsigned reader) const {
+    m_readers[reader].store(0, std::memory_order_release);
+  }
+
+private:
+  struct Entry {
+    const Shape* shape;
+    int id;
+  };
+
+  struct Block {
+    std::atomic<uint32_t> count;
+    uint32_t capacity;
+    Entry entries[1]; //capacity of them
+  };
+
+  std::atomic<Block*> m_current;
+  std::atomic<uint32_t> m_epoch;                      //bumped by every publish
+  mutable std::atomic<uint32_t> m_readers[HIT_READERS]; //epoch each reader started in, 0 when not reading
+  Block* m_spare;                                     //freed block kept for reuse, so steady state doesn't allocate
+  std::vector<std::pair<uint32_t, Block*>> m_retiredBlocks; //with the last epoch they could be seen in
+  std::vector<std::pair<uint32_t, std::shared_ptr<Shape>>> m_retiredShapes;
+
+  static Block* makeBlock(uint32_t capacity) {
+    if (capacity < 16) capacity = 16;
+    Block* b = static_cast<Block*>(::operator new(sizeof(Block) + (capacity - 1) * sizeof(Entry)));
+    new (&b->count) std::atomic<uint32_t>(0);
+    b->capacity = capacity;
+    return b;
+  }
+
+  static void freeBlock(Block* b) {
+    if (b) ::operator delete(b);
+  }
+
+  // A block for at least capacity entries, the spare if it is big enough
+  Block* takeBlock(uint32_t capacity) {
+    Block* b;
+    if (m_spare && m_spare->capacity >= capacity) {
+      b = m_spare;
+      m_spare = nullptr;
+    } else {
+      b = makeBlock(capacity);
+    }
+    b->count.store(0, std::memory_order_relaxed);
+    return b;
+  }
+
+  void publish(Block* b) {
+    Block* old = m_current.load(std::memory_order_relaxed);
+    m_current.store(b, std::memory_order_seq_cst);
+    uint32_t e = m_epoch.load(std::memory_order_relaxed);
+    m_epoch.store(e + 1, std::memory_order_seq_cst);
+    m_retiredBlocks.emplace_back(e, old);
+    reclaim();
+  }
+
+  /**
+   * @brief Frees what was retired before the oldest epoch a reader is in.
+   */
+  void reclaim() {
+    uint32_t safe = m_epoch.load(std::memory_order_relaxed);
+    for (const auto& r : m_readers) {
+      uint32_t e = r.load(std::memory_order_seq_cst);
+      if (e && e < safe) safe = e;
+    }
+    size_t n = 0;
+    while (n < m_retiredBlocks.size() && m_retiredBlocks[n].first < safe) {
+      Block* b = m_retiredBlocks[n++].second;
+      if (!m_spare || b->capacity > m_spare->capacity) std::swap(b, m_spare);
+      freeBlock(b);
+    }
+    m_retiredBlocks.erase(m_retiredBlocks.begin(), m_retiredBlocks.begin() + n);
+    n = 0;
+    while (n < m_retiredShapes.size() && m_retiredShapes[n].first < safe) n++;
+    m_retiredShapes.erase(m_retiredShapes.begin(), m_retiredShapes.begin() + n);
+  }
+};
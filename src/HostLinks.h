@@ -0,0 +1,135 @@
+/*
+  HostLinks.h
+
+  Several hosts driving one display at once, e.g. a PLC on Serial1 and a
+  maintenance laptop on USB. Each link (see Transport.h) gets a parser of its
+  own, so bytes arriving on one never mix with a command half sent on
+  another; all of them build the same TouchManager.
+
+  A link can have its own group IDs: its 1 to GROUP_NAMESPACE - 1 (the
+  parser refuses higher ones, from every link) are stored
+  offset by a base of its own, so two hosts can both use 1i without one
+  taking over the other's buttons. A touch on a group is reported only to
+  the link that owns the group ID, with the ID it used, and a touch on
+  nothing (-1) to every link. Touches on shared IDs go to every link without
+  its own IDs, and to those with their own that ask for them (sharedTouches),
+  where they read just like their own IDs. When a new host takes over a link
+  (TCP), that link's parser starts afresh.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include <memory>
+#include <vector>
+#include "CommandParser.h"
+#include "Transport.h"
+
+class HostLinks {
+public:
+  HostLinks(TouchManager& manager, Adafruit_GFX* gfx, uint8_t orientation = 1)
+    : m_manager(manager), m_gfx(gfx), m_orientation(orientation), m_namespaces(0) {}
+
+  /**
+   * @brief Adds a link, with a parser of its own.
+   * @param ownGroups keep its group IDs apart from the other links'
+   * @param sharedTouches with ownGroups, still report touches on shared IDs
+   * @return its parser, or nullptr if there are PIPELINE_LINKS already
+   */
+  CommandParser* add(Transport& link, bool ownGroups = false, bool sharedTouches = false) {
+    if (m_links.size() == PIPELINE_LINKS) return nullptr;
+    Link l;
+    l.transport = &link;
+    l.sharedTouches = !ownGroups || sharedTouches;
+    l.parser.reset(new CommandParser(m_manager, m_gfx, link, m_orientation));
+    l.parser->link = m_links.size();
+    if (ownGroups) l.parser->groupBase = ++m_namespaces * GROUP_NAMESPACE;
+    link.onNewHost([](void* parser) { static_cast<CommandParser*>(parser)->reset(); }, l.parser.get());
+    m_links.push_back(std::move(l));
+    return m_links.back().parser.get();
+  }
+
+  size_t count() const { return m_links.size(); }
+  CommandParser& parser(size_t i) { return *m_links[i].parser; }
+  Transport& transport(size_t i) { return *m_links[i].transport; }
+
+  /**
+   * @brief Sends every link's scene changes through a pipeline, or nullptr
+   * to run them straight away.
+   */
+  void setPipeline(Pipeline* pipeline) {
+    for (auto& l : m_links) l.parser->pipeline = pipeline;
+  }
+
+  /**
+   * @return true if any link has bytes waiting
+   */
+  bool available() {
+    for (auto& l : m_links) {
+      if (l.transport->available() > 0) return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief Takes in up to most bytes from each link in turn.
+   * @return the bytes taken
+   */
+  size_t feed(size_t most) {
+    size_t taken = 0;
+    for (auto& l : m_links) taken += l.parser->feed(*l.transport, most);
+    return taken;
+  }
+
+  /**
+   * @brief Counts overflows, and prints errors from the render side.
+   */
+  void poll() {
+    for (auto& l : m_links) {
+      if (l.transport->overflow()) m_manager.perf.rxOverflows++;
+      l.parser->poll();
+    }
+  }
+
+  /**
+   * @return the link that owns a group ID, or -1 if it is shared
+   */
+  int owner(int id) const {
+    if (id < GROUP_NAMESPACE) return -1;
+    for (size_t i = 0; i < m_links.size(); i++) {
+      if (m_links[i].parser->groupBase == id / GROUP_NAMESPACE * GROUP_NAMESPACE) return i;
+    }
+    return -1;
+  }
+
+  /**
+   * @brief Reports a touch to the link that owns the group, a touch on
+   * nothing to every link, and one on a shared group to every link that
+   * takes shared touches.
+   * @param id from findGroupIDAt
+   * @param us micros() at the touch
+   */
+  void touch(int id, int x, int y, uint32_t us) {
+    int i = owner(id);
+    if (i >= 0) {
+      m_links[i].parser->reportTouch(id, x, y, us);
+      return;
+    }
+    for (auto& l : m_links) {
+      if (id < 0 || l.sharedTouches) l.parser->reportTouch(id, x, y, us);
+    }
+  }
+
+private:
+  struct Link {
+    Transport* transport;
+    std::unique_ptr<CommandParser> parser;
+    bool sharedTouches; //reported touches on shared IDs
+  };
+
+  TouchManager& m_manager;
+  Adafruit_GFX* m_gfx;
+  uint8_t m_orientation;
+  int m_namespaces;
+  std::vector<Link> m_links;
+};
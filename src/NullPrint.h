@@ -0,0 +1,18 @@
+/*
+  NullPrint.h
+
+  A Print that throws away what is written to it: for output nobody reads,
+  e.g. the echo while the self benchmark (SelfBench.h) or the soak test
+  (Soak.h) drives a parser. On the PC, host/PrintSinks.h has more.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+class NullPrint : public Print {
+public:
+  size_t write(uint8_t) override { return 1; }
+  size_t write(const uint8_t*, size_t size) override { return size; }
+  using Print::write;
+};
@@ -0,0 +1,224 @@
+/*
+  PerfCounters.h
+
+  Always-on performance counters, so deployments can be tuned from
+  field evidence. Dumped with `1?` and reset with `2?`.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include <Adafruit_GFX.h>
+#include "ThisCore.h"
+
+/**
+ * @brief A fixed block of counters. Times are in microseconds.
+ * The drawing counters are kept per core, each core adding only to its own,
+ * so with dualcore the two cores never write the same counter. The rest are
+ * only written on core 0.
+ */
+struct PerfCounters {
+  static const int OPCODES = 29;  // 'A'-'Z', ',', '#', '?'
+  static const int SHAPES = 5;    // by TouchShape::type()
+
+  /**
+   * @brief What one core has drawn.
+   */
+  struct Drawing {
+    uint32_t renders[SHAPES];     // shapes drawn, per type
+    uint32_t renderUs[SHAPES];    // time drawing, per type
+    uint32_t pixels;              // pixels written to the display
+    uint32_t spiBytes;            // estimated bytes sent to the display
+  };
+
+  uint32_t bytesRx;               // bytes received from the host
+  uint32_t rxOverflows;           // times the serial receive FIFO overflowed
+  uint32_t commands[OPCODES];     // commands parsed, per opcode
+  uint32_t parseUs;               // time taking in bytes, not counting rendering
+  uint32_t touches;               // new touch points
+  uint32_t hitTests;              // findGroupIDAt calls
+  uint32_t hitTestUs;
+  Drawing drawing[MERGIF_CORES];  // by the core that drew
+
+  PerfCounters() { reset(); }
+
+  /**
+   * @brief Zeros all the counters. Nothing may be drawing on the other core.
+   */
+  void reset() {
+    memset(this, 0, sizeof(*this));
+  }
+
+  static int opcodeSlot(char c) {
+    if ('A' <= c && c <= 'Z') return c - 'A';
+    if (c == ',') return 26;
+    if (c == '#') return 27;
+    if (c == '?') return 28;
+    return -1;
+  }
+
+  static char opcodeAt(int slot) {
+    return slot < 26 ? 'A' + slot : ",#?"[slot - 26];
+  }
+
+  static int shapeSlot(char type) {
+    const char* types = "ROSGT";
+    const char* p = strchr(types, type);
+    return (type && p) ? p - types : -1;
+  }
+
+  void command(char c) {
+    int i = opcodeSlot(c);
+    if (i >= 0) commands[i]++;
+  }
+
+  /**
+   * @brief The drawing counters of the calling core.
+   */
+  Drawing& mine() { return drawing[thisCore()]; }
+
+  void render(char type, uint32_t us) {
+    int i = shapeSlot(type);
+    if (i < 0) return;
+    Drawing& d = mine();
+    d.renders[i]++;
+    d.renderUs[i] += us;
+  }
+
+  // Totals over both cores
+
+  uint32_t renders(int slot) const {
+    uint32_t n = 0;
+    for (const Drawing& d : drawing) n += d.renders[slot];
+    return n;
+  }
+
+  uint32_t renderUs(int slot) const {
+    uint32_t t = 0;
+    for (const Drawing& d : drawing) t += d.renderUs[slot];
+    return t;
+  }
+
+  uint32_t pixels() const {
+    uint32_t n = 0;
+    for (const Drawing& d : drawing) n += d.pixels;
+    return n;
+  }
+
+  uint32_t spiBytes() const {
+    uint32_t n = 0;
+    for (const Drawing& d : drawing) n += d.spiBytes;
+    return n;
+  }
+
+  uint32_t totalRenderUs() const {
+    uint32_t t = 0;
+    for (int core = 0; core < MERGIF_CORES; core++) t += coreRenderUs(core);
+    return t;
+  }
+
+  /**
+   * @brief Time drawing on one core.
+   */
+  uint32_t coreRenderUs(int core) const {
+    uint32_t t = 0;
+    for (int i = 0; i < SHAPES; i++) t += drawing[core].renderUs[i];
+    return t;
+  }
+
+  /**
+   * @brief Prints the counters on one line, skipping zeros in the tables.
+   * e.g. `#perf rx=52 ovf=0 cmd=R2,O1 parse=4100 draw=R2/950,O1/700 px=5031 spi=10095 touch=1 hit=1/12`
+   */
+  void print(Print& out) const {
+    out.print("#perf rx="); out.print(bytesRx);
+    out.print(" ovf="); out.print(rxOverflows);
+    out.print(" cmd=");
+    bool first = true;
+    for (int i = 0; i < OPCODES; i++) {
+      if (!commands[i]) continue;
+      if (!first) out.print(',');
+      out.print(opcodeAt(i)); out.print(commands[i]);
+      first = false;
+    }
+    out.print(" parse="); out.print(parseUs);
+    out.print(" draw=");
+    first = true;
+    for (int i = 0; i < SHAPES; i++) {
+      if (!renders(i)) continue;
+      if (!first) out.print(',');
+      out.print("ROSGT"[i]); out.print(renders(i));
+      out.print('/'); out.print(renderUs(i));
+      first = false;
+    }
+    out.print(" px="); out.print(pixels());
+    out.print(" spi="); out.print(spiBytes());
+    out.print(" touch="); out.print(touches);
+    out.print(" hit="); out.print(hitTests);
+    out.print('/'); out.println(hitTestUs);
+  }
+};
+
+/**
+ * @brief Wraps a display driver to count the pixels written, and estimate the
+ * SPI bytes for an ILI9341 style controller: an address window (3 command and
+ * 8 data bytes) then 2 bytes per pixel, for every primitive.
+ * e.g. CountingGFX<Adafruit_ILI9341> tft(TFT_CS, TFT_DC);
+ */
+template <class Base>
+class CountingGFX : public Base {
+public:
+  PerfCounters* perf;
+
+  template <typename... Args>
+  CountingGFX(Args... args) : Base(args...), perf(nullptr) {}
+
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override {
+    count(x, y, 1, 1);
+    Base::drawPixel(x, y, color);
+  }
+  void writePixel(int16_t x, int16_t y, uint16_t color) override {
+    count(x, y, 1, 1);
+    Base::writePixel(x, y, color);
+  }
+  void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) override {
+    count(x, y, w, h);
+    Base::fillRect(x, y, w, h, color);
+  }
+  void writeFillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) override {
+    count(x, y, w, h);
+    Base::writeFillRect(x, y, w, h, color);
+  }
+  void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) override {
+    count(x, y, w, 1);
+    Base::drawFastHLine(x, y, w, color);
+  }
+  void writeFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) override {
+    count(x, y, w, 1);
+    Base::writeFastHLine(x, y, w, color);
+  }
+  void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) override {
+    count(x, y, 1, h);
+    Base::drawFastVLine(x, y, h, color);
+  }
+  void writeFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) override {
+    count(x, y, 1, h);
+    Base::writeFastVLine(x, y, h, color);
+  }
+
+private:
+  // Clip like the driver does, and count what is left
+  void count(int32_t x, int32_t y, int32_t w, int32_t h) {
+    if (!perf) return;
+    if (w < 0) { x += w + 1; w = -w; }
+    if (h < 0) { y += h + 1; h = -h; }
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > this->width()) w = this->width() - x;
+    if (y + h > this->height()) h = this->height() - y;
+    if (w <= 0 || h <= 0) return;
+    PerfCounters::Drawing& d = perf->mine();
+    d.pixels += w * h;
+    d.spiBytes += 11 + 2 * w * h;
+  }
+};
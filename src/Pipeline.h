@@ -0,0 +1,207 @@
+/*
+  Pipeline.h
+
+  Parsing on one core, drawing on the other. The parser decodes each scene
+  changing command into a DrawCommand (see DrawCommand.h) and sends it, and
+  its payload, through lock free single producer / single consumer queues to
+  a RenderLoop, which applies it to the TouchManager and draws. So bytes keep
+  coming in while a big fill goes out over SPI.
+
+  On the RP2040, define dualcore in main.cpp: loop() on core 0 parses and
+  handles touch, loop1() on core 1 runs the RenderLoop. On the PC a std::thread
+  stands in for core 1 (see test/test_host_pipeline and host/bench.cpp).
+  Without dualcore the RenderLoop is a task on the same core (see Scheduler.h),
+  drawing a slice of the queue at a time between touches; set sameCore so the
+  parser runs it itself instead of waiting for room.
+
+  Commands that fail on the render side ('V', 'K', 'U') send their opcode back,
+  and the parser of the link they came from prints the error the next time it
+  runs. Touch lookups on core 0 don't wait for core 1, see HitIndex.h.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include "DrawCommand.h"
+#include "ThisCore.h"
+
+#ifndef ARDUINO_ARCH_RP2040
+#include <thread>
+#endif
+
+#define PIPELINE_COMMANDS 64   //records in flight, a power of two
+#define PIPELINE_PAYLOAD 2048  //bytes of text, points and values in flight, a power of two
+#define PIPELINE_LINKS 4       //host links sending through it, each with its own errors (see HostLinks.h)
+
+class RenderLoop;
+
+/**
+ * @brief Lock free ring for one producer and one consumer (one core each).
+ * Only loads and stores, no read-modify-write, which the M0+ doesn't have.
+ * @tparam N slots, a power of two
+ */
+template <typename T, size_t N>
+class SpscQueue {
+public:
+  SpscQueue() : m_head(0), m_tail(0) {}
+
+  size_t size() const {
+    return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+  }
+  size_t space() const { return N - size(); }
+  static size_t capacity() { return N; }
+
+  // Producer side
+
+  bool push(const T& v) { return write(&v, 1); }
+
+  /**
+   * @brief Adds all n, or none if there isn't room.
+   */
+  bool write(const T* v, size_t n) {
+    uint32_t tail = m_tail.load(std::memory_order_relaxed);
+    if (N - (tail - m_head.load(std::memory_order_acquire)) < n) return false;
+    for (size_t i = 0; i < n; i++) m_slots[(tail + i) & (N - 1)] = v[i];
+    m_tail.store(tail + n, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side
+
+  bool pop(T& v) { return read(&v, 1); }
+
+  /**
+   * @brief Takes all n, or none if there aren't that many.
+   */
+  bool read(T* v, size_t n) {
+    uint32_t head = m_head.load(std::memory_order_relaxed);
+    if (m_tail.load(std::memory_order_acquire) - head < n) return false;
+    for (size_t i = 0; i < n; i++) v[i] = m_slots[(head + i) & (N - 1)];
+    m_head.store(head + n, std::memory_order_release);
+    return true;
+  }
+
+private:
+  static_assert((N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+  std::atomic<uint32_t> m_head; //next to read, only the consumer writes it
+  std::atomic<uint32_t> m_tail; //next to write, only the producer writes it
+  T m_slots[N];
+};
+
+/**
+ * @brief Spins politely while waiting on the other core.
+ */
+inline void pipelineWait() {
+#ifdef ARDUINO_ARCH_RP2040
+  tight_loop_contents();
+#else
+  std::this_thread::yield();
+#endif
+}
+
+class Pipeline {
+public:
+  SpscQueue<DrawCommand, PIPELINE_COMMANDS> commands;
+  SpscQueue<uint8_t, PIPELINE_PAYLOAD> payload;
+  SpscQueue<char, 16> errors[PIPELINE_LINKS]; //opcodes of commands that failed, back to the parser of each link
+  uint32_t stalls;                  //sends that had to wait for room, producer side
+  RenderLoop* sameCore;             //the consumer, if it runs on the producer's core
+
+  Pipeline() : stalls(0), sameCore(nullptr), m_sent(0), m_done(0), m_doneUs(0) {}
+
+  /**
+   * @brief Queues a command, waiting for room if the render side is behind.
+   * The payload must fit in PIPELINE_PAYLOAD; the parser refuses longer ones.
+   */
+  void send(const DrawCommand& cmd, const void* data) {
+    if (payload.space() < cmd.length || !commands.space()) {
+      stalls++;
+      while (payload.space() < cmd.length || !commands.space()) wait();
+    }
+    payload.write((const uint8_t*)data, cmd.length); //first, so it is there when the command is
+    commands.push(cmd);
+    m_sent++;
+  }
+
+  /**
+   * @brief Waits until the render side has run everything sent.
+   * Producer side.
+   */
+  void drain() {
+    while (m_done.load(std::memory_order_acquire) != m_sent) wait();
+  }
+
+  /**
+   * @brief True if nothing is queued or running.
+   */
+  bool idle() const { return m_done.load(std::memory_order_acquire) == m_sent; }
+
+  /**
+   * @brief Commands sent so far. Producer side.
+   */
+  uint32_t sent() const { return m_sent; }
+
+  /**
+   * @brief micros() when the render side finished its last command. After
+   * drain(), when the last one sent was done (for 'Q').
+   */
+  uint32_t doneUs() const { return m_doneUs.load(std::memory_order_acquire); }
+
+private:
+  friend class RenderLoop;
+  uint32_t m_sent;               //only the producer writes it
+  std::atomic<uint32_t> m_done;  //only the consumer writes it
+  std::atomic<uint32_t> m_doneUs; //only the consumer writes it
+
+  inline void wait();
+};
+
+/**
+ * @brief The consumer: takes commands off a Pipeline and runs them.
+ */
+class RenderLoop {
+public:
+  RenderLoop(Pipeline& pipeline, TouchManager& manager, Adafruit_GFX* gfx)
+    : m_pipeline(pipeline), m_runner(manager, gfx) {}
+
+  /**
+   * @brief Runs one command, if there is one.
+   * @return false if the queue was empty
+   */
+  bool step() {
+    DrawCommand cmd;
+    if (!m_pipeline.commands.pop(cmd)) return false;
+    m_pipeline.payload.read(m_data, cmd.length);
+    m_data[cmd.length] = 0; //for text
+    if (!m_runner.run(cmd, m_data)) m_pipeline.errors[cmd.link].push(cmd.op); //dropped if the parser is far behind
+    m_pipeline.m_doneUs.store(micros(), std::memory_order_relaxed); //published by m_done
+    m_pipeline.m_done.store(m_pipeline.m_done.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Runs commands until stop is set, waiting when there are none.
+   * For a thread standing in for core 1, on the PC.
+   */
+  void run(const std::atomic<bool>& stop) {
+    setThisCore(1); //this thread is core 1, for the counters it adds to
+    while (!stop.load(std::memory_order_acquire)) {
+      if (!step()) pipelineWait();
+    }
+    while (step()) {}
+  }
+
+private:
+  Pipeline& m_pipeline;
+  CommandRunner m_runner;
+  alignas(4) uint8_t m_data[PIPELINE_PAYLOAD + 1];
+};
+
+/**
+ * @brief Waits for the render side to make progress, or makes it, if it is
+ * on this core.
+ */
+inline void Pipeline::wait() {
+  if (!sameCore || !sameCore->step()) pipelineWait();
+}
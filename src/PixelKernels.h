@@ -0,0 +1,335 @@
+/*
+  PixelKernels.h
+
+  The inner loops of framebuffer rendering, on RGB565 spans:
+
+  - fill16:    set n pixels to one colour
+  - copy16:    copy n pixels (a bitmap row)
+  - blitKey16: copy n pixels, leaving those of the key colour as they were
+  - swap16:    byte swap n pixels, e.g. to the big endian order the ILI9341
+               takes over SPI (dst may be src)
+
+  Each comes as a scalar reference, a 32 bit word version (two pixels per
+  load / store, for the Cortex-M0+, which has no unaligned access or SIMD),
+  and on x86 hosts SSE2 and AVX2 versions. PixelKernels::best() picks the
+  fastest this CPU has; the plain functions below call it.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && defined(__SSE2__)
+#define PIXEL_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace PixelKernels {
+
+/**
+ * @brief One implementation of each kernel.
+ */
+struct Kernels {
+  const char* name;
+  void (*fill16)(uint16_t* dst, uint16_t color, size_t n);
+  void (*copy16)(uint16_t* dst, const uint16_t* src, size_t n);
+  void (*blitKey16)(uint16_t* dst, const uint16_t* src, size_t n, uint16_t key);
+  void (*swap16)(uint16_t* dst, const uint16_t* src, size_t n);
+};
+
+// ---- scalar reference ----
+
+namespace scalar {
+
+inline void fill16(uint16_t* dst, uint16_t color, size_t n) {
+  for (size_t i = 0; i < n; i++) dst[i] = color;
+}
+
+inline void copy16(uint16_t* dst, const uint16_t* src, size_t n) {
+  for (size_t i = 0; i < n; i++) dst[i] = src[i];
+}
+
+inline void blitKey16(uint16_t* dst, const uint16_t* src, size_t n, uint16_t key) {
+  for (size_t i = 0; i < n; i++) {
+    if (src[i] != key) dst[i] = src[i];
+  }
+}
+
+inline void swap16(uint16_t* dst, const uint16_t* src, size_t n) {
+  for (size_t i = 0; i < n; i++) dst[i] = (uint16_t)((src[i] >> 8) | (src[i] << 8));
+}
+
+} // namespace scalar
+
+// ---- 32 bit words, two pixels at a time ----
+
+namespace packed32 {
+
+typedef uint32_t __attribute__((may_alias)) Word;
+
+inline bool aligned(const void* p) { return ((uintptr_t)p & 3) == 0; }
+
+inline void fill16(uint16_t* dst, uint16_t color, size_t n) {
+  if (n && !aligned(dst)) {
+    *dst++ = color;
+    n--;
+  }
+  uint32_t pair = color | ((uint32_t)color << 16);
+  Word* w = (Word*)dst;
+  for (; n >= 8; n -= 8, w += 4) {
+    w[0] = pair; w[1] = pair; w[2] = pair; w[3] = pair;
+  }
+  for (; n >= 2; n -= 2) *w++ = pair;
+  if (n) *(uint16_t*)w = color;
+}
+
+inline void copy16(uint16_t* dst, const uint16_t* src, size_t n) {
+  if (aligned(dst) != aligned(src)) { //can't pair them up
+    scalar::copy16(dst, src, n);
+    return;
+  }
+  if (n && !aligned(dst)) {
+    *dst++ = *src++;
+    n--;
+  }
+  Word* d = (Word*)dst;
+  const Word* s = (const Word*)src;
+  for (; n >= 8; n -= 8, d += 4, s += 4) {
+    uint32_t a = s[0], b = s[1], c = s[2], e = s[3];
+    d[0] = a; d[1] = b; d[2] = c; d[3] = e;
+  }
+  for (; n >= 2; n -= 2) *d++ = *s++;
+  if (n) *(uint16_t*)d = *(const uint16_t*)s;
+}
+
+inline void blitKey16(uint16_t* dst, const uint16_t* src, size_t n, uint16_t key) {
+  if (aligned(dst) != aligned(src)) {
+    scalar::blitKey16(dst, src, n, key);
+    return;
+  }
+  if (n && !aligned(dst)) {
+    if (*src != key) *dst = *src;
+    dst++; src++; n--;
+  }
+  Word* d = (Word*)dst;
+  const Word* s = (const Word*)src;
+  for (; n >= 2; n -= 2, d++, s++) {
+    uint32_t v = *s;
+    bool lo = (uint16_t)v != key, hi = (uint16_t)(v >> 16) != key;
+    if (lo && hi) {
+      *d = v; //the usual case in a sprite, one store
+    } else if (lo) {
+      *(uint16_t*)d = (uint16_t)v;
+    } else if (hi) {
+      ((uint16_t*)d)[1] = (uint16_t)(v >> 16);
+    }
+  }
+  if (n && *(const uint16_t*)s != key) *(uint16_t*)d = *(const uint16_t*)s;
+}
+
+inline void swap16(uint16_t* dst, const uint16_t* src, size_t n) {
+  if (aligned(dst) != aligned(src)) {
+    scalar::swap16(dst, src, n);
+    return;
+  }
+  if (n && !aligned(dst)) {
+    *dst++ = (uint16_t)((*src >> 8) | (*src << 8));
+    src++;
+    n--;
+  }
+  Word* d = (Word*)dst;
+  const Word* s = (const Word*)src;
+  for (; n >= 2; n -= 2) {
+    uint32_t v = *s++;
+    *d++ = ((v & 0x00FF00FF) << 8) | ((v >> 8) & 0x00FF00FF); //both halves at once, as REV16
+  }
+  if (n) {
+    uint16_t v = *(const uint16_t*)s;
+    *(uint16_t*)d = (uint16_t)((v >> 8) | (v << 8));
+  }
+}
+
+} // namespace packed32
+
+#ifdef PIXEL_KERNELS_X86
+
+// ---- SSE2, 8 pixels at a time (every x86-64 has it) ----
+
+namespace sse2 {
+
+inline void fill16(uint16_t* dst, uint16_t color, size_t n) {
+  __m128i v = _mm_set1_epi16((short)color);
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    _mm_storeu_si128((__m128i*)(dst + i), v);
+    _mm_storeu_si128((__m128i*)(dst + i + 8), v);
+    _mm_storeu_si128((__m128i*)(dst + i + 16), v);
+    _mm_storeu_si128((__m128i*)(dst + i + 24), v);
+  }
+  for (; i + 8 <= n; i += 8) _mm_storeu_si128((__m128i*)(dst + i), v);
+  for (; i < n; i++) dst[i] = color;
+}
+
+inline void copy16(uint16_t* dst, const uint16_t* src, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(src + i + 8));
+    _mm_storeu_si128((__m128i*)(dst + i), a);
+    _mm_storeu_si128((__m128i*)(dst + i + 8), b);
+  }
+  for (; i + 8 <= n; i += 8) {
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_loadu_si128((const __m128i*)(src + i)));
+  }
+  for (; i < n; i++) dst[i] = src[i];
+}
+
+inline void blitKey16(uint16_t* dst, const uint16_t* src, size_t n, uint16_t key) {
+  __m128i k = _mm_set1_epi16((short)key);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+    __m128i keep = _mm_cmpeq_epi16(s, k); //where dst shows through
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_and_si128(keep, d), _mm_andnot_si128(keep, s)));
+  }
+  scalar::blitKey16(dst + i, src + i, n - i, key);
+}
+
+inline void swap16(uint16_t* dst, const uint16_t* src, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+  }
+  scalar::swap16(dst + i, src + i, n - i);
+}
+
+} // namespace sse2
+
+// ---- AVX2, 16 pixels at a time, used only if the CPU has it ----
+
+namespace avx2 {
+
+__attribute__((target("avx2"))) inline void fill16(uint16_t* dst, uint16_t color, size_t n) {
+  __m256i v = _mm256_set1_epi16((short)color);
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64) {
+    _mm256_storeu_si256((__m256i*)(dst + i), v);
+    _mm256_storeu_si256((__m256i*)(dst + i + 16), v);
+    _mm256_storeu_si256((__m256i*)(dst + i + 32), v);
+    _mm256_storeu_si256((__m256i*)(dst + i + 48), v);
+  }
+  for (; i + 16 <= n; i += 16) _mm256_storeu_si256((__m256i*)(dst + i), v);
+  for (; i < n; i++) dst[i] = color;
+}
+
+__attribute__((target("avx2"))) inline void copy16(uint16_t* dst, const uint16_t* src, size_t n) {
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(src + i + 16));
+    _mm256_storeu_si256((__m256i*)(dst + i), a);
+    _mm256_storeu_si256((__m256i*)(dst + i + 16), b);
+  }
+  for (; i + 16 <= n; i += 16) {
+    _mm256_storeu_si256((__m256i*)(dst + i), _mm256_loadu_si256((const __m256i*)(src + i)));
+  }
+  for (; i < n; i++) dst[i] = src[i];
+}
+
+__attribute__((target("avx2"))) inline void blitKey16(uint16_t* dst, const uint16_t* src, size_t n,
+                                                       uint16_t key) {
+  __m256i k = _mm256_set1_epi16((short)key);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+    __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+    __m256i keep = _mm256_cmpeq_epi16(s, k);
+    _mm256_storeu_si256((__m256i*)(dst + i), _mm256_blendv_epi8(s, d, keep));
+  }
+  scalar::blitKey16(dst + i, src + i, n - i, key);
+}
+
+__attribute__((target("avx2"))) inline void swap16(uint16_t* dst, const uint16_t* src, size_t n) {
+  const __m256i order = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                         1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+    _mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(v, order));
+  }
+  scalar::swap16(dst + i, src + i, n - i);
+}
+
+} // namespace avx2
+
+#endif // PIXEL_KERNELS_X86
+
+// ---- choosing one ----
+
+inline const Kernels& scalarKernels() {
+  static const Kernels k = {"scalar", scalar::fill16, scalar::copy16, scalar::blitKey16, scalar::swap16};
+  return k;
+}
+
+inline const Kernels& packed32Kernels() {
+  static const Kernels k = {"packed32", packed32::fill16, packed32::copy16, packed32::blitKey16, packed32::swap16};
+  return k;
+}
+
+#ifdef PIXEL_KERNELS_X86
+inline const Kernels& sse2Kernels() {
+  static const Kernels k = {"sse2", sse2::fill16, sse2::copy16, sse2::blitKey16, sse2::swap16};
+  return k;
+}
+
+inline const Kernels& avx2Kernels() {
+  static const Kernels k = {"avx2", avx2::fill16, avx2::copy16, avx2::blitKey16, avx2::swap16};
+  return k;
+}
+
+inline bool hasAvx2() {
+  return __builtin_cpu_supports("avx2");
+}
+#endif
+
+/**
+ * @brief Every implementation this CPU can run, slowest first, ending with nullptr.
+ */
+inline const Kernels* const* available() {
+#ifdef PIXEL_KERNELS_X86
+  static const Kernels* const withAvx2[] = {&scalarKernels(), &packed32Kernels(), &sse2Kernels(), &avx2Kernels(), nullptr};
+  static const Kernels* const withoutAvx2[] = {&scalarKernels(), &packed32Kernels(), &sse2Kernels(), nullptr};
+  return hasAvx2() ? withAvx2 : withoutAvx2;
+#else
+  static const Kernels* const all[] = {&scalarKernels(), &packed32Kernels(), nullptr};
+  return all;
+#endif
+}
+
+/**
+ * @brief The last of available(), looked up every time; see best().
+ */
+inline const Kernels& fastest() {
+  const Kernels* const* k = available();
+  while (k[1]) k++;
+  return **k;
+}
+
+/**
+ * @brief The fastest implementation for this CPU. Chosen once, thread safe
+ * (a function local static), as fills come from several threads at once.
+ */
+inline const Kernels& best() {
+  static const Kernels& chosen = fastest();
+  return chosen;
+}
+
+inline void fill16(uint16_t* dst, uint16_t color, size_t n) { best().fill16(dst, color, n); }
+inline void copy16(uint16_t* dst, const uint16_t* src, size_t n) { best().copy16(dst, src, n); }
+inline void blitKey16(uint16_t* dst, const uint16_t* src, size_t n, uint16_t key) { best().blitKey16(dst, src, n, key); }
+inline void swap16(uint16_t* dst, const uint16_t* src, size_t n) { best().swap16(dst, src, n); }
+
+} // namespace PixelKernels
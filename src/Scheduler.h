@@ -0,0 +1,182 @@
+/*
+  Scheduler.h
+
+  A small cooperative scheduler for loop(): each task runs every so many
+  microseconds, when its ready test says there is work (e.g. bytes waiting),
+  or when an interrupt wakes it. Tasks run to completion, in the order they
+  were added, so each should do a bounded slice of work and return.
+
+  When nothing is due, idle() sleeps (__wfi) until the next task is due or an
+  interrupt comes in: a byte on the UART, the touch controller's INT pin, or
+  the timer alarm it sets for the next period. So a byte or touch is handled
+  as soon as it arrives, and the core sleeps the rest of the time.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+#ifdef ARDUINO_ARCH_RP2040
+#include <hardware/sync.h>
+#include <pico/time.h>
+#endif
+
+#define SCHEDULER_TASKS 8     //most tasks
+#define SCHEDULER_MIN_SLEEP 50 //microseconds, don't sleep for less than this
+
+inline uint32_t schedulerClock() { return micros(); }
+
+class Scheduler {
+public:
+  typedef void (*Run)();
+  typedef bool (*Ready)();
+
+  struct Task {
+    const char* name;
+    Run run;
+    Ready ready;          //nullptr for none
+    uint32_t periodUs;    //0 for none
+    uint32_t next;        //when it is next due
+    std::atomic<bool> woken;
+    uint32_t runs;
+    uint32_t busyUs;      //time spent running it
+  };
+
+  uint32_t sleeps;        //times idle() slept
+  uint32_t idleUs;        //time spent in idle()
+
+  /**
+   * @param clock microseconds, wrapping (micros, or a fake one for tests)
+   */
+  explicit Scheduler(uint32_t (*clock)() = schedulerClock)
+    : sleeps(0), idleUs(0), m_clock(clock), m_count(0) {}
+
+  /**
+   * @brief Adds a task. It runs every periodUs (if not 0), whenever ready
+   * returns true (if given), and when woken.
+   * @return its number, for wake(), or -1 if there are SCHEDULER_TASKS already
+   */
+  int add(const char* name, Run run, uint32_t periodUs, Ready ready = nullptr) {
+    if (m_count == SCHEDULER_TASKS) return -1;
+    Task& t = m_tasks[m_count];
+    t.name = name;
+    t.run = run;
+    t.ready = ready;
+    t.periodUs = periodUs;
+    t.next = m_clock() + periodUs;
+    t.woken.store(false);
+    t.runs = 0;
+    t.busyUs = 0;
+    return m_count++;
+  }
+
+  /**
+   * @brief Makes a task run on the next pass. Safe from an interrupt.
+   */
+  void wake(int task) {
+    if (task >= 0 && task < m_count) m_tasks[task].woken.store(true);
+  }
+
+  /**
+   * @brief One pass: runs every task that is due, ready or woken.
+   * @return true if any ran
+   */
+  bool runOnce() {
+    bool ran = false;
+    for (int i = 0; i < m_count; i++) {
+      Task& t = m_tasks[i];
+      uint32_t now = m_clock();
+      bool due = t.periodUs && (int32_t)(now - t.next) >= 0;
+      if (due) {
+        t.next += t.periodUs;
+        if ((int32_t)(now - t.next) >= 0) t.next = now + t.periodUs; //fell behind, don't catch up in a burst
+      }
+      bool woken = t.woken.load();
+      if (!due && !woken && !(t.ready && t.ready())) continue;
+      if (woken) t.woken.store(false); //before running, so a wake during the run isn't lost
+      t.run();
+      t.runs++;
+      t.busyUs += m_clock() - now;
+      ran = true;
+    }
+    return ran;
+  }
+
+  /**
+   * @brief Microseconds until the next periodic task is due, 0 if one is,
+   * or 0xFFFFFFFF if there are none.
+   */
+  uint32_t untilDue() const {
+    uint32_t now = m_clock(), until = 0xFFFFFFFF;
+    for (int i = 0; i < m_count; i++) {
+      const Task& t = m_tasks[i];
+      if (!t.periodUs) continue;
+      int32_t left = (int32_t)(t.next - now);
+      if (left <= 0) return 0;
+      if ((uint32_t)left < until) until = left;
+    }
+    return until;
+  }
+
+  /**
+   * @return true if a task was woken or is ready
+   */
+  bool pending() const {
+    for (int i = 0; i < m_count; i++) {
+      const Task& t = m_tasks[i];
+      if (t.woken.load() || (t.ready && t.ready())) return true;
+    }
+    return false;
+  }
+
+  /**
+   * @return true if a task was woken. Only reads flags, so it is safe with
+   * interrupts off (ready tests may do I/O: USB, TCP, the chain's UARTs).
+   */
+  bool woken() const {
+    for (int i = 0; i < m_count; i++) {
+      if (m_tasks[i].woken.load()) return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief Sleeps until the next task is due or an interrupt comes in.
+   * Doesn't sleep if a task is ready. On the PC it only counts.
+   */
+  void idle() {
+    uint32_t us = untilDue();
+    if (us < SCHEDULER_MIN_SLEEP) return;
+    if (pending()) return; //the ready tests, with interrupts on
+    uint32_t start = m_clock();
+#ifdef ARDUINO_ARCH_RP2040
+    alarm_id_t alarm = add_alarm_in_us(us, [](alarm_id_t, void*) -> int64_t { return 0; }, nullptr, false);
+    if (alarm <= 0) return; //no alarm free, or already due
+    uint32_t irq = save_and_disable_interrupts();
+    // A wake (e.g. TOUCH_INT) since the check is seen here, and any interrupt
+    // from now on still ends the sleep. A byte whose interrupt was taken
+    // between pending() and here waits at most until the next task is due.
+    if (!woken()) __wfi();
+    restore_interrupts(irq);
+    cancel_alarm(alarm);
+#endif
+    sleeps++;
+    idleUs += m_clock() - start;
+  }
+
+  /**
+   * @brief What loop() calls: a pass, or a sleep if there was nothing to do.
+   */
+  void loop() {
+    if (!runOnce()) idle();
+  }
+
+  int count() const { return m_count; }
+  const Task& task(int i) const { return m_tasks[i]; }
+
+private:
+  uint32_t (*m_clock)();
+  Task m_tasks[SCHEDULER_TASKS];
+  int m_count;
+};
@@ -0,0 +1,143 @@
+/*
+  SelfBench.h
+
+  The 'J' command: times a fixed reference scene on the device itself, so
+  panels and SPI clocks can be compared from the field without a host tool.
+  Prints one line:
+
+    J:<version> n:<shapes> ins:<us> draw:<us> px:<pixels> spi:<bytes> hit:<ns> parse:<bytes/s>
+
+  - ins:   adding the scene to a TouchManager, without drawing
+  - draw:  drawAll of it to the display (px and spi from the counters, if
+           the display counts them)
+  - hit:   one findGroupIDAt, the mean of a grid over the screen
+  - parse: taking in SELFBENCH_STREAM, not drawing
+
+  Change SELFBENCH_VERSION with the scene or stream, so results are only
+  compared with their own kind. The display is cleared and the current
+  scene redrawn afterwards; the performance counters are left as they were.
+*/
+
+#pragma once
+
+#include "CommandParser.h"
+#include "NullPrint.h"
+
+#define SELFBENCH_VERSION 1
+#define SELFBENCH_RUNS 3 //best of, for the CPU only parts
+
+// A sample of what hosts send: shapes, labels and graph columns
+static const char SELFBENCH_STREAM[] =
+  "1i 10x 10y 60w 40h #f800C R 2i 80x 10y 60w 40h #07e0C R 3i 150x 10y 60w 40h #001fC R "
+  "4i 40x 90y 30d #ffe0C O 5i 110x 90y 30d #f81fC O 6i 180x 90y 30d #07ffC O "
+  "7i 220x 20y P 300x 20y P 300x 70y P 260x 90y P 220x 70y P #fd20C S "
+  "0i 10x 60y #ffffC 0h \"Temperature 21.5C\" T 0i 10x 130y 1h \"Pressure\" T "
+  "8i 10x 150y 300w 80h #07e0C 10a "
+  "100,200G 110,190G 120,180G 130,170G 140,160G 150,150G 160,140G 170,130G "
+  "180,120G 190,110G 200,100G 190,110G 180,120G 170,130G 160,140G 150,150G "
+  "9i 250x 100y 40w 20h #7befC R 10i 250x 125y 40w 20h #7befC R ";
+
+/**
+ * @brief Adds the reference scene: a grid of 40 rects, 20 circles, 8
+ * polygons, 8 labels and two graphs of 150 columns.
+ */
+inline void buildReferenceScene(TouchManager& tm) {
+  for (int i = 0; i < 40; i++) {
+    tm.addRect(4 + (i % 8) * 39, 4 + (i / 8) * 24, 34, 20, 0x1082 * (1 + i % 15), true, 1 + i);
+  }
+  for (int i = 0; i < 20; i++) {
+    tm.addCircle(20 + (i % 10) * 30, 60 + (i / 10) * 30, 24, 0xF800 | (i * 0x0841), true, 41 + i % 5);
+  }
+  for (int i = 0; i < 8; i++) {
+    int x = 10 + i * 38;
+    std::vector<GFXPoint> pts = {
+      {(int16_t)x, 130}, {(int16_t)(x + 30), 125}, {(int16_t)(x + 34), 150}, {(int16_t)(x + 12), 160}
+    };
+    tm.addPolygon(pts, C565_ORANGE, true, 50 + i);
+  }
+  for (int i = 0; i < 8; i++) {
+    tm.addText(4 + (i % 4) * 80, 165 + (i / 4) * 12, "Label 42", 0, C565_WHITE, 1, 1, 60 + i);
+  }
+  for (int g = 0; g < 2; g++) {
+    tm.beginGraph(10 + g * 155, 190, 150, 46, g ? C565_YELLOW : C565_GREEN, true, 70 + g, g ? 10 : 0);
+    for (int i = 0; i < 150; i++) {
+      int16_t column[2] = {(int16_t)(i % 40), (int16_t)((i * 7) % 45)};
+      tm.appendGraph(70 + g, column, 2);
+    }
+  }
+}
+
+/**
+ * @brief Runs the benchmark and prints the result line.
+ * @param manager the live scene, redrawn at the end
+ * @param gfx the display, may be nullptr (then draw is not timed)
+ */
+inline void selfBench(TouchManager& manager, Adafruit_GFX* gfx, Print& out) {
+  NullPrint quiet;
+  PerfCounters saved = manager.perf; //the display counts into these
+
+  uint32_t insertUs = UINT32_MAX;
+  int shapes = 0;
+  for (int r = 0; r < SELFBENCH_RUNS; r++) {
+    TouchManager tm;
+    uint32_t t0 = micros();
+    buildReferenceScene(tm);
+    uint32_t us = micros() - t0;
+    if (us < insertUs) insertUs = us;
+    shapes = tm.shapes().size();
+  }
+
+  TouchManager tm;
+  buildReferenceScene(tm);
+  uint32_t drawUs = 0, pixels = 0, spi = 0;
+  if (gfx) {
+    gfx->fillScreen(C565_BLACK);
+    manager.perf.reset();
+    uint32_t t0 = micros();
+    tm.drawAll(gfx);
+    drawUs = micros() - t0;
+    pixels = manager.perf.pixels();
+    spi = manager.perf.spiBytes();
+  }
+
+  const int probes = (320 / 8) * (240 / 8);
+  uint32_t hitUs = UINT32_MAX;
+  volatile int sink = 0;
+  for (int r = 0; r < SELFBENCH_RUNS; r++) {
+    uint32_t t0 = micros();
+    for (int y = 4; y < 240; y += 8) {
+      for (int x = 4; x < 320; x += 8) {
+        sink += tm.findGroupIDAt(x, y);
+      }
+    }
+    uint32_t us = micros() - t0;
+    if (us < hitUs) hitUs = us;
+  }
+
+  uint32_t parseUs = UINT32_MAX;
+  const uint32_t bytes = sizeof(SELFBENCH_STREAM) - 1;
+  for (int r = 0; r < SELFBENCH_RUNS; r++) {
+    TouchManager scratch; //no display, so only the parsing and adding
+    CommandParser parser(scratch, nullptr, quiet);
+    parser.record = false;
+    uint32_t t0 = micros();
+    for (uint32_t i = 0; i < bytes; i++) parser.feed(SELFBENCH_STREAM[i]);
+    uint32_t us = micros() - t0;
+    if (us < parseUs) parseUs = us;
+  }
+
+  if (gfx) { //put back what was on screen
+    gfx->fillScreen(C565_BLACK);
+    manager.drawAll(gfx);
+  }
+  manager.perf = saved;
+
+  out.print("J:"); out.print(SELFBENCH_VERSION);
+  out.print(" n:"); out.print(shapes);
+  out.print(" ins:"); out.print(insertUs);
+  out.print(" draw:"); out.print(drawUs);
+  out.print(" px:"); out.print(pixels);
+  out.print(" spi:"); out.print(spi);
+  out.print(" hit:"); out.print((uint32_t)((uint64_t)hitUs * 1000 / probes));
+  out.print(" parse:"); out.println((uint32_t)((uint64_t)bytes * 1000000 / (parseUs ? parseUs : 1)));
+}
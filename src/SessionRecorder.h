@@ -0,0 +1,119 @@
+/*
+  SessionRecorder.h
+
+  Records what came in (received bytes and touches, with their times) into
+  a RAM ring, so a slow or broken session can be replayed exactly on a PC
+  with host/replay.cpp. Build with -D MERGIF_RECORD to record, otherwise
+  RECORD_RX and RECORD_TOUCH compile to nothing and `4?` only says so.
+
+  `4?` dumps the ring in binary (and empties it). tools/record.py can also
+  make the same format on the host side, from what it sends.
+
+  Capture format, all little endian:
+    "MREC", uint8 version (1), uint32 length, then length bytes of records:
+    uint32 micros(), uint8 type, uint8 n, n bytes of data
+  Types: 'R' received bytes (those arriving within RECORD_JOIN_US of the first
+  share its record), 't' a touch at int16 x, int16 y (screen coordinates).
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#ifndef RECORD_BYTES
+#define RECORD_BYTES 16384
+#endif
+
+#ifndef RECORD_JOIN_US
+#define RECORD_JOIN_US 500
+#endif
+
+#define RECORD_HEADER 6 // time, type, n
+
+struct SessionRecorder {
+  uint8_t ring[RECORD_BYTES];
+  uint32_t head;     // where the oldest record starts, counting every byte ever written
+  uint32_t tail;     // where the next record goes
+  uint32_t open;     // the 'R' record still taking bytes, if joining
+  bool joining;
+  uint32_t dropped;  // records overwritten since clear()
+
+  void clear() {
+    head = tail = open = dropped = 0;
+    joining = false;
+  }
+
+  void rx(uint8_t b) {
+    uint32_t now = micros();
+    if (joining && at(open + 5) < 255 && now - time(open) < RECORD_JOIN_US) {
+      reserve(1);
+      if (joining) { //still there
+        at(tail++) = b;
+        at(open + 5)++;
+        return;
+      }
+    }
+    begin('R', 1, now);
+    at(tail++) = b;
+    open = tail - RECORD_HEADER - 1;
+    joining = true;
+  }
+
+  void touch(int16_t x, int16_t y) {
+    begin('t', 4, micros());
+    at(tail++) = x;
+    at(tail++) = x >> 8;
+    at(tail++) = y;
+    at(tail++) = y >> 8;
+    joining = false;
+  }
+
+  /**
+   * @brief Writes the capture, oldest record first (see above).
+   */
+  void dump(Print& out) {
+    uint32_t n = tail - head;
+    uint8_t b[9] = {'M', 'R', 'E', 'C', 1,
+                    (uint8_t)n, (uint8_t)(n >> 8), (uint8_t)(n >> 16), (uint8_t)(n >> 24)};
+    out.write(b, sizeof(b));
+    for (uint32_t i = head; i < tail; i++) {
+      out.write(at(i));
+    }
+  }
+
+private:
+  uint8_t& at(uint32_t i) { return ring[i % RECORD_BYTES]; }
+
+  uint32_t time(uint32_t r) {
+    return at(r) | (at(r + 1) << 8) | (at(r + 2) << 16) | ((uint32_t)at(r + 3) << 24);
+  }
+
+  // Drops the oldest records until n more bytes fit
+  void reserve(uint32_t n) {
+    while (tail + n - head > RECORD_BYTES) {
+      if (joining && head == open) joining = false;
+      head += RECORD_HEADER + at(head + 5);
+      dropped++;
+    }
+  }
+
+  void begin(uint8_t type, uint8_t n, uint32_t now) {
+    reserve(RECORD_HEADER + n);
+    for (int k = 0; k < 4; k++) at(tail++) = now >> (8 * k);
+    at(tail++) = type;
+    at(tail++) = n;
+  }
+};
+
+inline SessionRecorder& sessionRecorder() {
+  static SessionRecorder recorder;
+  return recorder;
+}
+
+#ifdef MERGIF_RECORD
+#define RECORD_RX(b) sessionRecorder().rx(b)
+#define RECORD_TOUCH(x, y) sessionRecorder().touch(x, y)
+#else
+#define RECORD_RX(b) do {} while (0)
+#define RECORD_TOUCH(x, y) do {} while (0)
+#endif
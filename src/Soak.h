@@ -0,0 +1,180 @@
+/*
+  Soak.h
+
+  A long running test for slow degradation: heap fragmentation from the
+  shapes, strings and graph buffers coming and going, and command latency
+  creeping up. It feeds the parser random commands (shapes added to new and
+  existing groups, labels of random lengths, graph columns, and a clear when
+  the scene gets big), and every SOAK_WINDOW commands prints a line like
+
+    #soak ops=120000 shapes=214 free=81234 largest=60112 chunks=12 live=45678 allocs=3456 p50=40 p99=310 max=100200
+
+  - free, largest: free heap, and the biggest block that could be allocated
+  - chunks: free blocks the heap is split into
+  - live: bytes in use
+  - allocs: allocations in the window, where the heap can count them
+  - p50, p99, max: microseconds per command in the window
+
+  On the device, define soak in main.cpp. On the PC, host/soak.cpp runs it
+  against a model of a small heap, so it can count allocations.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include <algorithm>
+#include "CommandParser.h"
+#include "NullPrint.h"
+
+#ifdef ARDUINO_ARCH_RP2040
+#include <malloc.h>
+#endif
+
+#define SOAK_WINDOW 1000     //commands per report line
+#define SOAK_MAX_SHAPES 300  //cleared ('Z') when the scene gets this big
+#define SOAK_GRAPHS 4
+
+/**
+ * @brief A snapshot of the heap. Zero for what a platform can't tell.
+ */
+struct HeapStats {
+  uint32_t freeBytes;
+  uint32_t largestFree;
+  uint32_t freeChunks;
+  uint32_t liveBytes;
+  uint32_t allocs; //allocations so far
+};
+
+/**
+ * @brief The heap as the RP2040's newlib sees it. The largest block is
+ * found by trying malloc, halving the size.
+ */
+inline HeapStats deviceHeapStats() {
+  HeapStats h = {};
+#ifdef ARDUINO_ARCH_RP2040
+  struct mallinfo mi = mallinfo();
+  h.freeBytes = rp2040.getFreeHeap();
+  h.freeChunks = mi.ordblks;
+  h.liveBytes = mi.uordblks;
+  uint32_t lo = 0, hi = h.freeBytes;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo + 1) / 2;
+    void* p = malloc(mid);
+    if (p) {
+      free(p);
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  h.largestFree = lo;
+#endif
+  return h;
+}
+
+class SoakTest {
+public:
+  /**
+   * @param manager the shapes, usually the live one
+   * @param gfx the display, may be nullptr
+   * @param report where the #soak lines go
+   * @param heapStats gives the heap stats for each line
+   */
+  SoakTest(TouchManager& manager, Adafruit_GFX* gfx, Print& report,
+           HeapStats (*heapStats)() = deviceHeapStats, uint32_t seed = 1)
+    : heap(), p50(0), p99(0), maxUs(0), m_manager(manager), m_report(report), m_heap(heapStats),
+      m_parser(manager, gfx, m_quiet), m_rng(seed ? seed : 1), m_ops(0), m_count(0),
+      m_lastAllocs(heapStats().allocs) {
+    m_parser.record = false;
+  }
+
+  uint32_t ops() const { return m_ops; }
+
+  // The last report, for host tools
+  HeapStats heap;
+  uint32_t p50, p99, maxUs;
+
+  /**
+   * @brief Runs one random command, and reports at the end of each window.
+   * @return true if a report was made
+   */
+  bool step() {
+    makeCommand();
+    uint32_t t0 = micros();
+    for (const char* p = m_cmd; *p; p++) m_parser.feed(*p);
+    m_latency[m_count++] = micros() - t0;
+    m_ops++;
+    if (m_count < SOAK_WINDOW) return false;
+    report();
+    return true;
+  }
+
+private:
+  TouchManager& m_manager;
+  Print& m_report;
+  HeapStats (*m_heap)();
+  NullPrint m_quiet;
+  CommandParser m_parser;
+  uint32_t m_rng;
+  uint32_t m_ops;
+  uint32_t m_count;
+  uint32_t m_lastAllocs;
+  uint32_t m_latency[SOAK_WINDOW];
+  char m_cmd[256]; //built here, so the test itself doesn't allocate
+
+  uint32_t rnd(uint32_t n) { //xorshift32
+    m_rng ^= m_rng << 13;
+    m_rng ^= m_rng >> 17;
+    m_rng ^= m_rng << 5;
+    return m_rng % n;
+  }
+
+  void makeCommand() {
+    char* p = m_cmd;
+    char* end = m_cmd + sizeof(m_cmd);
+#define SOAK_PUT(...) p += snprintf(p, end - p, __VA_ARGS__)
+    uint32_t pick = rnd(1000);
+    if (m_manager.shapes().size() >= SOAK_MAX_SHAPES || pick == 0) {
+      SOAK_PUT("Z ");
+    } else if (pick < 400) {
+      SOAK_PUT("%ui %ux %uy %uw %uh #%xC R ", 1 + rnd(60), rnd(320), rnd(240), 1 + rnd(80), 1 + rnd(60),
+               (unsigned)rnd(0x10000));
+    } else if (pick < 550) {
+      SOAK_PUT("%ui %ux %uy %ud #%xC O ", 1 + rnd(60), rnd(320), rnd(240), 2 + rnd(60), (unsigned)rnd(0x10000));
+    } else if (pick < 650) {
+      SOAK_PUT("%ui ", 1 + rnd(60));
+      for (uint32_t k = 3 + rnd(6); k; k--) SOAK_PUT("%ux %uy P ", rnd(320), rnd(240));
+      SOAK_PUT("#%xC S ", (unsigned)rnd(0x10000));
+    } else if (pick < 750) {
+      SOAK_PUT("%ui %ux %uy #%xC %uh \"", 1 + rnd(60), rnd(300), rnd(230), (unsigned)rnd(0x10000), rnd(2));
+      for (uint32_t k = 1 + rnd(30); k && end - p > 8; k--) *p++ = 'A' + rnd(26);
+      SOAK_PUT("\" T ");
+    } else { //a column for one of the graphs, each its own size and series count
+      uint32_t g = rnd(SOAK_GRAPHS);
+      SOAK_PUT("%ui 10x %uy %uw 50h #7e0C 10a ", 200 + g, 10 + g * 55, 50 + rnd(250));
+      for (uint32_t k = 0; k <= g; k++) SOAK_PUT("%u%c", rnd(1000), k < g ? ',' : 'G');
+      SOAK_PUT(" ");
+    }
+#undef SOAK_PUT
+  }
+
+  void report() {
+    std::sort(m_latency, m_latency + m_count);
+    p50 = m_latency[(m_count - 1) / 2];
+    p99 = m_latency[(m_count * 99 + 99) / 100 - 1]; //nearest rank
+    maxUs = m_latency[m_count - 1];
+    heap = m_heap();
+    m_report.print("#soak ops="); m_report.print(m_ops);
+    m_report.print(" shapes="); m_report.print((uint32_t)m_manager.shapes().size());
+    m_report.print(" free="); m_report.print(heap.freeBytes);
+    m_report.print(" largest="); m_report.print(heap.largestFree);
+    m_report.print(" chunks="); m_report.print(heap.freeChunks);
+    m_report.print(" live="); m_report.print(heap.liveBytes);
+    m_report.print(" allocs="); m_report.print(heap.allocs - m_lastAllocs);
+    m_report.print(" p50="); m_report.print(p50);
+    m_report.print(" p99="); m_report.print(p99);
+    m_report.print(" max="); m_report.println(maxUs);
+    m_lastAllocs = heap.allocs;
+    m_count = 0;
+  }
+};
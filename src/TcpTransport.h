@@ -0,0 +1,146 @@
+/*
+  TcpTransport.h
+
+  A link to a host over TCP (see Transport.h): on the Pico W, a WiFiServer
+  and WiFiClient; on the PC, the POSIX sockets in host/SocketTcp.h, so the
+  same code runs over loopback (see host/link.cpp -t).
+
+  Nothing here blocks loop(). service() takes in a connection, moves what
+  has arrived into a receive buffer and what was written out to the socket,
+  only as much as each side has room for. When the parser falls behind the
+  receive buffer fills, bytes stay in the socket, and TCP's window slows the
+  host down: nothing is lost, unlike a UART. One host at a time; the next
+  waits to be accepted until that one closes and all it sent has been read,
+  and the parser is reset for it (onNewHost, see HostLinks.h).
+
+  Replies wait for room, as on a UART, but only so long: a host that hasn't
+  read for TCP_TX_WAIT_US loses what doesn't fit (write returns what was
+  taken, txDropped counts the rest), and later writes don't wait again until
+  the send buffer moves, so a host that never reads can't stall the parser.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include "Transport.h"
+#include "ByteRing.h"
+
+#define TCP_PORT 2323         //where hosts connect
+#define TCP_RX_BUFFER 2048    //bytes received but not parsed yet
+#define TCP_TX_BUFFER 2048    //replies and touches not sent yet
+#define TCP_TX_WAIT_US 100000 //longest a write waits for the host to read
+
+/**
+ * @tparam Server has begin() and accept() returning a Client (WiFiServer)
+ * @tparam Client tests true when open, has connected(), available(),
+ * read(buf, n), availableForWrite(), write(buf, n), stop() (WiFiClient)
+ */
+template <typename Server, typename Client>
+class TcpTransport : public Transport {
+public:
+  uint32_t connections;  //hosts taken in
+  uint32_t txDropped;    //bytes written with the send buffer full for too long, not sent
+  uint32_t bytesIn, bytesOut;
+
+  explicit TcpTransport(Server& server)
+    : connections(0), txDropped(0), bytesIn(0), bytesOut(0), m_server(server), m_open(false),
+      m_stalled(false) {}
+
+  void begin() { m_server.begin(); }
+
+  const char* name() const override { return "TCP"; }
+
+  /**
+   * @brief Takes in a host if there is none, and moves bytes both ways as
+   * far as there is room. Never waits.
+   */
+  void service() {
+    if (m_open && !m_client.connected()) { //the host went away; what it sent can still be read
+      m_client.stop();
+      m_open = false;
+      m_tx.clear();
+    }
+    if (!m_open) {
+      if (m_rx.size()) return; //the last host's bytes first, so sessions don't mix
+      Client c = m_server.accept();
+      if (!c) return;
+      m_client = c;
+      m_open = true;
+      m_stalled = false;
+      connections++;
+      newHost();
+    }
+    size_t n;
+    while (m_client.available() > 0) {
+      uint8_t* in = m_rx.back(n);
+      if (!n) break; //full: leave it in the socket, TCP holds the host back
+      int got = m_client.read(in, n);
+      if (got <= 0) break;
+      m_rx.commit(got);
+    }
+    while (m_tx.size()) {
+      const uint8_t* out = m_tx.front(n);
+      int room = m_client.availableForWrite();
+      if (room <= 0) break;
+      if ((size_t)room < n) n = room;
+      size_t sent = m_client.write(out, n);
+      m_tx.drop(sent);
+      if (sent) m_stalled = false;
+      if (sent < n) break;
+    }
+  }
+
+  int available() override {
+    if (!m_rx.size()) service(); //not on every byte
+    return m_rx.size();
+  }
+
+  int read() override {
+    int b = m_rx.read();
+    if (b >= 0) bytesIn++;
+    return b;
+  }
+
+  int peek() override { return m_rx.peek(); }
+
+  size_t write(uint8_t b) override { return write(&b, 1); }
+
+  /**
+   * @return the bytes taken, fewer if the host stopped reading
+   */
+  size_t write(const uint8_t* buffer, size_t size) override {
+    if (!m_open) return 0; //nobody to send to
+    size_t n = m_tx.write(buffer, size);
+    if (n < size) {
+      uint32_t start = micros();
+      do {
+        service(); //make room
+        if (!m_open) break; //gone, and its replies with it
+        n += m_tx.write(buffer + n, size - n);
+      } while (n < size && !m_stalled && micros() - start < TCP_TX_WAIT_US);
+      if (n < size) m_stalled = true;
+    }
+    txDropped += size - n;
+    bytesOut += n;
+    return n;
+  }
+
+  void flush() override { service(); }
+
+  bool connected() override { return m_open; }
+
+  /**
+   * @return true if a host was connected and has gone, and all it sent has been read
+   */
+  bool closed() const { return connections && !m_open && !m_rx.size(); }
+
+  using Print::write;
+
+private:
+  Server& m_server;
+  Client m_client;
+  bool m_open;
+  bool m_stalled; //a write timed out, and nothing has gone out since
+  ByteRing<TCP_RX_BUFFER> m_rx;
+  ByteRing<TCP_TX_BUFFER> m_tx;
+};
@@ -0,0 +1,27 @@
+/*
+  ThisCore.h
+
+  Which core the caller is running on, for the counters and trace rings that
+  each core keeps to itself (see PerfCounters.h and Trace.h), so the two
+  never write the same memory. On the PC a thread stands in for core 1
+  (RenderLoop::run) and says so with setThisCore(1).
+*/
+
+#pragma once
+
+#define MERGIF_CORES 2
+
+#ifdef ARDUINO_ARCH_RP2040
+#include <pico/platform.h>
+
+inline int thisCore() { return get_core_num(); }
+inline void setThisCore(int) {}
+#else
+inline int& hostCore() {
+  static thread_local int core = 0;
+  return core;
+}
+
+inline int thisCore() { return hostCore(); }
+inline void setThisCore(int core) { hostCore() = core; }
+#endif
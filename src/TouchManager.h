@@ -8,11 +8,21 @@
 #pragma once
 
 #include <vector>     // For dynamic arrays
+#include <unordered_map> // For the graph registry
 #include <memory>     // For std::shared_ptr
+#include <atomic>     // For the text bounds flag
 #include <algorithm>  // For std::find_if
-#include <string>     // For std::string
+#include <string>     // For std::basic_string
 #include <cmath> 
+#include <cstdio>     // For snprintf
+#include <cstring>
 #include <Adafruit_GFX.h> //THE graphics library!
+#include "PerfCounters.h"
+#include "Trace.h"
+#include "BlockPool.h"
+#include "HitIndex.h"
+
+#define GRAPH_BUCKETS 32 // graphs a TouchManager holds before its registry grows
 
 // --- Standard GFX colors (for convenience) ---
 #define C565_BLACK        0x0000 ///<   0,   0,   0
@@ -53,40 +63,281 @@ struct TouchGroup {
   explicit TouchGroup(int groupID) : id(groupID) {}
 };
 
+/**
+ * @brief Fixed capacity deque of sample numbers. 
+ * Used as a monotonic queue to track the min or max of a sliding window.
+ */
+struct SampleDeque {
+  std::vector<uint32_t, PoolAllocator<uint32_t>> slots;
+  size_t head;
+  size_t count;
+
+  explicit SampleDeque(size_t capacity, BlockPool* pool = nullptr)
+    : slots(capacity, 0, PoolAllocator<uint32_t>(pool)), head(0), count(0) {}
+
+  bool empty() const { return count == 0; }
+  uint32_t front() const { return slots[head]; }
+  uint32_t back() const { return slots[(head + count - 1) % slots.size()]; }
+  void popFront() { head = (head + 1) % slots.size(); --count; }
+  void popBack() { --count; }
+  void pushBack(uint32_t v) { slots[(head + count++) % slots.size()] = v; }
+  void clear() { head = 0; count = 0; }
+};
+
+/**
+ * @brief One series (trace) of a graph. 
+ * A ring buffer of the last `capacity` samples, with the window min/max kept
+ * in O(1) amortized time per sample by a pair of monotonic deques.
+ */
+struct GraphSeries {
+  std::vector<int16_t, PoolAllocator<int16_t>> samples; // ring buffer, sample number n lives at n % capacity
+  uint32_t total;               // samples pushed since the last clear
+  SampleDeque minQ, maxQ;       // sample numbers with increasing / decreasing values
+  int32_t sum;                  // of the samples in the window, for the mean
+  int32_t lo, hi;               // displayed range when autoscaling
+
+  // Style, 0 uses the graph's setting
+  uint16_t color;
+  uint8_t mode;                 // a SeriesMode
+  uint8_t overlays;             // SeriesOverlay bits
+  char shown[32];               // overlay label as last drawn, to skip redraws
+
+  explicit GraphSeries(size_t capacity, BlockPool* pool = nullptr)
+    : samples(capacity, 0, PoolAllocator<int16_t>(pool)), total(0),
+      minQ(capacity, pool), maxQ(capacity, pool), sum(0), lo(0), hi(0),
+      color(0), mode(0), overlays(0) {
+    shown[0] = 0;
+  }
+
+  size_t capacity() const { return samples.size(); }
+  size_t size() const { return total < capacity() ? total : capacity(); }
+
+  // i = 0 is the oldest sample still in the window
+  int16_t at(size_t i) const { return samples[(total - size() + i) % capacity()]; }
+  int16_t last() const { return samples[(total - 1) % capacity()]; }
+  int16_t minimum() const { return samples[minQ.front() % capacity()]; }
+  int16_t maximum() const { return samples[maxQ.front() % capacity()]; }
+  int16_t mean() const { return size() ? sum / (int32_t)size() : 0; }
+
+  void push(int16_t v) {
+    uint32_t idx = total++;
+    if (idx >= capacity()) sum -= samples[idx % capacity()]; //sliding out
+    sum += v;
+    samples[idx % capacity()] = v;
+    // drop sample numbers that just slid out of the window
+    uint32_t oldest = total - size();
+    if (!minQ.empty() && minQ.front() < oldest) minQ.popFront();
+    if (!maxQ.empty() && maxQ.front() < oldest) maxQ.popFront();
+    // and any that can never again be the min / max
+    while (!minQ.empty() && samples[minQ.back() % capacity()] >= v) minQ.popBack();
+    while (!maxQ.empty() && samples[maxQ.back() % capacity()] <= v) maxQ.popBack();
+    minQ.pushBack(idx);
+    maxQ.pushBack(idx);
+  }
+
+  /**
+   * @brief Updates the displayed range from the window min/max.
+   * The range only moves when the data leaves it, or when the data has shrunk
+   * to well inside it, so the plot doesn't jitter with every sample.
+   * @param margin hysteresis in percent of the data span.
+   * @return true if the range changed.
+   */
+  bool rescale(uint8_t margin) {
+    if (!total) return false;
+    int32_t mn = minimum(), mx = maximum();
+    int32_t span = (mx - mn) > 0 ? (mx - mn) : 1;
+    int32_t pad = span * margin / 100;
+    if (mn >= lo && mx <= hi && (hi - lo) <= span + 4 * pad) return false;
+    lo = mn - pad;
+    hi = mx + pad;
+    return true;
+  }
+
+  void clear() {
+    total = 0;
+    sum = 0;
+    minQ.clear();
+    maxQ.clear();
+    lo = hi = 0;
+  }
+};
+
+/**
+ * @brief How a series is plotted.
+ */
+enum SeriesMode : uint8_t {
+  SERIES_DEFAULT = 0, // lines if the graph is filled, else pixels
+  SERIES_PIXELS = 1,
+  SERIES_LINES = 2
+};
+
+/**
+ * @brief Overlay labels for a series, drawn at the top of its band.
+ */
+enum SeriesOverlay : uint8_t {
+  OVERLAY_MIN = 1,
+  OVERLAY_MAX = 2,
+  OVERLAY_MEAN = 4,
+  OVERLAY_LAST = 8
+};
+
+/**
+ * @brief Oscilloscope style trigger edges.
+ */
+enum TriggerEdge : uint8_t {
+  TRIGGER_OFF = 0,     // free running, every sample is plotted
+  TRIGGER_RISING = 1,
+  TRIGGER_FALLING = 2,
+  TRIGGER_EITHER = 3
+};
+
+// Series a graph can be styled with 'U' or sent in a 'V' column
+#define GRAPH_MAX_SERIES 16
+
+/**
+ * @brief The data for a graph: one GraphSeries per value in each 'G' column.
+ */
 struct TouchGraphs {
   int id;
-  std::vector<std::vector<GFXPoint>> graph;
-  explicit TouchGraphs(int groupID, std::vector<GFXPoint> series) : id(groupID) {
-    graph.push_back(series);
+  size_t width;      // samples kept per series, one per pixel column
+  uint8_t autoscale; // hysteresis margin in percent, 0 plots raw values
+  BlockPool* pool;   // for the sample buffers, nullptr for the heap
+  std::vector<GraphSeries, PoolAllocator<GraphSeries>> series;
+
+  // Trigger, evaluated on the first series. While armed, samples go into the
+  // pre-trigger buffers; on a trigger those start the captured window, which
+  // is drawn once full. Then samples are ignored for the holdoff, and it re-arms.
+  enum TriggerState : uint8_t { ARMED, CAPTURING, HOLDOFF };
+  uint8_t trigEdge;
+  int16_t trigLevel;
+  uint16_t trigHoldoff;    // samples ignored after a capture
+  uint16_t trigPre;        // samples kept from before the trigger
+  TriggerState trigState;
+  uint32_t trigCount;      // samples held off so far
+  bool trigHavePrev;
+  int16_t trigPrev;        // last sample of the first series, for edge detection
+  std::vector<GraphSeries, PoolAllocator<GraphSeries>> pre;
+
+  TouchGraphs(int groupID, size_t w, uint8_t margin, BlockPool* blocks = nullptr)
+    : id(groupID), width(w), autoscale(margin), pool(blocks),
+      series(PoolAllocator<GraphSeries>(blocks)),
+      trigEdge(TRIGGER_OFF), trigLevel(0), trigHoldoff(0), trigPre(0),
+      trigState(ARMED), trigCount(0), trigHavePrev(false), trigPrev(0),
+      pre(PoolAllocator<GraphSeries>(blocks)) {}
+
+  /**
+   * @brief Sets up (or turns off) the trigger and arms it.
+   * @param edge a TriggerEdge
+   * @param level value of the first series to trigger on
+   * @param holdoff samples to ignore after each capture
+   * @param preTrigger samples to show from before the trigger, less than width
+   */
+  void trigger(uint8_t edge, int16_t level, uint16_t holdoff, uint16_t preTrigger) {
+    trigEdge = edge & TRIGGER_EITHER;
+    trigLevel = level;
+    trigHoldoff = holdoff;
+    trigPre = preTrigger < width ? preTrigger : width - 1;
+    pre.clear();
+    rearm();
   }
-};
 
-//TODO: This should be private inside TouchManager, but then we can't access it in TouchGraph::draw
-std::vector<std::shared_ptr<TouchGraphs>> allGraphs;
+  /**
+   * @brief Sets the colour, plot mode and overlays of a series.
+   * Series that don't have data yet are made, so this can be done first.
+   */
+  void style(size_t index, uint16_t color, uint8_t mode, uint8_t overlays) {
+    while (series.size() <= index) {
+      series.emplace_back(width, pool);
+    }
+    series[index].color = color;
+    series[index].mode = mode;
+    series[index].overlays = overlays;
+    series[index].shown[0] = 0;
+  }
 
-std::shared_ptr<TouchGraphs> getOrCreateGraph(int groupID, const std::vector<GFXPoint>& series = {}) {
-  if (!groupID) return nullptr;
-  auto it = std::find_if(allGraphs.begin(), allGraphs.end(),
-                          [groupID](const auto& graphPtr) {
-                            return graphPtr->id == groupID;
-                          });
+  /**
+   * @brief Appends one column of samples, one value per series.
+   * Values are clamped to int16.
+   * @return true if there is something new to draw: always when free running,
+   * only when a triggered window has been captured otherwise.
+   */
+  template <typename T>
+  bool append(const T* values, size_t count) {
+    if (!count) return false;
+    while (series.size() < count) {
+      series.emplace_back(width, pool);
+    }
+    if (trigEdge == TRIGGER_OFF) {
+      push(series, values, count);
+      return true;
+    }
 
-  if (it != allGraphs.end()) {
-    if (series.size() > 0) //add new series if provided
-      it->get()->graph.push_back(series);
-    return *it; // Return existing graph
+    switch (trigState) {
+      case HOLDOFF:
+        if (++trigCount >= trigHoldoff) rearm();
+        return false;
+
+      case ARMED: {
+        int16_t v = clamp(values[0]);
+        bool fired = trigHavePrev &&
+          (((trigEdge & TRIGGER_RISING) && trigPrev < trigLevel && v >= trigLevel) ||
+           ((trigEdge & TRIGGER_FALLING) && trigPrev > trigLevel && v <= trigLevel));
+        trigPrev = v;
+        trigHavePrev = true;
+        if (!fired) {
+          if (trigPre) {
+            while (pre.size() < count) pre.emplace_back(trigPre, pool);
+            push(pre, values, count);
+          }
+          return false;
+        }
+        // start the window with what came before the trigger
+        for (size_t i = 0; i < series.size(); ++i) {
+          series[i].clear();
+          for (size_t k = 0; i < pre.size() && k < pre[i].size(); ++k) {
+            series[i].push(pre[i].at(k));
+          }
+        }
+        trigState = CAPTURING;
+      }
+      // fall through - the triggering sample is the first one captured
+      case CAPTURING:
+        push(series, values, count);
+        if (series[0].size() < width) return false;
+        if (trigHoldoff) {
+          trigState = HOLDOFF;
+          trigCount = 0;
+        } else {
+          rearm();
+        }
+        return true;
+    }
+    return false;
   }
-  
-  // Create new group only if series is provided
-  if (series.size() > 0) {
-    auto newGraph = std::make_shared<TouchGraphs>(groupID, series);
-    allGraphs.push_back(newGraph);
-    return newGraph;
+
+private:
+  static int16_t clamp(int32_t v) {
+    return (int16_t)(v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : v));
+  }
+
+  template <typename T>
+  void push(std::vector<GraphSeries, PoolAllocator<GraphSeries>>& dest, const T* values, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      dest[i].push(clamp(values[i]));
+      if (autoscale && &dest == &series) {
+        dest[i].rescale(autoscale);
+      }
+    }
   }
-  
-  return nullptr;
-}
 
+  void rearm() {
+    trigState = ARMED;
+    trigHavePrev = false;
+    for (auto& p : pre) {
+      p.clear();
+    }
+  }
+};
 
 // ----------------------------------------------------
 //  BASE CLASS FOR ALL SHAPES
@@ -106,7 +357,7 @@ public:
 
   // Constructor
   TouchShape(std::shared_ptr<TouchGroup> g, uint16_t c, bool f)
-    : group(g), color(c), filled(f) {}
+    : group(std::move(g)), color(c), filled(f) {}
   
   // Destructor (base class best practice)
   virtual ~TouchShape() {}
@@ -124,6 +375,11 @@ public:
    * @param gfx Point to Adafruit_GFX.
    */
   virtual void draw(Adafruit_GFX* gfx) const = 0;
+
+  /**
+   * @brief The command letter that makes this kind of shape.
+   */
+  virtual char type() const = 0;
 };
 
 
@@ -140,7 +396,7 @@ public:
 
   TouchRect(int _x, int _y, int _w, int _h, 
             uint16_t _color, bool _filled, std::shared_ptr<TouchGroup> _group)
-    : TouchShape(_group, _color, _filled), x(_x), y(_y), w(_w), h(_h) {}
+    : TouchShape(std::move(_group), _color, _filled), x(_x), y(_y), w(_w), h(_h) {}
 
   bool contains(int px, int py) const override {
     return (px >= x) && (px < (x + w)) && (py >= y) && (py < (y + h));
@@ -153,6 +409,8 @@ public:
       gfx->drawRect(x, y, w, h, color);
     }
   }
+
+  char type() const override { return 'R'; }
 };
 
 /**
@@ -164,7 +422,7 @@ public:
 
   TouchCircle(int _x, int _y, int _d, 
               uint16_t _color, bool _filled, std::shared_ptr<TouchGroup> _group)
-    : TouchShape(_group, _color, _filled), x(_x), y(_y), d(_d) {}
+    : TouchShape(std::move(_group), _color, _filled), x(_x), y(_y), d(_d) {}
 
   bool contains(int px, int py) const override {
     // Use distance formula: (px-x)^2 + (py-y)^2 <= r^2
@@ -182,42 +440,107 @@ public:
       gfx->drawCircle(x, y, d / 2, color);
     }
   }
+
+  char type() const override { return 'O'; }
 };
 
 /**
  * @brief 'G' graph shape.
- * Call once for each series to add data to the graph for a given ID.
+ * The samples live in its TouchGraphs data. Each series is
+ * plotted in its own horizontal band, oldest sample on the left, below a line
+ * of overlay labels if it has any.
  */
 class TouchGraph : public TouchShape {
 public:
   int x, y, w, h;
-  std::vector<GFXPoint> series;
-  TouchGraph(int _x, int _y, int _w, int _h, const std::vector<GFXPoint>& _points,
+  std::shared_ptr<TouchGraphs> data;
+
+  TouchGraph(int _x, int _y, int _w, int _h, std::shared_ptr<TouchGraphs> _data,
                uint16_t _color, bool _filled, std::shared_ptr<TouchGroup> _group)
-    : TouchShape(_group, _color, _filled), series(_points), x(_x), y(_y), w(_w), h(_h) {}
-    
+    : TouchShape(std::move(_group), _color, _filled), x(_x), y(_y), w(_w), h(_h), data(std::move(_data)) {}
+
+  bool contains(int px, int py) const override {
+    return (px >= x) && (px < (x + w)) && (py >= y) && (py < (y + h));
+  }
+
   void draw(Adafruit_GFX* gfx) const override {
-    if (this->group == nullptr) return;
-    //Need to find the graph object matching this group ID but we don't have access to TouchManager's allGraphs or getOrCreateGraph here.
-    auto g = getOrCreateGraph(this->group ->id);
-
-    if (!g || g->graph.size() == 0 || g->graph[0].size() == 0) return;
-    int yh = h / g->graph[0].size(); //height per series
-    for (const auto& aseries : g->graph) {
-      int filling = (this->filled && (aseries.size() > 1)) ? 1 : 0;
-      for (size_t i = 0; i < aseries.size() - filling; ++i) {
-        int px = aseries[i].x + x;
-        int py = aseries[i].y + y*yh;
-        if (filling) {
-          int nx = aseries[i + 1].x + x;
-          int ny = aseries[i + 1].y + y*yh;
-          gfx->drawLine(px, py, nx, ny, color);
+    render(gfx, true);
+  }
+
+  /**
+   * @brief Redraws the traces after new data, and the overlay labels only if
+   * their text has changed.
+   */
+  void update(Adafruit_GFX* gfx) const {
+    render(gfx, false);
+  }
+
+  char type() const override { return 'G'; }
+
+private:
+  static const int LABEL_H = 8; // default font, size 1
+
+  void render(Adafruit_GFX* gfx, bool full) const {
+    const auto& g = data;
+    if (full) gfx->fillRect(x, y, w, h, C565_BLACK);
+    if (!g || g->series.size() == 0) return;
+    int yh = h / g->series.size(); //height per series
+    for (size_t s = 0; s < g->series.size(); ++s) {
+      GraphSeries& aseries = g->series[s];
+      uint16_t c = aseries.color ? aseries.color : color;
+      int top = y + s * yh;
+      int plotH = yh;
+      if (aseries.overlays) {
+        plotH -= LABEL_H;
+        drawLabel(gfx, aseries, c, top, full);
+        top += LABEL_H;
+      }
+      if (plotH < 1) continue;
+      if (!full) gfx->fillRect(x, top, w, plotH, C565_BLACK);
+      int bottom = top + plotH - 1;
+      bool lines = aseries.mode ? aseries.mode == SERIES_LINES : this->filled;
+      // fixed point (16.16) pixels per unit, only used when autoscaling
+      int32_t scale = ((int32_t)(plotH - 1) << 16) / ((aseries.hi - aseries.lo) > 0 ? (aseries.hi - aseries.lo) : 1);
+      int lastY = 0;
+      for (size_t i = 0; i < aseries.size(); ++i) {
+        int32_t v = aseries.at(i);
+        int32_t dy = g->autoscale ? (int32_t)(((int64_t)(v - aseries.lo) * scale) >> 16) : v;
+        if (dy < 0) dy = 0;
+        if (dy > plotH - 1) dy = plotH - 1;
+        int px = x + i;
+        int py = bottom - dy;
+        if (lines && i > 0) {
+          gfx->drawLine(px - 1, lastY, px, py, c);
         } else {
-          gfx->drawPixel(px, py, color);
+          gfx->drawPixel(px, py, c);
         }
+        lastY = py;
       }
     }
   }
+
+  void drawLabel(Adafruit_GFX* gfx, GraphSeries& aseries, uint16_t c, int top, bool full) const {
+    char label[sizeof(aseries.shown)] = "";
+    if (aseries.size()) {
+      int len = 0;
+      if (aseries.overlays & OVERLAY_MIN)
+        len += snprintf(label + len, sizeof(label) - len, "v%d ", aseries.minimum());
+      if ((aseries.overlays & OVERLAY_MAX) && len < (int)sizeof(label))
+        len += snprintf(label + len, sizeof(label) - len, "^%d ", aseries.maximum());
+      if ((aseries.overlays & OVERLAY_MEAN) && len < (int)sizeof(label))
+        len += snprintf(label + len, sizeof(label) - len, "~%d ", aseries.mean());
+      if ((aseries.overlays & OVERLAY_LAST) && len < (int)sizeof(label))
+        snprintf(label + len, sizeof(label) - len, "=%d", aseries.last());
+    }
+    if (!full && strcmp(label, aseries.shown) == 0) return; //digits haven't changed
+    strcpy(aseries.shown, label);
+    gfx->fillRect(x, top, w, LABEL_H, C565_BLACK);
+    gfx->setFont(NULL);
+    gfx->setTextSize(1);
+    gfx->setTextColor(c);
+    gfx->setCursor(x, top);
+    gfx->print(label);
+  }
 };
 
 /**
@@ -226,11 +549,13 @@ public:
 class TouchPolygon : public TouchShape {
 public:
   // Store a copy of the points
-  std::vector<GFXPoint> points;
+  std::vector<GFXPoint, PoolAllocator<GFXPoint>> points;
 
-  TouchPolygon(const std::vector<GFXPoint>& _points,
-               uint16_t _color, bool _filled, std::shared_ptr<TouchGroup> _group)
-    : TouchShape(_group, _color, _filled), points(_points) {}
+  TouchPolygon(const GFXPoint* _points, size_t count,
+               uint16_t _color, bool _filled, std::shared_ptr<TouchGroup> _group,
+               BlockPool* pool = nullptr)
+    : TouchShape(std::move(_group), _color, _filled),
+      points(_points, _points + count, PoolAllocator<GFXPoint>(pool)) {}
     //note Adafruit_GFX can't fill polygons so we won't use the filled option
 
   /**
@@ -272,11 +597,13 @@ public:
     }
     return isInside;
   }
+
+  char type() const override { return 'S'; }
 };
 
 class TouchText : public TouchShape {
 public:
-  std::string text;
+  std::basic_string<char, std::char_traits<char>, PoolAllocator<char>> text;
   int x, y;
   int fontIndex;
   uint16_t color;
@@ -290,14 +617,15 @@ public:
   // "mutable" so we can update these inside the const draw() function
   mutable int16_t bX, bY;
   mutable uint16_t bW, bH;
-  mutable bool boundsCalculated;
+  mutable std::atomic<bool> boundsCalculated; //set after the bounds, for touch lookups on another core
 
-  TouchText(int _x, int _y, std::string _text, int _fontIdx, 
+  TouchText(int _x, int _y, const char* _text, int _fontIdx, 
             uint16_t _color, uint8_t _size, uint8_t _dir,
             std::shared_ptr<TouchGroup> _group,
-            const std::vector<const GFXfont*>* _fonts)
-    : TouchShape(_group, _color, false), // Filled doesn't apply to text
-      x(_x), y(_y), text(_text), fontIndex(_fontIdx), 
+            const std::vector<const GFXfont*>* _fonts,
+            BlockPool* pool = nullptr)
+    : TouchShape(std::move(_group), _color, false), // Filled doesn't apply to text
+      text(_text, PoolAllocator<char>(pool)), x(_x), y(_y), fontIndex(_fontIdx), 
       color(_color), size(_size), direction(_dir),
       fontTable(_fonts), boundsCalculated(false) {}
 
@@ -340,6 +668,19 @@ public:
     // Standard rectangle check using the calculated bounds
     return (px >= bX) && (px < (bX + bW)) && (py >= bY) && (py < (bY + bH));
   }
+
+  char type() const override { return 'T'; }
+};
+
+/**
+ * @brief Told about each shape as it is drawn, e.g. to account pixels to
+ * shapes (see host/OverdrawCanvas.h). Set TouchManager::observer to use it.
+ */
+class DrawObserver {
+public:
+  virtual ~DrawObserver() {}
+  virtual void drawing(const TouchShape& shape) = 0;
+  virtual void drawn(const TouchShape& shape) = 0;
 };
 
 // ----------------------------------------------------
@@ -348,8 +689,18 @@ public:
 
 class TouchManager {
 private:
+  // Memory for the shapes and everything in them, recycled after a clear.
+  // Declared first so it outlives them.
+  BlockPool m_pool;
+
+  template <typename T, typename... Args>
+  std::shared_ptr<T> make(Args&&... args) {
+    return std::allocate_shared<T>(PoolAllocator<T>(&m_pool), std::forward<Args>(args)...);
+  }
+
   std::vector<std::shared_ptr<TouchGroup>> allGroups;
   std::vector<std::shared_ptr<TouchShape>> allShapes;
+  HitIndex<TouchShape> m_hits; // what findGroupIDAt searches, safe to read from another core
   Adafruit_GFX* m_gfx; // Pointer to the registered display
 
   std::vector<const GFXfont*> fontTable;
@@ -366,13 +717,58 @@ private:
     }
     
     // Create new group
-    auto newGroup = std::make_shared<TouchGroup>(groupID);
-    allGroups.push_back(newGroup);
-    return newGroup;
+    allGroups.push_back(make<TouchGroup>(groupID));
+    return allGroups.back();
+  }
+
+  // Graph shapes by group ID, each with a handle to its data. The nodes come
+  // from the pool and the buckets are sized once in the constructor (a clear
+  // keeps them), so adding a graph to a rebuilt scene takes nothing from the heap.
+  typedef std::pair<const int, std::shared_ptr<TouchGraph>> GraphEntry;
+  std::unordered_map<int, std::shared_ptr<TouchGraph>, std::hash<int>, std::equal_to<int>,
+                     PoolAllocator<GraphEntry>> allGraphs;
+
+  TouchGraph* findGraph(int groupID) {
+    auto it = allGraphs.find(groupID);
+    return it != allGraphs.end() ? it->second.get() : nullptr;
   }
 
+  TouchGraphs* findGraphData(int groupID) {
+    TouchGraph* plot = findGraph(groupID);
+    return plot ? plot->data.get() : nullptr;
+  }
+
+  void addShape(std::shared_ptr<TouchShape> shape) {
+    allShapes.push_back(std::move(shape));
+    const TouchShape& added = *allShapes.back();
+    // Draw it if the display is registered
+    if (m_gfx) {
+      drawShape(added, m_gfx);
+    }
+    m_hits.append(&added, added.group ? added.group->id : 0);
+  }
+
+  void drawShape(const TouchShape& shape, Adafruit_GFX* gfx) {
+    TRACE_SCOPE(TRACE_DRAW, shape.type());
+    if (observer) observer->drawing(shape);
+    uint32_t t0 = micros();
+    shape.draw(gfx);
+    perf.render(shape.type(), micros() - t0);
+    if (observer) observer->drawn(shape);
+  }
+
+
 public:
-  TouchManager() : m_gfx(nullptr) {}
+  // Counters for rendering and hit testing, also used by the command parser
+  PerfCounters perf;
+
+  // Told about every shape drawn, nullptr for none
+  DrawObserver* observer;
+
+  TouchManager()
+    : m_gfx(nullptr),
+      allGraphs(GRAPH_BUCKETS, std::hash<int>(), std::equal_to<int>(), PoolAllocator<GraphEntry>(&m_pool)),
+      observer(nullptr) {}
 
   /**
    * @brief Binds the manager to a display for auto-drawing.
@@ -394,14 +790,7 @@ public:
    * @param ID group ID or 0 aka nullptr
    */
   void addRect(int x, int y, int w, int h, uint16_t color, bool filled, int groupID) {
-    auto group = getOrCreateGroup(groupID);
-    auto newShape = std::make_shared<TouchRect>(x, y, w, h, color, filled, group);
-    // Add it to the list
-    allShapes.push_back(newShape);
-    // Draw it if the display is registered
-    if (m_gfx) {
-      newShape->draw(m_gfx);
-    }
+    addShape(make<TouchRect>(x, y, w, h, color, filled, getOrCreateGroup(groupID)));
   }
 
   /**
@@ -415,12 +804,7 @@ public:
    * @param ID
    */
   void addCircle(int x, int y, int d, uint16_t color, bool filled, int groupID) {
-    auto group = getOrCreateGroup(groupID);
-    auto newShape = std::make_shared<TouchCircle>(x, y, d, color, filled, group);
-    allShapes.push_back(newShape);
-    if (m_gfx) {
-      newShape->draw(m_gfx);
-    }
+    addShape(make<TouchCircle>(x, y, d, color, filled, getOrCreateGroup(groupID)));
   }
 
   /**
@@ -428,12 +812,11 @@ public:
    * @param points A std::vector of GFXPoint structs.
    */
   void addPolygon(const std::vector<GFXPoint>& points, uint16_t color, bool filled = true, int groupID = 0) {
-    auto group = getOrCreateGroup(groupID);
-    auto newShape = std::make_shared<TouchPolygon>(points, color, filled, group);
-    allShapes.push_back(newShape);
-    if (m_gfx) {
-      newShape->draw(m_gfx);
-    }
+    addPolygon(points.data(), points.size(), color, filled, groupID);
+  }
+
+  void addPolygon(const GFXPoint* points, size_t count, uint16_t color, bool filled = true, int groupID = 0) {
+    addShape(make<TouchPolygon>(points, count, color, filled, getOrCreateGroup(groupID), &m_pool));
   }
 
   // Returns the index of the font to be used later
@@ -442,38 +825,139 @@ public:
     return fontTable.size() - 1;
   }
 
-  void addText(int x, int y, std::string text, int fontIndex, 
+  void addText(int x, int y, const char* text, int fontIndex, 
                uint16_t color, uint8_t size, uint8_t direction, int groupID) {
-    auto group = getOrCreateGroup(groupID);
     // Pass the pointer to our fontTable so the object can look it up later
-    auto newShape = std::make_shared<TouchText>(
-      x, y, text, fontIndex, color, size, direction, group, &fontTable
-    );
-    allShapes.push_back(newShape);
-    if (m_gfx) {
-      newShape->draw(m_gfx);
+    addShape(make<TouchText>(
+      x, y, text, fontIndex, color, size, direction, getOrCreateGroup(groupID), &fontTable, &m_pool
+    ));
+  }
+
+  /**
+   * @brief Creates the graph for a group ID, if it doesn't exist yet.
+   * Nothing is drawn until it has data.
+   *
+   * @param x left edge
+   * @param y upper edge
+   * @param w width, also the number of samples kept per series
+   * @param h height, shared equally by the series
+   * @param color rgb
+   * @param filled true joins the samples with lines, false plots pixels
+   * @param groupID group ID, required
+   * @param autoscale hysteresis margin in percent, 0 plots raw values
+   * @return false if the graph can't be made
+   */
+  bool beginGraph(int x, int y, int w, int h, uint16_t color, bool filled, int groupID,
+                  uint8_t autoscale = 0) {
+    if (!groupID || w <= 0) return false;
+    TouchGraph* found = findGraph(groupID);
+    if (found) {
+      found->data->autoscale = autoscale;
+      return true;
+    }
+    auto& plot = allGraphs[groupID];
+    plot = make<TouchGraph>(x, y, w, h, make<TouchGraphs>(groupID, w, autoscale, &m_pool),
+                            color, filled, getOrCreateGroup(groupID));
+    allShapes.push_back(plot);
+    m_hits.append(plot.get(), groupID);
+    return true;
+  }
+
+  /**
+   * @brief Appends one column (a sample per series) to a graph, without drawing.
+   * @return true if the graph has something new to draw, false if not, or if
+   * there is no graph for that group ID.
+   */
+  bool appendGraph(int groupID, const int16_t* samples, size_t count) {
+    TouchGraphs* data = findGraphData(groupID);
+    return data && data->append(samples, count);
+  }
+
+  /**
+   * @brief Sets up the trigger for a graph. See TouchGraphs::trigger.
+   * @return false if there is no graph for that group ID.
+   */
+  bool triggerGraph(int groupID, uint8_t edge, int16_t level, uint16_t holdoff, uint16_t preTrigger) {
+    TouchGraphs* data = findGraphData(groupID);
+    if (!data) return false;
+    data->trigger(edge, level, holdoff, preTrigger);
+    return true;
+  }
+
+  /**
+   * @brief Redraws the graph for a group ID, e.g. after appendGraph.
+   */
+  void drawGraph(int groupID) {
+    TouchGraph* plot = findGraph(groupID);
+    if (plot && m_gfx) {
+      TRACE_SCOPE(TRACE_DRAW, 'G');
+      if (observer) observer->drawing(*plot);
+      uint32_t t0 = micros();
+      plot->update(m_gfx);
+      perf.render('G', micros() - t0);
+      if (observer) observer->drawn(*plot);
+    }
+  }
+
+  /**
+   * @brief Sets the colour, plot mode and overlay labels of one graph series.
+   *
+   * @param index series number, from 0 to GRAPH_MAX_SERIES - 1
+   * @param color rgb, 0 for the graph's colour
+   * @param mode a SeriesMode
+   * @param overlays SeriesOverlay bits
+   * @return false if there is no graph for that group ID, or no such series.
+   */
+  bool styleGraph(int groupID, int index, uint16_t color, uint8_t mode, uint8_t overlays) {
+    TouchGraphs* data = findGraphData(groupID);
+    //each series up to index is made, so don't let a typo take the heap
+    if (!data || index < 0 || index >= GRAPH_MAX_SERIES) return false;
+    data->style(index, color, mode, overlays);
+    TouchGraph* plot = findGraph(groupID);
+    if (plot && m_gfx) {
+      drawShape(*plot, m_gfx); //the bands may have moved
+    }
+    return true;
+  }
+
+  /**
+   * @brief Appends one sample per series to the graph for a group ID and
+   * redraws it. The graph is created on the first call for that ID.
+   * See beginGraph for the parameters.
+   * @param values one value per series
+   */
+  void addGraph(int x, int y, int w, int h, uint16_t color, bool filled, int groupID,
+                const std::vector<int>& values, uint8_t autoscale = 0) {
+    addGraph(x, y, w, h, color, filled, groupID, values.data(), values.size(), autoscale);
+  }
+
+  void addGraph(int x, int y, int w, int h, uint16_t color, bool filled, int groupID,
+                const int* values, size_t count, uint8_t autoscale = 0) {
+    if (!count || !beginGraph(x, y, w, h, color, filled, groupID, autoscale)) return;
+    if (findGraphData(groupID)->append(values, count)) {
+      drawGraph(groupID);
     }
   }
 
   /**
    * @brief Processes a touch at (px, py).
    * Searches all shapes in reverse order (Z-order) to find a match.
+   * Never blocks, and may be called from another core while shapes are
+   * added or cleared (see HitIndex.h).
    *
+   * @param reader a number for each core or thread calling it, below HIT_READERS
    * @return The ID of the group that was touched, or -1 if no match.
    */
-  int findGroupIDAt(int px, int py) {
-    // Iterate in reverse order (Z-order: last-added is checked first)
-    for (auto it = allShapes.rbegin(); it != allShapes.rend(); ++it) {
-      if ((*it)->contains(px, py)) {
-        // Found a matching shape!
-        if ((*it)->group) {
-          return (*it)->group->id; // Return its group ID
-        } else {
-          return -1; // Matched a "dead" shape (no group)
-        }
-      }
+  int findGroupIDAt(int px, int py, unsigned reader = 0) {
+    uint32_t t0 = micros();
+    int id;
+    {
+      TRACE_SCOPE(TRACE_HIT, 0);
+      id = m_hits.find(px, py, reader);
     }
-    return -1; // No shape contained this point
+    perf.hitTests++;
+    perf.hitTestUs += micros() - t0;
+    return id;
   }
 
   /**
@@ -483,15 +967,35 @@ public:
    */
   void drawAll(Adafruit_GFX* gfx) {
     for (const auto& shape : allShapes) {
-      shape->draw(gfx);
+      drawShape(*shape, gfx);
     }
   }
 
+  /**
+   * @brief All the shapes, in drawing order (first is on the bottom).
+   */
+  const std::vector<std::shared_ptr<TouchShape>>& shapes() const {
+    return allShapes;
+  }
+
+  /**
+   * @brief The pool the shapes are allocated from.
+   */
+  const BlockPool& pool() const { return m_pool; }
+
+  /**
+   * @brief The index findGroupIDAt searches.
+   */
+  const HitIndex<TouchShape>& hitIndex() const { return m_hits; }
+
   /**
    * @brief Clears all defined groups and shapes.
+   * Their memory stays in the pool, for the next scene. They are freed once
+   * no touch lookup can still be looking at them.
    */
   void clearAll() {
-    allShapes.clear();
+    m_hits.clear(allShapes);
     allGroups.clear();
+    allGraphs.clear();
   }
 };
\ No newline at end of file
@@ -0,0 +1,120 @@
+/*
+  Trace.h
+
+  Timestamped scope tracing into a fixed RAM ring buffer, to see where the
+  milliseconds go without printing while it happens. Build with -D MERGIF_TRACE
+  to record, otherwise TRACE_SCOPE compiles to nothing.
+
+  Each core records into its own ring, so neither has to lock or share a count
+  with the other. `3?` dumps both in binary (and empties them), tools/trace2chrome.py
+  turns that into Chrome trace JSON (chrome://tracing or https://ui.perfetto.dev).
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include "ThisCore.h"
+
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS 512 // per core, 12 bytes each in RAM (sizeof(TraceEvent)), 10 in a dump
+#endif
+
+/**
+ * @brief What a trace event measured. The arg is a command or shape letter.
+ */
+enum TraceId : uint8_t {
+  TRACE_PARSE = 1, // a command, arg is the opcode
+  TRACE_DRAW = 2,  // a TouchShape draw, arg is its type()
+  TRACE_HIT = 3,   // findGroupIDAt
+  TRACE_REMAP = 4, // remapTouchPoint
+  TRACE_TX = 5     // serial output, arg is the reason ('e'cho, 't'ouch)
+};
+#define TRACE_CORE1 0x80 // set on the id of events from core 1, in a dump
+
+/**
+ * @brief One scope, begin and end in micros().
+ */
+struct TraceEvent {
+  uint32_t begin;
+  uint32_t end;
+  uint8_t id;
+  uint8_t arg;
+};
+
+/**
+ * @brief Ring buffer of the most recent TRACE_EVENTS events on one core.
+ * Only that core records into it.
+ */
+struct TraceBuffer {
+  TraceEvent events[TRACE_EVENTS];
+  uint32_t count; // events recorded, the newest is at (count - 1) % TRACE_EVENTS
+
+  void record(uint8_t id, uint8_t arg, uint32_t begin, uint32_t end) {
+    TraceEvent& e = events[count++ % TRACE_EVENTS];
+    e.begin = begin;
+    e.end = end;
+    e.id = id;
+    e.arg = arg;
+  }
+
+  void clear() { count = 0; }
+
+  uint32_t size() const { return count < TRACE_EVENTS ? count : TRACE_EVENTS; }
+
+  /**
+   * @brief Writes the events oldest first, each as uint32 begin, uint32 end,
+   * uint8 id (| flags), uint8 arg. All little endian.
+   */
+  void dump(Print& out, uint8_t flags) const {
+    uint8_t b[10];
+    for (uint32_t i = count - size(); i < count; i++) {
+      const TraceEvent& e = events[i % TRACE_EVENTS];
+      for (int k = 0; k < 4; k++) {
+        b[k] = e.begin >> (8 * k);
+        b[4 + k] = e.end >> (8 * k);
+      }
+      b[8] = e.id | flags;
+      b[9] = e.arg;
+      out.write(b, 10);
+    }
+  }
+};
+
+inline TraceBuffer& traceBuffer(int core = thisCore()) {
+  static TraceBuffer trace[MERGIF_CORES];
+  return trace[core];
+}
+
+/**
+ * @brief Writes "MTRC", a uint16 event count, then core 0's events and core 1's
+ * (their ids | TRACE_CORE1), and empties both rings. Nothing may be recording
+ * on the other core.
+ */
+inline void traceDump(Print& out) {
+  uint32_t n = 0;
+  for (int core = 0; core < MERGIF_CORES; core++) n += traceBuffer(core).size();
+  uint8_t b[6] = {'M', 'T', 'R', 'C', (uint8_t)n, (uint8_t)(n >> 8)};
+  out.write(b, 6);
+  for (int core = 0; core < MERGIF_CORES; core++) {
+    traceBuffer(core).dump(out, core ? TRACE_CORE1 : 0);
+    traceBuffer(core).clear();
+  }
+}
+
+/**
+ * @brief Records an event covering its own lifetime.
+ */
+struct TraceScope {
+  uint32_t t0;
+  uint8_t id, arg;
+  TraceScope(uint8_t _id, uint8_t _arg) : t0(micros()), id(_id), arg(_arg) {}
+  ~TraceScope() { traceBuffer().record(id, arg, t0, micros()); }
+};
+
+#ifdef MERGIF_TRACE
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(id, arg) TraceScope TRACE_CONCAT(trace_, __LINE__)(id, arg)
+#else
+#define TRACE_SCOPE(id, arg) do {} while (0)
+#endif
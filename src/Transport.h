@@ -0,0 +1,99 @@
+/*
+  Transport.h
+
+  A link to the host: the byte stream the parser takes commands from and
+  sends its replies and touch reports to (an Arduino Stream), and what can
+  be told about the link itself. main.cpp picks one: Serial1, the UART at
+  115200 baud, or Serial, the USB CDC link, many times faster when the host
+  is a PC. On the PC, host/FdTransport.h runs the same parser over stdio or
+  a pseudo terminal (see host/link.cpp).
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+class Transport : public Stream {
+public:
+  virtual ~Transport() {}
+
+  /**
+   * @brief For messages, e.g. "Serial1".
+   */
+  virtual const char* name() const = 0;
+
+  /**
+   * @return true if received bytes were lost (the buffer was full) since
+   * the last call
+   */
+  virtual bool overflow() { return false; }
+
+  /**
+   * @return false if it is known that no host is there to listen
+   */
+  virtual bool connected() { return true; }
+
+  typedef void (*NewHost)(void* context);
+
+  /**
+   * @brief Calls hook when a new host takes over the link (TCP), before any
+   * of its bytes are read, so the parser can start afresh (see HostLinks.h).
+   */
+  void onNewHost(NewHost hook, void* context) {
+    m_newHost = hook;
+    m_newHostContext = context;
+  }
+
+  using Print::write;
+
+protected:
+  void newHost() {
+    if (m_newHost) m_newHost(m_newHostContext);
+  }
+
+private:
+  NewHost m_newHost = nullptr;
+  void* m_newHostContext = nullptr;
+};
+
+/**
+ * @brief A Transport over any Arduino Stream.
+ */
+template <typename S>
+class StreamTransport : public Transport {
+public:
+  StreamTransport(S& stream, const char* name) : m_stream(stream), m_name(name) {}
+
+  const char* name() const override { return m_name; }
+  int available() override { return m_stream.available(); }
+  int read() override { return m_stream.read(); }
+  int peek() override { return m_stream.peek(); }
+  size_t write(uint8_t b) override { return m_stream.write(b); }
+  size_t write(const uint8_t* buffer, size_t size) override { return m_stream.write(buffer, size); }
+  void flush() override { m_stream.flush(); }
+
+protected:
+  S& m_stream;
+  const char* m_name;
+};
+
+#ifdef ARDUINO_ARCH_RP2040
+/**
+ * @brief A UART, Serial1 (or Serial2, see ChainLink.h). Counts receive FIFO overflows.
+ */
+class UartTransport : public StreamTransport<SerialUART> {
+public:
+  explicit UartTransport(SerialUART& uart = Serial1, const char* name = "Serial1")
+    : StreamTransport<SerialUART>(uart, name) {}
+  bool overflow() override { return m_stream.overflow(); }
+};
+
+/**
+ * @brief Serial, the USB CDC link. USB has flow control, so nothing is lost.
+ */
+class UsbTransport : public StreamTransport<SerialUSB> {
+public:
+  explicit UsbTransport(SerialUSB& usb = Serial) : StreamTransport<SerialUSB>(usb, "USB") {}
+  bool connected() override { return (bool)m_stream; } //a host has the port open
+};
+#endif
@@ -3,14 +3,38 @@
 #include <Adafruit_GFX.h>
 #include <Adafruit_ILI9341.h>
 #include <Adafruit_FT6206.h> 
+#include "PerfCounters.h"
+#include "Trace.h"
+#include "CommandParser.h"
+#include "Soak.h"
+#include "Pipeline.h"
+#include "Scheduler.h"
+#include "Transport.h"
+#include "HostLinks.h"
+#include "TcpTransport.h"
+#include "ChainLink.h"
 
 #define TFT_DC 26
 #define TFT_CS 28
 #define TFT_ORENTATION 1
 #define demo
 #define testing
-
-Adafruit_ILI9341 tft = Adafruit_ILI9341(TFT_CS, TFT_DC);
+//#define soak //random commands forever, reporting heap and latency, see Soak.h
+//#define dualcore //parse and touch on core 0, draw on core 1, see Pipeline.h
+//#define USB_LINK //take commands over USB (Serial) as well, with group IDs of its own, see HostLinks.h
+//#define CHAIN //one of a daisy chain: Serial1 to the host or the node before, Serial2 to the next, see ChainLink.h
+//#define WIFI_LINK //and over TCP on the Pico W, port TCP_PORT, see TcpTransport.h
+#define WIFI_SSID "your network"
+#define WIFI_PASSWORD "its password"
+//#define TOUCH_INT 27 //FT6206 INT pin, if wired: a touch wakes the touch task at once
+
+#define TOUCH_PERIOD_US 10000     //touch sampling, 100 per second
+#define TELEMETRY_PERIOD_US 100000 //overflow count and errors from the render side
+#define INGEST_BYTES 64           //most bytes taken in per pass, so touch gets a turn during a flood
+#define RENDER_SLICE_US 4000      //most time drawing per pass, without dualcore
+#define NETWORK_PERIOD_US 5000    //TCP sends and new connections, when nothing else services them
+
+CountingGFX<Adafruit_ILI9341> tft(TFT_CS, TFT_DC); //counts pixels and SPI bytes
 Adafruit_FT6206 ts = Adafruit_FT6206(); 
 
 TouchManager g_touchManager;
@@ -26,20 +50,24 @@ int doTouch(int x, int y) {
   return g_touchManager.findGroupIDAt(x, y);
 }
 
+// The display's rotation and size as set up. Text drawing turns the display
+// for a moment, and with dualcore that may be happening on core 1 during a touch.
+uint8_t touchRotation;
+int16_t touchWidth, touchHeight;
+
 /**
  * @brief Remaps a raw touch point from an FT6206 (240x320 native)
  * to the rotated coordinate system of an Adafruit_GFX display.
  *
- * @param tft       A pointer to your display object (e.g., &tft).
- * @param raw_x     The original p.x from the touch controller.
- * @param raw_y     The original p.y from the touch controller.
- * @param mapped_x  A pointer to store the final, remapped x-coordinate.
- * @param mapped_y  A pointer to store the final, remapped y-coordinate.
+ * @param rotation  The display's rotation (0-3).
+ * @param width     The display's width in that rotation.
+ * @param height    The display's height in that rotation.
+ * @param t         The original point from the touch controller.
+ * @return The remapped point.
  */
-TS_Point remapTouchPoint(Adafruit_GFX* tft, TS_Point t) {
+TS_Point remapTouchPoint(uint8_t rotation, int16_t width, int16_t height, TS_Point t) {
+  TRACE_SCOPE(TRACE_REMAP, 0);
   TS_Point p;
-  // Get the display's current rotation
-  uint8_t rotation = tft->getRotation();
   switch (rotation) {
     case 0:  // Portrait (0,0 in top-left)
       p.x = t.x;
@@ -48,72 +76,103 @@ TS_Point remapTouchPoint(Adafruit_GFX* tft, TS_Point t) {
 
     case 1:  // Landscape (0,0 in top-left)
       p.x = t.y;
-      p.y = (tft->height() - 1) - t.x;
+      p.y = (height - 1) - t.x;
       break;
 
     case 2:  // Portrait-Inverted (0,0 in top-left)
-      p.x = (tft->width() - 1) - t.x;
-      p.y = (tft->height() - 1) - t.y;
+      p.x = (width - 1) - t.x;
+      p.y = (height - 1) - t.y;
       break;
 
     case 3:  // Landscape-Inverted (0,0 in top-left)
-      p.x = (tft->width() - 1) - t.y;
+      p.x = (width - 1) - t.y;
       p.y = t.x;
       break;
   }
   return p;
 }
 
-uint16_t radix;
-char c; //a global to take in commands
-int n; //a global to hold accumulated digits as a number
-int attr[('Z' - 'A')]; //attributes are an array of letters
-#define LTR(x) (x - 'a')
-boolean quoting; //track quoting state
-String text; //track quoted text
-
 TS_Point p;
-std::vector<GFXPoint> points;
-
-std::vector<int> series;
-std::vector<std::vector<int>> graph;
-
-void printAttrib() {
-  for (int i = 0; i<sizeof(attr)/sizeof(attr[0]); i++) {
-    Serial1.print((char)(i + 'a'));
-    Serial1.print("="); 
-    if ('c' == i + 'a') {
-      Serial1.print("#"); 
-      Serial1.print(attr[i], HEX);
-    } else {
-      Serial1.print(attr[i]);
-    }
-    Serial1.print(", "); 
+
+UartTransport hostLink;
+#ifdef CHAIN
+UartTransport nextLink(Serial2, "Serial2");
+ChainLink chainLink(hostLink, &nextLink); //this node's frames, and the others' passed along
+#endif
+#ifdef USB_LINK
+UsbTransport usbLink;
+#endif
+#ifdef WIFI_LINK
+#include <WiFi.h>
+WiFiServer tcpServer(TCP_PORT);
+TcpTransport<WiFiServer, WiFiClient> tcpLink(tcpServer);
+#endif
+
+HostLinks links(g_touchManager, &tft, TFT_ORENTATION);
+
+#ifdef soak
+SoakTest soakTest(g_touchManager, &tft, hostLink);
+#endif
+
+Pipeline g_pipeline;
+RenderLoop renderLoop(g_pipeline, g_touchManager, &tft);
+
+Scheduler scheduler;
+int touchTask;
+
+/**
+ * @brief Reads the touch controller, and reports a touch at a new point.
+ */
+void sampleTouch() {
+  if (!ts.touched()) return;
+  // Get the touch point
+  TS_Point np = remapTouchPoint(touchRotation, touchWidth, touchHeight, ts.getPoint());
+  uint32_t touchUs = micros();
+  if (np.x != p.x || np.y != p.y) {
+    p = np;
+    RECORD_TOUCH(p.x, p.y);
+    g_touchManager.perf.touches++;
+    int id = doTouch(p.x, p.y);
+    links.touch(id, p.x, p.y, touchUs); //to the host that owns the group
   }
-  Serial1.println(".");
 }
 
-void printPoints() {
-  for (int i = 0; i<points.size(); i++) {
-    Serial1.print(i); Serial1.print("=("); 
-    Serial1.print(points[i].x); Serial1.print(", "); 
-    Serial1.print(points[i].y); Serial1.print(") ");
-  }
-  Serial1.println(".");
+/**
+ * @brief Takes in what has arrived from the hosts, up to INGEST_BYTES from each.
+ * Scene changes are queued for the render task (or core 1).
+ */
+void ingest() {
+  links.feed(INGEST_BYTES);
+}
+
+bool ingestReady() { return links.available(); }
+
+#ifndef dualcore
+/**
+ * @brief Draws queued commands for up to RENDER_SLICE_US.
+ */
+void render() {
+  uint32_t start = micros();
+  while (renderLoop.step() && micros() - start < RENDER_SLICE_US) {}
+}
+
+bool renderReady() { return g_pipeline.commands.size() > 0; }
+#endif
+
+void telemetry() {
+  links.poll(); //overflows, and errors from the render side
 }
 
 
 void setup() {
   tft.begin();
+  tft.perf = &g_touchManager.perf;
   g_touchManager.begin(&tft);
-  radix = 10;
-  n = 0; //current number in radix
-  c = 0; //current character
-  quoting = false; //are we taking in quoted text?
-  text = ""; //The quoted text
-
 
   tft.setRotation(1);
+  touchRotation = tft.getRotation();
+  touchWidth = tft.width();
+  touchHeight = tft.height();
 
   tft.setTextColor(C565_WHITE);
   tft.setTextSize(2);
@@ -124,246 +183,116 @@ void setup() {
   Wire.begin(); 
 
   if (! ts.begin(40)) {
-    Serial1.println(".");
+    hostLink.println(".");
     while (1);
   }
 
   Serial1.begin(115200);
+#ifdef CHAIN
+  Serial2.begin(115200);
+  links.add(chainLink);
+#else
+  links.add(hostLink);
+#endif
+#ifdef USB_LINK
+  Serial.begin(115200); //the rate doesn't matter over USB
+  links.add(usbLink, true);
+#endif
+#ifdef WIFI_LINK
+  if (WiFi.begin(WIFI_SSID, WIFI_PASSWORD) == WL_CONNECTED) {
+    tcpLink.begin();
+    links.add(tcpLink, true);
+    hostLink.print("#tcp "); hostLink.print(WiFi.localIP()); hostLink.print(":"); hostLink.println(TCP_PORT);
+  } else {
+    hostLink.println("Error: no WiFi");
+  }
+#endif
 
 #ifdef demo
-
-  // Serial1.println("Ready2");
-  g_touchManager.addText( 
-    0, //X
-    0, //Y
-    "Ready2", 0, C565_YELLOW, 
-    1 + 1, //size
-    (0 + TFT_ORENTATION) % 4, //direction
-    0  //ID
-  );
-
-  // --- Define Groups and Rectangles ---
-  
-  // Draw multiple rectangles in one group.
-  Serial1.println("1i 10x 20y 40h 50w #f800C R");
-  g_touchManager.addRect(10, 20, 40, 50, C565_RED, true, 1); // Group 1, Rect 1
-  Serial1.println("1i 70x 10y 30h 20w #001fC R");
-  g_touchManager.addRect(70, 10, 30, 20, C565_BLUE, false, 1); // Group 1, Rect 2
-
-  // Add another group with one, circle
-  Serial1.println("2i 100x 35y 25d #07e0C O");
-  g_touchManager.addCircle(100, 35, 25, C565_GREEN, false, 2); // (100, 35) center, 25 diameter
-
-  // Add a circle, not in a group
-  Serial1.println("0i 100x 35y 25d #fd20C O");
-  g_touchManager.addCircle(200, 100, 50, C565_ORANGE, true, 0); 
-  
-  // Add an overlapping rect for Z-order testing
-  // This rect is added LAST, so it will be "on top"
-  Serial1.println("99i 30x 40y 50w 50h 30735c R");
-  g_touchManager.addRect(30, 40, 50, 50, C565_PURPLE, true, 99); // Group 99, Rect 1
-
-  Serial1.println("3i 220x 20y P 270x 20y P ");
-  Serial1.println("220x 70y P 270x 70y P #ffe0C L");
-  points.push_back({220, 20});
-  points.push_back({270, 20});
-  points.push_back({220, 70});
-  points.push_back({270, 70});
-  g_touchManager.addPolygon(points, C565_YELLOW, 3); 
-  points.clear();
-
-  // g_touchManager.drawAll(&tft);
+  // Drawn through the first link's parser, which echoes each command back
+  const char* demoScene[] = {
+    "0i 0x 0y 1h 0d #ffe0C \"Ready2\" T",
+    // --- Define Groups and Rectangles ---
+    // Draw multiple rectangles in one group.
+    "1i 10x 20y 40h 50w #f800C R",
+    "1i 70x 10y 30h 20w #001fC R",
+    // Add another group with one, circle
+    "2i 100x 35y 25d #07e0C O",
+    // Add a circle, not in a group
+    "0i 200x 100y 50d #fd20C O",
+    // Add an overlapping rect for Z-order testing
+    // This rect is added LAST, so it will be "on top"
+    "99i 30x 40y 50w 50h 30735c R",
+    "3i 220x 20y P 270x 20y P ",
+    "220x 70y P 270x 70y P #ffe0C L",
+  };
+  for (const char* command : demoScene) {
+    while (*command) links.parser(0).feed(*command++);
+    links.parser(0).feed('\n');
+  }
 #endif
 
 #ifdef testing
-  Serial1.print("\nTesting ");
-  Serial1.flush();
+  hostLink.print("\nTesting ");
+  hostLink.flush();
 
   // Test 1: Hit the first rectangle of Group 1
-  if(1 != doTouch(15, 20)) Serial1.println("Error: 15,20 should be in group 1");
+  if(1 != doTouch(15, 20)) hostLink.println("Error: 15,20 should be in group 1");
 
   // Test 2: Hit the second rectangle of Group 1
-  if(1 != doTouch(72, 15)) Serial1.println("Error: 72,15 should be in group 1");
+  if(1 != doTouch(72, 15)) hostLink.println("Error: 72,15 should be in group 1");
  
   // Test 3: Hit the rectangle for Group 2
-  if(2 != doTouch(100, 33)) Serial1.println("Error: 100,33 should be in group 2");
+  if(2 != doTouch(100, 33)) hostLink.println("Error: 100,33 should be in group 2");
 
   // Test 4: Hit a blank area
-  if(-1 != doTouch(200, 200)) Serial1.println("Error: 200,200 should not be in a group -1");
+  if(-1 != doTouch(200, 200)) hostLink.println("Error: 200,200 should not be in a group -1");
 
   // Test 5: Z-ORDER TEST. This point is inside both
   // Group 1 (10,10,50,50) and Group 99 (40,40,50,50).
   // Since Group 99 was added last, it should win.
-  if(99 != doTouch(45, 45)) Serial1.println("Error: 45,45 should be in group 99"); 
-  Serial1.println(" completed");
+  if(99 != doTouch(45, 45)) hostLink.println("Error: 45,45 should be in group 99"); 
+  hostLink.println(" completed");
 
   #endif
 
-}
+  links.setPipeline(&g_pipeline); //from here on, core 1 or the render task draws
+#ifndef dualcore
+  g_pipeline.sameCore = &renderLoop;
+#endif
 
+  // in order of priority
+  touchTask = scheduler.add("touch", sampleTouch, TOUCH_PERIOD_US);
+  scheduler.add("ingest", ingest, 0, ingestReady);
+#ifndef dualcore
+  scheduler.add("render", render, 0, renderReady);
+#endif
+  scheduler.add("telemetry", telemetry, TELEMETRY_PERIOD_US);
+#ifdef WIFI_LINK
+  scheduler.add("network", []() { tcpLink.service(); }, NETWORK_PERIOD_US);
+#endif
+#ifdef TOUCH_INT
+  pinMode(TOUCH_INT, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(TOUCH_INT), []() { scheduler.wake(touchTask); }, FALLING);
+#endif
+}
 
-void loop() {
-  if (ts.touched()) {
-    // Get the touch point
-    TS_Point np = remapTouchPoint(&tft, ts.getPoint());
-    if (np.x != p.x || np.y != p.y) {
-      p = np;
-      // printAttrib();
-      // Serial1.print(n); Serial1.print(" ");
-      Serial1.print(doTouch(p.x, p.y));
-      Serial1.print("@ X:"); Serial1.print(p.x);
-      Serial1.print("Y:"); Serial1.println(p.y);
-    }
+#ifdef dualcore
+void setup1() {
+}
 
+void loop1() {
+  if (!renderLoop.step()) {
+    tight_loop_contents();
   }
-  if (Serial1.available()) {
-    if (Serial1.peek() == 34) { //about to get a quote
-      if (c == 34) { //getting a double quote
-        if (quoting) {// just two quotes
-          text = ""; //empty string
-        } else { // three quotes
-          text += '"'; //this is an escaped quote
-          quoting = true; //keep quoting
-        }
-      } else { //single quote
-        if (quoting) { //end the quoted string
-          quoting = false;
-        } else {
-          quoting = true;
-          // Serial1.println(">");
-          text = ""; //start a new string
-        }
-      }
-      Serial1.print(c = Serial1.read()); //quote managed
-      return;
-    }
-    c = Serial1.read();
-    Serial1.print(c);
-    if (quoting) {
-      text += c;
-      return;
-    }
-    if (isdigit(c) || (radix > 10 && c >= 'a' && c <= 'f')) {
-      //Note: don't use isHexadecimalDigit(c) so that 'C' (or whatever) can pop us out
-      n *= radix;
-      if (radix > 10 && c >= 'a' && c <= 'f') { //a-f are numbers now
-        n += (int)(c - 'a' + 10);
-      } else {
-        n += (int)(c - '0');
-      }
-      // Serial1.print("\n");Serial1.print(radix); Serial1.print(" "); Serial1.println(n); 
-      return;
-    }
-
-    switch (c) {
-
-      case 'Z': //Zero out the display and objects
-        tft.fillScreen(C565_BLACK);
-        g_touchManager.clearAll();
-        for (int i = 0; i<sizeof(attr)/sizeof(attr[0]); i++) { 
-          attr[i] = 0; 
-        }
-        points.clear(); n = 0; radix = 10;
-        delay(100);
-        break;
-
-      case 'R': //Rectangle
-        g_touchManager.addRect(
-          attr[LTR('x')], attr[LTR('y')], attr[LTR('w')], attr[LTR('h')], 
-          attr[LTR('c')], true, attr[LTR('i')] 
-        );
-        n = 0; radix = 10;
-        break;
-      
-      case 'O': //Circle
-        g_touchManager.addCircle(
-          attr[LTR('x')], attr[LTR('y')], attr[LTR('d')], 
-          attr[LTR('c')], true, attr[LTR('i')] 
-        );
-        n = 0; radix = 10;
-        break;
-
-      case 'P': //Point
-        points.push_back(
-          (GFXPoint){(int16_t)attr[LTR('x')], (int16_t)attr[LTR('y')]}
-        );
-        break;
-
-      case 'L': //Line, not closed, no group ID
-        g_touchManager.addPolygon(points, attr[LTR('c')], false, 0);
-        points.clear(); n = 0; radix = 10;
-        break;
-
-      case 'S': //Shape
-        g_touchManager.addPolygon(points, attr[LTR('c')], true, attr[LTR('i')] );
-        points.clear(); n = 0; radix = 10;
-        break;
-
-      case '#': //Hex set radix to 16
-        radix = (0 == n ? 16 : n);
-        n = 0;
-        break;
-
-      case 'C': //Color (also 'c' if not in hex)
-        attr[LTR('c')] = n;
-        // Serial1.print(n); Serial1.print(" "); Serial1.println(n, HEX);
-        n = 0; radix = 10;
-        break; 
-
-      case 'T': //Text
-        Serial1.println(text);
-        g_touchManager.addText(
-          attr[LTR('x')], attr[LTR('y')], text.c_str(), attr[LTR('f')], 
-          attr[LTR('c')], 
-          attr[LTR('h')] + 1, //size (height) default is 1
-          (attr[LTR('d')] + TFT_ORENTATION) % 4, //orentation; relate to display orientation
-          attr[LTR('i')]  
-        );
-        break;
-
-      case ',': //series
-        series.push_back(n);
-        n = 0; radix = 10;
-        break;
-
-      case 'G': { //Graph
-        series.push_back(n);
-        n = 0; radix = 10;
-        graph.push_back(series);
-        int y_count = attr[LTR('w')]; //width is both pixel width and number of series
-        while (graph.size() > y_count) { //If this pushes series off the other side
-          graph.erase(graph.begin()); //trim them off
-        }
-        Serial1.println("");
-        for (const auto& aseries : graph) {
-          for (const auto& element : aseries) {
-            Serial1.print(element);
-            Serial1.print(",\t");
-          }
-          Serial1.println("");
-        }
-        series.clear();
-        break;
-      }
-
-      case '?':
-        printAttrib();
-        printPoints();
-        break;
-
-      default:
-        break;
-    }
-
-    if ('a' <= c && c <= 'z') {
-      attr[LTR(c)] = n;
-      // Serial1.print("\nslot "); Serial1.print(LTR(c));
-      // Serial1.print((char)(LTR(c) + 'a'));
-      // Serial1.print("="); Serial1.println(attr[LTR(c)]);
-      radix = 10; //back to decimal
-      n = 0;
-      return;
-    }
-  }
-  delay(100); // this speeds up the simulation
+}
+#endif
+
+
+void loop() {
+#ifdef soak
+  soakTest.step(); //the host link only gets the #soak lines
+  return;
+#endif
+  scheduler.loop(); //runs what is due, or sleeps until something is
 }
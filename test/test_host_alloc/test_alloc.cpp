@@ -0,0 +1,129 @@
+/*
+ * Counts heap allocations while a scene is built: once the parser and the
+ * shape pool have seen it, clearing it and building it again must not
+ * allocate at all, from the bytes coming in to the shapes being drawn.
+ * Run on the PC: pio test -e native
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "CommandParser.h"
+#include "Canvas565.h"
+#include "PrintSinks.h"
+
+#include <cstdlib>
+#include <new>
+#include <string>
+
+static size_t g_allocs = 0;
+static bool g_counting = false;
+
+// Every new and delete goes through this pair
+static void* allocate(size_t n) {
+  if (g_counting) g_allocs++;
+  void* p = std::malloc(n ? n : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+static void release(void* p) noexcept { std::free(p); }
+
+void* operator new(size_t n) { return allocate(n); }
+void* operator new[](size_t n) { return allocate(n); }
+void operator delete(void* p) noexcept { release(p); }
+void operator delete[](void* p) noexcept { release(p); }
+void operator delete(void* p, size_t) noexcept { release(p); }
+void operator delete[](void* p, size_t) noexcept { release(p); }
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// Every kind of shape, a label too long to fit in a string object, graphs
+// with several series, a style, a trigger and a binary packet.
+static std::string scene() {
+  std::string s =
+    "1i 10x 10y 50w 40h #f800C R 2i 100x 80y 30d #07e0C O "
+    "3i 10x 100y P 60x 100y P 40x 150y P 5x 140y P #ffe0C S "
+    "200x 10y P 300x 40y P 250x 90y P L "
+    "4i 20x 200y 1h \"a label well past the small string buffer\" T "
+    "5i 10x 5y \"ok\" T "
+    "6i 120x 10y 150w 60h #7e0C 10a 1,20,300G 2,30,100G 3,40,200G "
+    "6i 1n #1fC 2m 15v U "
+    "7i 120x 100y 100w 40h 1k 50l 4p K 7i 10G 20G 90G 30G "
+    "8i 10x 170y 80w 30h V";
+  const uint8_t packet[] = {1, 2, 3, 0, 10, 246, 5, 5, 250, 6};
+  s.append((const char*)packet, sizeof(packet));
+  s += " 9i 0x 0y 20w 20h R ";
+  return s;
+}
+
+static void send(CommandParser& parser, const std::string& s) {
+  for (char ch : s) parser.feed((uint8_t)ch);
+}
+
+void test_rebuilding_a_scene_allocates_nothing(void) {
+  Canvas565 canvas;
+  canvas.setRotation(1);
+  TouchManager tm;
+  tm.begin(&canvas);
+  NullPrint out;
+  CommandParser parser(tm, &canvas, out);
+  const std::string stream = scene();
+
+  send(parser, stream); //warm up
+  size_t shapes = tm.shapes().size();
+  send(parser, "Z ");
+
+  g_allocs = 0;
+  g_counting = true;
+  for (int pass = 0; pass < 3; pass++) {
+    send(parser, stream);
+    send(parser, "1?Z ");
+  }
+  g_counting = false;
+  TEST_ASSERT_EQUAL_MESSAGE(0, g_allocs, "heap allocations once warmed up");
+
+  send(parser, stream);
+  TEST_ASSERT_EQUAL(shapes, tm.shapes().size());
+}
+
+void test_pool_reuses_blocks(void) {
+  BlockPool pool;
+  void* a = pool.allocate(40);
+  void* b = pool.allocate(48); // same class
+  TEST_ASSERT_TRUE(a != b);
+  pool.deallocate(a, 40);
+  TEST_ASSERT_EQUAL_PTR(a, pool.allocate(33)); // 33..48 share a class
+  void* big = pool.allocate(3000);
+  pool.deallocate(big, 3000);
+  TEST_ASSERT_EQUAL_PTR(big, pool.allocate(2049));
+  TEST_ASSERT_EQUAL(3, pool.heapBlocks);
+
+  void* huge = pool.allocate(100000); // past the classes, straight from the heap
+  pool.deallocate(huge, 100000);
+  TEST_ASSERT_EQUAL(3, pool.heapBlocks);
+  TEST_ASSERT_EQUAL(0, pool.idleBytes());
+  pool.deallocate(b, 48);
+  TEST_ASSERT_EQUAL(48, pool.idleBytes());
+}
+
+void test_clear_keeps_the_memory(void) {
+  TouchManager tm;
+  NullPrint out;
+  CommandParser parser(tm, nullptr, out);
+  send(parser, scene());
+  uint32_t blocks = tm.pool().heapBlocks;
+  TEST_ASSERT_GREATER_THAN(0, blocks);
+  send(parser, "Z ");
+  TEST_ASSERT_GREATER_THAN(0, tm.pool().idleBytes());
+  send(parser, scene());
+  TEST_ASSERT_EQUAL(blocks, tm.pool().heapBlocks);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_rebuilding_a_scene_allocates_nothing);
+  RUN_TEST(test_pool_reuses_blocks);
+  RUN_TEST(test_clear_keeps_the_memory);
+  return UNITY_END();
+}
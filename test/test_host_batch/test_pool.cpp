@@ -0,0 +1,72 @@
+/*
+ * Checks host/WorkStealingPool.h runs every job exactly once, and that
+ * replays on several threads give the same frames as on one.
+ * Run on the PC: pio test -e native
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "WorkStealingPool.h"
+#include "Replay.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_every_job_once(void) {
+  WorkStealingPool pool(4);
+  std::vector<std::atomic<int>> runs(1000);
+  std::atomic<unsigned> highest(0);
+  // no asserts in the jobs, Unity can't fail from another thread
+  pool.run(runs.size(), [&](size_t i, unsigned thread) {
+    if (thread > highest) highest = thread;
+    runs[i]++;
+  });
+  for (auto& r : runs) TEST_ASSERT_EQUAL(1, r.load());
+  TEST_ASSERT_LESS_THAN(4, highest.load());
+  std::atomic<int> none(0);
+  pool.run(0, [&](size_t, unsigned) { none++; });
+  TEST_ASSERT_EQUAL(0, none.load());
+}
+
+void test_uneven_jobs_are_stolen(void) {
+  WorkStealingPool pool(4);
+  std::atomic<int> done(0);
+  // the first thread's share is slow, the others should take some of it
+  pool.run(40, [&](size_t i, unsigned) {
+    if (i < 10) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    done++;
+  });
+  TEST_ASSERT_EQUAL(40, done.load());
+  TEST_ASSERT_GREATER_THAN(0, pool.steals());
+}
+
+void test_parallel_replays_match(void) {
+  std::vector<Capture> captures(16);
+  for (size_t i = 0; i < captures.size(); i++) {
+    std::string s;
+    for (int k = 0; k < 20; k++) {
+      s += std::to_string(k + 1) + "i " + std::to_string((i * 31 + k * 17) % 300) + "x " +
+           std::to_string((i * 7 + k * 29) % 220) + "y 30w 20h #" + std::to_string(1000 + i + k) + "C R ";
+    }
+    captures[i].load(s);
+  }
+  std::vector<uint64_t> one(captures.size()), many(captures.size());
+  WorkStealingPool(1).run(captures.size(), [&](size_t i, unsigned) {
+    Canvas565 canvas;
+    one[i] = replay(captures[i], canvas).hash;
+  });
+  WorkStealingPool(4).run(captures.size(), [&](size_t i, unsigned) {
+    Canvas565 canvas;
+    many[i] = replay(captures[i], canvas).hash;
+  });
+  for (size_t i = 0; i < captures.size(); i++) TEST_ASSERT_EQUAL_UINT64(one[i], many[i]);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_every_job_once);
+  RUN_TEST(test_uneven_jobs_are_stolen);
+  RUN_TEST(test_parallel_replays_match);
+  return UNITY_END();
+}
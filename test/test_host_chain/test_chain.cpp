@@ -0,0 +1,102 @@
+/*
+ * Daisy chained displays (src/ChainLink.h), simulated on the PC
+ * (host/ChainSim.h): frames reach the node they are addressed to, and only
+ * it, binary frames get through unparsed, and replies and touches come back
+ * tagged with the node they came from.
+ * Run on the PC: pio test -e native
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "ChainSim.h"
+#include "PrintSinks.h"
+
+#include <string>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static std::string frame(int node, const std::string& body) {
+  return "~" + std::to_string(node) + "," + std::to_string(body.size()) + ":" + body;
+}
+
+static uint64_t alone(const std::string& cmds) {
+  Canvas565 canvas;
+  canvas.setRotation(1);
+  TouchManager tm;
+  tm.begin(&canvas);
+  NullPrint out;
+  CommandParser parser(tm, &canvas, out);
+  for (unsigned char ch : cmds) parser.feed(ch);
+  return canvas.hash();
+}
+
+void test_frames_reach_their_node(void) {
+  ChainSim chain(4);
+  std::string scene[4];
+  for (int i = 0; i < 4; i++) {
+    scene[i] = std::to_string(i + 1) + "i " + std::to_string(20 + 30 * i) + "x 40y 25w 25h #f800C R ";
+  }
+  chain.send("~*:#7e0C 5i 200x 150y 20d O\n"); //every node
+  for (int i = 3; i >= 0; i--) chain.send("~" + std::to_string(i) + ":" + scene[i] + "\n");
+  chain.run();
+  for (int i = 0; i < 4; i++) {
+    TEST_ASSERT_EQUAL(2, chain.nodes[i]->manager.shapes().size());
+    TEST_ASSERT_TRUE(chain.nodes[i]->canvas.hash() == alone("#7e0C 5i 200x 150y 20d O\n" + scene[i] + "\n"));
+  }
+  TEST_ASSERT_EQUAL(0, chain.nodes[3]->link->forwardedDown); //the end of the chain
+}
+
+void test_binary_frames_pass_unparsed(void) {
+  ChainSim chain(3);
+  // a V packet whose samples include '~', ':' and newlines
+  std::string v = "9i 10x 10y 200w 100h #ffe0C V";
+  const uint8_t packet[] = {0, 1, 4, 0, '~', 0, '\n', 0, ':', 0, '~', 1};
+  v.append((const char*)packet, sizeof(packet));
+  v += " ";
+  chain.send(frame(2, v));
+  chain.run();
+  TEST_ASSERT_EQUAL(0, chain.nodes[0]->manager.shapes().size());
+  TEST_ASSERT_EQUAL(0, chain.nodes[1]->manager.shapes().size());
+  TEST_ASSERT_TRUE(chain.nodes[2]->canvas.hash() == alone(v));
+  TEST_ASSERT_EQUAL(v.size(), chain.nodes[0]->link->forwardedDown); //the body, as it was
+  TEST_ASSERT_EQUAL(v.size(), chain.nodes[1]->link->forwardedDown);
+}
+
+void test_replies_and_touches_come_back_tagged(void) {
+  ChainSim chain(3);
+  chain.send(frame(2, "3i 100x 100y 50w 50h R 7Q "));
+  std::string back = chain.run();
+  TEST_ASSERT_TRUE(back.find("~2,") == 0); //node 2's echo and reply
+  TEST_ASSERT_TRUE(back.find("Q:7") != std::string::npos);
+
+  TEST_ASSERT_EQUAL(3, chain.touch(2, 120, 120));
+  chain.touch(0, 5, 5);
+  back = chain.run();
+  TEST_ASSERT_TRUE(back.find("~0,12:-1@ X:5Y:5\r\n") != std::string::npos); //the nearer one first
+  TEST_ASSERT_TRUE(back.find("~2,16: 3@ X:120Y:120\r\n") != std::string::npos); //after the rest of its echo
+}
+
+void test_plain_bytes_are_for_the_first_node(void) {
+  ChainSim chain(2);
+  chain.send("1i 10x 10y 20w 20h R 7Q ");
+  std::string back = chain.run();
+  TEST_ASSERT_EQUAL(1, chain.nodes[0]->manager.shapes().size());
+  TEST_ASSERT_EQUAL(0, chain.nodes[1]->manager.shapes().size());
+  TEST_ASSERT_TRUE(back.find("~") == std::string::npos); //a single display, as before
+  TEST_ASSERT_TRUE(back.find("Q:7") != std::string::npos);
+  TEST_ASSERT_FALSE(chain.nodes[0]->link->framed());
+  chain.send("~5 not a header\n");
+  chain.run();
+  TEST_ASSERT_FALSE(chain.nodes[0]->link->framed());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_frames_reach_their_node);
+  RUN_TEST(test_binary_frames_pass_unparsed);
+  RUN_TEST(test_replies_and_touches_come_back_tagged);
+  RUN_TEST(test_plain_bytes_are_for_the_first_node);
+  return UNITY_END();
+}
@@ -0,0 +1,341 @@
+/*
+ * Unit tests for the graph data in TouchManager.h: the window min and max
+ * against a brute force scan as the ring wraps, the autoscale hysteresis, the
+ * binary 'V' packets (CommandParser.h) as they are decoded, the trigger going
+ * from armed to capturing to holdoff, the overlay label only redrawn when
+ * its digits change, and series numbers out of range refused.
+ * Run on the PC: pio test -e native
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "TouchManager.h"
+#include "CommandParser.h"
+#include "Canvas565.h"
+#include "PrintSinks.h"
+
+#include <algorithm>
+#include <string>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static std::string samples(const GraphSeries& s) {
+  std::string out;
+  for (size_t i = 0; i < s.size(); i++) out += std::to_string(s.at(i)) + " ";
+  return out;
+}
+
+/**
+ * @brief A canvas that keeps the text printed on it, so labels can be read back.
+ */
+class TextCanvas : public Canvas565 {
+public:
+  std::string text;
+  size_t write(uint8_t c) override {
+    text += (char)c;
+    return Canvas565::write(c);
+  }
+  using Canvas565::write;
+};
+
+static void send(CommandParser& parser, const std::string& bytes) {
+  for (unsigned char ch : bytes) parser.feed(ch);
+}
+
+static std::string packet(std::initializer_list<uint8_t> bytes) {
+  return std::string(bytes.begin(), bytes.end());
+}
+
+/**
+ * @brief The min, max and last labels of each series of a graph, one after the other.
+ */
+static std::string labels(TouchManager& tm, TextCanvas& canvas, int id, size_t count) {
+  const uint8_t all = OVERLAY_MIN | OVERLAY_MAX | OVERLAY_LAST;
+  for (size_t i = 1; i < count; i++) tm.styleGraph(id, i, 0, 0, all);
+  canvas.text.clear();
+  tm.styleGraph(id, 0, 0, 0, all); //redraws every label
+  return canvas.text;
+}
+
+void test_window_min_max_brute_force(void) {
+  for (size_t capacity : {1, 2, 7, 64}) {
+    GraphSeries s(capacity);
+    uint32_t rng = 12345;
+    for (int n = 0; n < 2000; n++) {
+      rng = rng * 1103515245 + 12345;
+      int16_t v = (int16_t)((rng >> 16) % 200) - 100;
+      if (n % 300 > 250) v = 7; //runs of equal values
+      s.push(v);
+      int lo = INT16_MAX, hi = INT16_MIN;
+      int32_t sum = 0;
+      for (size_t i = 0; i < s.size(); i++) {
+        lo = std::min(lo, (int)s.at(i));
+        hi = std::max(hi, (int)s.at(i));
+        sum += s.at(i);
+      }
+      TEST_ASSERT_EQUAL(std::min((size_t)n + 1, capacity), s.size());
+      TEST_ASSERT_EQUAL(v, s.last());
+      TEST_ASSERT_EQUAL(lo, s.minimum());
+      TEST_ASSERT_EQUAL(hi, s.maximum());
+      TEST_ASSERT_EQUAL(sum / (int32_t)s.size(), s.mean());
+    }
+    s.clear();
+    s.push(-3);
+    TEST_ASSERT_EQUAL(-3, s.minimum());
+    TEST_ASSERT_EQUAL(-3, s.maximum());
+  }
+}
+
+void test_autoscale_hysteresis(void) {
+  GraphSeries s(4);
+  TEST_ASSERT_FALSE(s.rescale(10)); //no data
+  s.push(0);
+  s.push(100);
+  TEST_ASSERT_TRUE(s.rescale(10)); //span 100, 10 either side
+  TEST_ASSERT_EQUAL(-10, s.lo);
+  TEST_ASSERT_EQUAL(110, s.hi);
+  s.push(50);
+  TEST_ASSERT_FALSE(s.rescale(10));
+  s.push(105); //inside the margin
+  TEST_ASSERT_FALSE(s.rescale(10));
+  s.push(120); //0 slides out, and 120 is past the top
+  TEST_ASSERT_TRUE(s.rescale(10));
+  TEST_ASSERT_EQUAL(43, s.lo); //50 - 7
+  TEST_ASSERT_EQUAL(127, s.hi); //120 + 7
+  s.push(60);
+  s.push(70); //60..120: shrunk, but not by enough to move
+  TEST_ASSERT_FALSE(s.rescale(10));
+  s.push(75);
+  TEST_ASSERT_FALSE(s.rescale(10));
+  s.push(90); //60..90, well inside
+  TEST_ASSERT_TRUE(s.rescale(10));
+  TEST_ASSERT_EQUAL(57, s.lo);
+  TEST_ASSERT_EQUAL(93, s.hi);
+  s.clear();
+  TEST_ASSERT_FALSE(s.rescale(10));
+}
+
+void test_append_clamps_and_adds_series(void) {
+  TouchGraphs g(1, 3, 0);
+  const int first[] = {40000, -5};
+  TEST_ASSERT_TRUE(g.append(first, 2)); //free running: always something to draw
+  TEST_ASSERT_EQUAL(2, g.series.size());
+  TEST_ASSERT_EQUAL(INT16_MAX, g.series[0].last());
+  const int second[] = {-40000, 1, 2};
+  g.append(second, 3); //a third series starts here
+  TEST_ASSERT_EQUAL(3, g.series.size());
+  TEST_ASSERT_EQUAL(INT16_MIN, g.series[0].last());
+  TEST_ASSERT_EQUAL(1, g.series[2].size());
+}
+
+void test_append_graph_columns(void) {
+  TextCanvas canvas;
+  TouchManager tm;
+  tm.begin(&canvas);
+  TEST_ASSERT_FALSE(tm.beginGraph(10, 10, 8, 40, C565_WHITE, true, 0)); //needs a group id
+  TEST_ASSERT_FALSE(tm.beginGraph(10, 10, 0, 40, C565_WHITE, true, 4)); //and a width
+  TEST_ASSERT_TRUE(tm.beginGraph(10, 10, 8, 40, C565_WHITE, true, 4));
+  const int16_t columns[][2] = {{10, -1}, {4660, -32768}, {32767, 5}};
+  for (const auto& column : columns) TEST_ASSERT_TRUE(tm.appendGraph(4, column, 2));
+  TEST_ASSERT_FALSE(tm.appendGraph(5, columns[0], 2)); //no such graph
+  // the labels show what each series holds
+  tm.styleGraph(4, 1, 0, 0, OVERLAY_MIN | OVERLAY_MAX | OVERLAY_LAST);
+  TEST_ASSERT_EQUAL_STRING("v-32768 ^5 =5", canvas.text.c_str());
+  canvas.text.clear();
+  tm.styleGraph(4, 0, 0, 0, OVERLAY_MIN | OVERLAY_MEAN);
+  TEST_ASSERT_EQUAL_STRING("v10 ~12479 v-32768 ^5 =5", canvas.text.c_str());
+  tm.clearAll();
+  TEST_ASSERT_FALSE(tm.appendGraph(4, columns[0], 2));
+}
+
+void test_more_graphs_than_buckets(void) {
+  TouchManager tm;
+  const int count = GRAPH_BUCKETS * 3;
+  for (int id = 1; id <= count; id++) TEST_ASSERT_TRUE(tm.beginGraph(0, 0, 4, 10, C565_WHITE, true, id));
+  for (int id = 1; id <= count; id++) {
+    const int16_t v = id;
+    TEST_ASSERT_TRUE(tm.appendGraph(id, &v, 1));
+  }
+  TEST_ASSERT_FALSE(tm.appendGraph(count + 1, nullptr, 0));
+  tm.clearAll();
+  TEST_ASSERT_FALSE(tm.appendGraph(1, nullptr, 0));
+}
+
+void test_binary_int16(void) {
+  TextCanvas canvas;
+  TouchManager tm;
+  tm.begin(&canvas);
+  StringPrint out;
+  CommandParser parser(tm, &canvas, out);
+  // 2 series, 3 columns, little endian, the extremes too
+  send(parser, "4i 10x 10y 8w 40h V" +
+       packet({0, 2, 3, 0, 10, 0, 0xff, 0xff, 0x34, 0x12, 0x00, 0x80, 0xff, 0x7f, 5, 0}) + " ");
+  TEST_ASSERT_FALSE(parser.binary());
+  TEST_ASSERT_EQUAL_STRING("v10 ^32767 =32767v-32768 ^5 =5", labels(tm, canvas, 4, 2).c_str());
+  TEST_ASSERT_TRUE(out.data.find("Error") == std::string::npos);
+  tm.clearAll();
+}
+
+void test_binary_int8_deltas(void) {
+  TextCanvas canvas;
+  TouchManager tm;
+  tm.begin(&canvas);
+  StringPrint out;
+  CommandParser parser(tm, &canvas, out);
+  send(parser, "5i 10x 10y 8w 40h V" + packet({1, 2, 3, 0, 5, 0xfe, 0xfb, 3, 0x7f, 0x80}) + " ");
+  TEST_ASSERT_EQUAL_STRING("v0 ^127 =127v-127 ^1 =-127", labels(tm, canvas, 5, 2).c_str());
+  // the next packet goes on from the last column
+  send(parser, "V" + packet({1, 2, 1, 0, 1, 1}) + " ");
+  TEST_ASSERT_EQUAL_STRING("v0 ^128 =128v-127 ^1 =-126", labels(tm, canvas, 5, 2).c_str());
+  // an int16 packet sets the base for deltas after it
+  send(parser, "V" + packet({0, 2, 1, 0, 0xe8, 0x03, 0x18, 0xfc}) + "V" + packet({1, 2, 1, 0, 0xff, 1}) + " ");
+  TEST_ASSERT_EQUAL_STRING("v0 ^1000 =999v-1000 ^1 =-999", labels(tm, canvas, 5, 2).c_str());
+  tm.clearAll();
+}
+
+void test_binary_bad_header(void) {
+  const std::string bad[] = {packet({2, 1, 1, 0}), packet({0, 0, 1, 0}), packet({1, 17, 1, 0})};
+  for (const std::string& header : bad) {
+    TextCanvas canvas;
+    TouchManager tm;
+    tm.begin(&canvas);
+    StringPrint out;
+    CommandParser parser(tm, &canvas, out);
+    send(parser, "6i 10x 10y 8w 40h V" + header + "9i 100x 100y 5w 5h R ");
+    TEST_ASSERT_FALSE(parser.binary());
+    TEST_ASSERT_TRUE(out.data.find("Error: bad V header") != std::string::npos);
+    TEST_ASSERT_EQUAL(9, tm.findGroupIDAt(102, 102)); //what follows is parsed
+    TEST_ASSERT_EQUAL_STRING("", labels(tm, canvas, 6, 1).c_str()); //no samples
+    tm.clearAll();
+  }
+  // no columns is a packet, not an error
+  TextCanvas canvas;
+  TouchManager tm;
+  tm.begin(&canvas);
+  StringPrint out;
+  CommandParser parser(tm, &canvas, out);
+  send(parser, "6i 10x 10y 8w 40h V" + packet({0, 3, 0, 0}) + "9i 100x 100y 5w 5h R ");
+  TEST_ASSERT_TRUE(out.data.find("Error") == std::string::npos);
+  TEST_ASSERT_EQUAL(9, tm.findGroupIDAt(102, 102));
+  tm.clearAll();
+}
+
+void test_trigger_states(void) {
+  TouchGraphs g(1, 5, 0);
+  g.trigger(TRIGGER_RISING, 10, 3, 2); //2 samples from before, 3 held off after
+  auto push = [&](int a, int b) {
+    const int column[] = {a, b};
+    return g.append(column, 2);
+  };
+  TEST_ASSERT_EQUAL(TouchGraphs::ARMED, g.trigState);
+  TEST_ASSERT_FALSE(push(0, 100));
+  TEST_ASSERT_FALSE(push(1, 101));
+  TEST_ASSERT_FALSE(push(12, 102)); //rises past 10
+  TEST_ASSERT_EQUAL(TouchGraphs::CAPTURING, g.trigState);
+  TEST_ASSERT_EQUAL_STRING("0 1 12 ", samples(g.series[0]).c_str()); //from before, then the trigger
+  TEST_ASSERT_EQUAL_STRING("100 101 102 ", samples(g.series[1]).c_str()); //the other series with it
+  TEST_ASSERT_FALSE(push(5, 103)); //falling doesn't matter now
+  TEST_ASSERT_TRUE(push(20, 104)); //the window is full: draw it
+  TEST_ASSERT_EQUAL(TouchGraphs::HOLDOFF, g.trigState);
+  TEST_ASSERT_EQUAL_STRING("0 1 12 5 20 ", samples(g.series[0]).c_str());
+
+  TEST_ASSERT_FALSE(push(0, 0)); //held off, would trigger otherwise
+  TEST_ASSERT_FALSE(push(50, 0));
+  TEST_ASSERT_FALSE(push(0, 0));
+  TEST_ASSERT_EQUAL(TouchGraphs::ARMED, g.trigState);
+  TEST_ASSERT_EQUAL_STRING("0 1 12 5 20 ", samples(g.series[0]).c_str()); //still shown
+
+  TEST_ASSERT_FALSE(push(30, 200)); //the first sample after arming has nothing to rise from
+  TEST_ASSERT_EQUAL(TouchGraphs::ARMED, g.trigState);
+  TEST_ASSERT_FALSE(push(3, 201));
+  TEST_ASSERT_FALSE(push(4, 202));
+  TEST_ASSERT_FALSE(push(10, 203)); //reaching the level is enough
+  TEST_ASSERT_EQUAL(TouchGraphs::CAPTURING, g.trigState);
+  TEST_ASSERT_EQUAL_STRING("3 4 10 ", samples(g.series[0]).c_str()); //only the last 2 from before
+
+  g.trigger(TRIGGER_FALLING, 0, 0, 0);
+  TEST_ASSERT_FALSE(push(5, 0));
+  TEST_ASSERT_FALSE(push(-5, 0));
+  TEST_ASSERT_EQUAL_STRING("-5 ", samples(g.series[0]).c_str());
+  for (int i = 0; i < 3; i++) TEST_ASSERT_FALSE(push(i, 0));
+  TEST_ASSERT_TRUE(push(9, 0));
+  TEST_ASSERT_EQUAL(TouchGraphs::ARMED, g.trigState); //no holdoff: armed again at once
+
+  g.trigger(TRIGGER_OFF, 0, 0, 0);
+  TEST_ASSERT_TRUE(push(1, 1)); //free running
+}
+
+void test_overlay_label_cached(void) {
+  TextCanvas canvas;
+  TouchManager tm;
+  tm.begin(&canvas);
+  TEST_ASSERT_TRUE(tm.beginGraph(0, 0, 50, 40, C565_WHITE, true, 3));
+  auto add = [&](int16_t v) {
+    canvas.text.clear();
+    tm.appendGraph(3, &v, 1);
+    tm.drawGraph(3);
+    return canvas.text;
+  };
+  add(10);
+  add(50);
+  canvas.text.clear();
+  TEST_ASSERT_TRUE(tm.styleGraph(3, 0, 0, 0, OVERLAY_MIN | OVERLAY_MAX));
+  TEST_ASSERT_EQUAL_STRING("v10 ^50 ", canvas.text.c_str()); //drawn in full
+
+  TEST_ASSERT_EQUAL_STRING("", add(30).c_str()); //min and max as they were: the label is left alone
+  TEST_ASSERT_EQUAL_STRING("", add(10).c_str());
+  TEST_ASSERT_EQUAL_STRING("v10 ^60 ", add(60).c_str());
+  TEST_ASSERT_EQUAL_STRING("", add(60).c_str());
+
+  canvas.text.clear();
+  tm.styleGraph(3, 0, 0, 0, OVERLAY_LAST);
+  TEST_ASSERT_EQUAL_STRING("=60", canvas.text.c_str()); //restyled: drawn again
+  TEST_ASSERT_EQUAL_STRING("=61", add(61).c_str()); //a different digit
+  TEST_ASSERT_EQUAL_STRING("", add(61).c_str());
+
+  tm.styleGraph(3, 0, 0, 0, 0);
+  TEST_ASSERT_EQUAL_STRING("", add(70).c_str()); //no overlays, no label
+  tm.clearAll();
+}
+
+void test_style_series_in_range(void) {
+  TextCanvas canvas;
+  TouchManager tm;
+  tm.begin(&canvas);
+  StringPrint out;
+  CommandParser parser(tm, &canvas, out);
+  send(parser, "3i 10x 10y 8w 40h 1,2G ");
+  TEST_ASSERT_TRUE(tm.styleGraph(3, GRAPH_MAX_SERIES - 1, 0, 0, 0));
+  TEST_ASSERT_FALSE(tm.styleGraph(3, GRAPH_MAX_SERIES, 0, 0, 0));
+  TEST_ASSERT_FALSE(tm.styleGraph(3, -1, 0, 0, 0));
+  out.data.clear();
+  send(parser, "1000n U ");
+  parser.attr[LTR('n')] = -1; //what a number too big for an int can end up as
+  send(parser, "U ");
+  size_t first = out.data.find("Error: U needs a graph id and a series n from 0 to 15");
+  TEST_ASSERT_TRUE(first != std::string::npos);
+  TEST_ASSERT_TRUE(out.data.find("Error: U", first + 1) != std::string::npos);
+  for (const auto& shape : tm.shapes()) {
+    if (shape->type() == 'G') {
+      TEST_ASSERT_EQUAL(GRAPH_MAX_SERIES, static_cast<const TouchGraph&>(*shape).data->series.size());
+    }
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_window_min_max_brute_force);
+  RUN_TEST(test_autoscale_hysteresis);
+  RUN_TEST(test_append_clamps_and_adds_series);
+  RUN_TEST(test_append_graph_columns);
+  RUN_TEST(test_more_graphs_than_buckets);
+  RUN_TEST(test_binary_int16);
+  RUN_TEST(test_binary_int8_deltas);
+  RUN_TEST(test_binary_bad_header);
+  RUN_TEST(test_trigger_states);
+  RUN_TEST(test_overlay_label_cached);
+  RUN_TEST(test_style_series_in_range);
+  return UNITY_END();
+}
@@ -0,0 +1,119 @@
+/*
+ * Touch lookups while another thread builds and clears scenes (src/HitIndex.h):
+ * they must never block, crash or see a shape that isn't (or wasn't just) there,
+ * and cleared shapes must outlive any lookup that could see them.
+ * Best run under -fsanitize=thread or address as well.
+ * Run on the PC: pio test -e native
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "TouchManager.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static const int LAYERS = 40; //shapes per scene, all over (100, 100), group IDs 1 to LAYERS
+
+void test_lookups_during_scene_changes(void) {
+  TouchManager tm;
+  const int READERS = 3;
+  std::atomic<bool> done(false);
+  std::atomic<uint32_t> lookups[READERS], wrong[READERS];
+  std::thread readers[READERS];
+  for (int r = 0; r < READERS; r++) {
+    lookups[r] = 0;
+    wrong[r] = 0;
+    readers[r] = std::thread([&, r]() {
+      while (!done) {
+        // reader 0 as the touch core does; the others straight on the index, as
+        // the perf counters findGroupIDAt adds to are for one reader
+        int id = r == 0 ? tm.findGroupIDAt(100, 100, 0) : tm.hitIndex().find(100, 100, r);
+        if (id != -1 && (id < 1 || id > LAYERS)) wrong[r]++;
+        if (tm.hitIndex().find(400, 400, r) != -1) wrong[r]++; //off every shape
+        lookups[r]++;
+      }
+    });
+  }
+
+  for (int scene = 0; scene < 300; scene++) { //this thread writes
+    for (int k = 0; k < LAYERS; k++) {
+      switch (k % 3) {
+        case 0: tm.addRect(0, 0, 200 + k, 200, C565_RED, true, k + 1); break;
+        case 1: tm.addCircle(100, 100, 50 + k, C565_GREEN, true, k + 1); break;
+        default: tm.addPolygon({{0, 0}, {300, 0}, {300, 300}, {0, 300}}, C565_BLUE, true, k + 1); break;
+      }
+      if (k % 8 == 0) std::this_thread::yield(); //let the readers in, even on one core
+    }
+    tm.clearAll();
+  }
+  done = true;
+  for (auto& t : readers) t.join();
+
+  for (int r = 0; r < READERS; r++) {
+    TEST_ASSERT_EQUAL(0, wrong[r].load());
+    TEST_ASSERT_GREATER_THAN(0, lookups[r].load());
+  }
+  tm.clearAll();
+  TEST_ASSERT_EQUAL(0, tm.hitIndex().retired()); //all freed once the readers were gone
+}
+
+void test_cleared_shapes_outlive_readers(void) {
+  TouchManager tm;
+  tm.addRect(10, 10, 50, 50, C565_RED, true, 7);
+  std::weak_ptr<TouchShape> shape = tm.shapes()[0];
+
+  tm.hitIndex().enter(2); //a lookup in progress on another core
+  tm.clearAll();
+  TEST_ASSERT_EQUAL(0, tm.shapes().size());
+  TEST_ASSERT_FALSE(shape.expired());
+  TEST_ASSERT_GREATER_THAN(0, tm.hitIndex().retired());
+  tm.addRect(0, 0, 5, 5, C565_RED, true, 8);
+  TEST_ASSERT_FALSE(shape.expired());
+
+  tm.hitIndex().leave(2);
+  tm.addRect(0, 0, 5, 5, C565_RED, true, 9);
+  TEST_ASSERT_TRUE(shape.expired());
+  TEST_ASSERT_EQUAL(0, tm.hitIndex().retired());
+  TEST_ASSERT_EQUAL(9, tm.findGroupIDAt(2, 2));
+  TEST_ASSERT_EQUAL(-1, tm.findGroupIDAt(20, 20));
+}
+
+void test_lookup_time_doesnt_depend_on_the_writer(void) {
+  TouchManager tm;
+  for (int k = 0; k < LAYERS; k++) tm.addRect(k, k, 10, 10, C565_RED, true, k + 1);
+  auto time = [&]() {
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < 20000; i++) tm.hitIndex().find(300, 200, 1);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  };
+  double idle = time();
+  // the same scene, with the writer adding and clearing on top of it
+  std::atomic<bool> done(false);
+  std::thread writer([&]() {
+    while (!done) {
+      for (int k = 0; k < 100; k++) tm.addCircle(300, 200, 4, C565_GREEN, true, 0);
+      tm.clearAll();
+      for (int k = 0; k < LAYERS; k++) tm.addRect(k, k, 10, 10, C565_RED, true, k + 1);
+    }
+  });
+  double busy = time();
+  done = true;
+  writer.join();
+  // lookups only ever see the scene, which grows to at most LAYERS + 100 shapes;
+  // generous, as threads share cores with everything else on a build machine
+  TEST_ASSERT_TRUE(busy < idle * 20 + 0.05);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_lookups_during_scene_changes);
+  RUN_TEST(test_cleared_shapes_outlive_readers);
+  RUN_TEST(test_lookup_time_doesnt_depend_on_the_writer);
+  return UNITY_END();
+}
@@ -0,0 +1,152 @@
+/*
+ * Checks every src/PixelKernels.h implementation this CPU can run gives the
+ * same pixels as the scalar one, for all lengths and alignments, and that
+ * the canvas fills and blits with them correctly in every rotation.
+ * Run on the PC: pio test -e native
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "PixelKernels.h"
+#include "Canvas565.h"
+
+using namespace PixelKernels;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static const size_t SPAN = 300, GUARD = 8;
+
+static uint32_t rngState = 7;
+static uint16_t rnd16() {
+  rngState = rngState * 1664525u + 1013904223u;
+  return rngState >> 16;
+}
+
+// Source pixels, a quarter of them the key colour
+static void randomPixels(std::vector<uint16_t>& v, uint16_t key) {
+  for (auto& p : v) p = (rnd16() & 3) ? rnd16() : key;
+}
+
+/**
+ * @brief Runs op with the scalar and the other kernels on the same input,
+ * at every dst and src offset (alignment) and length up to SPAN, and
+ * compares the whole buffer, guard pixels around the span included.
+ */
+static void compareAll(const char* what,
+                       void (*op)(const Kernels&, uint16_t* dst, const uint16_t* src, size_t n)) {
+  std::vector<uint16_t> src(SPAN + 2 * GUARD), start(SPAN + 2 * GUARD), want, got;
+  randomPixels(src, 0xF81F);
+  randomPixels(start, 0xF81F);
+  for (const Kernels* const* k = available(); *k; k++) {
+    for (size_t dstOff = 0; dstOff < 4; dstOff++) {
+      for (size_t srcOff = 0; srcOff < 4; srcOff++) {
+        for (size_t n = 0; n <= SPAN; n += (n < 70 ? 1 : 23)) {
+          want = start;
+          got = start;
+          op(scalarKernels(), &want[GUARD + dstOff], &src[GUARD + srcOff], n);
+          op(**k, &got[GUARD + dstOff], &src[GUARD + srcOff], n);
+          if (want != got) {
+            char msg[96];
+            snprintf(msg, sizeof(msg), "%s %s n=%zu dst+%zu src+%zu", (*k)->name, what, n, dstOff, srcOff);
+            TEST_FAIL_MESSAGE(msg);
+          }
+        }
+      }
+    }
+  }
+}
+
+void test_fill(void) {
+  compareAll("fill16", [](const Kernels& k, uint16_t* dst, const uint16_t*, size_t n) { k.fill16(dst, 0xA5C3, n); });
+}
+
+void test_copy(void) {
+  compareAll("copy16", [](const Kernels& k, uint16_t* dst, const uint16_t* src, size_t n) { k.copy16(dst, src, n); });
+}
+
+void test_blit_key(void) {
+  compareAll("blitKey16", [](const Kernels& k, uint16_t* dst, const uint16_t* src, size_t n) {
+    k.blitKey16(dst, src, n, 0xF81F);
+  });
+}
+
+void test_swap(void) {
+  compareAll("swap16", [](const Kernels& k, uint16_t* dst, const uint16_t* src, size_t n) { k.swap16(dst, src, n); });
+  // in place, as used before sending a buffer
+  for (const Kernels* const* k = available(); *k; k++) {
+    std::vector<uint16_t> v = {0x1234, 0xABCD, 0x00FF, 0xFF00, 0x0001, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13};
+    k[0]->swap16(v.data(), v.data(), v.size());
+    TEST_ASSERT_EQUAL_HEX16(0x3412, v[0]);
+    TEST_ASSERT_EQUAL_HEX16(0xCDAB, v[1]);
+    TEST_ASSERT_EQUAL_HEX16(0x0D00, v[17]);
+  }
+}
+
+void test_best_is_available(void) {
+  const Kernels* last = nullptr;
+  for (const Kernels* const* k = available(); *k; k++) last = *k;
+  TEST_ASSERT_EQUAL_PTR(last, &best());
+  TEST_ASSERT_EQUAL_STRING("scalar", available()[0]->name);
+}
+
+// The canvas fills through the kernels; check that against pixel by pixel
+void test_canvas_fill_rotations(void) {
+  for (uint8_t r = 0; r < 4; r++) {
+    Canvas565 canvas;
+    canvas.setRotation(r);
+    canvas.fillRect(-5, 7, 40, 13, 0x1234);
+    canvas.fillRect(canvas.width() - 3, canvas.height() - 2, 10, 10, 0x4321);
+    for (int16_t y = 0; y < canvas.height(); y++) {
+      for (int16_t x = 0; x < canvas.width(); x++) {
+        uint16_t want = (x < 35 && y >= 7 && y < 20) ? 0x1234
+                        : (x >= canvas.width() - 3 && y >= canvas.height() - 2) ? 0x4321 : 0;
+        if (canvas.getPixel(x, y) != want) {
+          char msg[64];
+          snprintf(msg, sizeof(msg), "rotation %d at %d,%d", r, x, y);
+          TEST_FAIL_MESSAGE(msg);
+        }
+      }
+    }
+    TEST_ASSERT_EQUAL_UINT64(35 * 13 + 3 * 2, canvas.writes);
+  }
+}
+
+void test_canvas_bitmap_rotations(void) {
+  const int16_t w = 7, h = 5;
+  uint16_t pixels[w * h];
+  for (int i = 0; i < w * h; i++) pixels[i] = (i % 3) ? 0x100 + i : 0xF81F;
+  for (uint8_t r = 0; r < 4; r++) {
+    Canvas565 canvas;
+    canvas.setRotation(r);
+    canvas.fillScreen(0x0007);
+    canvas.resetWrites();
+    canvas.drawRGBBitmapKeyed(-2, 3, pixels, w, h, 0xF81F);
+    canvas.drawRGBBitmap(50, 60, pixels, w, h);
+    uint64_t keyed = 0;
+    for (int16_t j = 0; j < h; j++) {
+      for (int16_t i = 0; i < w; i++) {
+        uint16_t p = pixels[j * w + i];
+        TEST_ASSERT_EQUAL_HEX16(p, canvas.getPixel(50 + i, 60 + j));
+        if (i >= 2) {
+          TEST_ASSERT_EQUAL_HEX16(p == 0xF81F ? 0x0007 : p, canvas.getPixel(i - 2, 3 + j));
+          keyed += p != 0xF81F;
+        }
+      }
+    }
+    TEST_ASSERT_EQUAL_UINT64(keyed + w * h, canvas.writes);
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_fill);
+  RUN_TEST(test_copy);
+  RUN_TEST(test_blit_key);
+  RUN_TEST(test_swap);
+  RUN_TEST(test_best_is_available);
+  RUN_TEST(test_canvas_fill_rotations);
+  RUN_TEST(test_canvas_bitmap_rotations);
+  return UNITY_END();
+}
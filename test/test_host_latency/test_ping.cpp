@@ -0,0 +1,134 @@
+/*
+ * Checks the 'Q' ping and 'N' time sync replies of the command parser.
+ * Run on the PC: pio test -e native
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "CommandParser.h"
+#include "Canvas565.h"
+#include "PrintSinks.h"
+
+#include <regex>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void send(CommandParser& parser, const char* s) {
+  while (*s) parser.feed(*s++);
+}
+
+void test_ping_times_last_command(void) {
+  Canvas565 canvas;
+  TouchManager tm;
+  tm.begin(&canvas);
+  StringPrint out;
+  CommandParser parser(tm, &canvas, out);
+  send(parser, "\n ");
+  uint32_t before = micros();
+  send(parser, "1");
+  uint32_t first = micros();
+  while (micros() - first < 2000) {} //so the first byte's time stands apart
+  send(parser, "i 10x 10y 200w 100h #07e0C R 42Q");
+  uint32_t after = micros();
+
+  std::smatch m;
+  TEST_ASSERT_TRUE(std::regex_search(out.data, m, std::regex("Q:42 s:(\\d+) e:(\\d+) r:(\\d+) d:(\\d+)")));
+  uint32_t s = std::stoul(m[1]), e = std::stoul(m[2]), r = std::stoul(m[3]), d = std::stoul(m[4]);
+  // s is the '1' that began the rect: not the whitespace before, the 'C' or the ping
+  TEST_ASSERT_GREATER_OR_EQUAL(before, s);
+  TEST_ASSERT_LESS_OR_EQUAL(first, s);
+  TEST_ASSERT_LESS_OR_EQUAL(e, s);
+  TEST_ASSERT_LESS_OR_EQUAL(d, e);
+  TEST_ASSERT_LESS_OR_EQUAL(after, d);
+  TEST_ASSERT_LESS_OR_EQUAL(e - s, r); // drawing is part of the command
+  TEST_ASSERT_EQUAL(1, tm.perf.renders(PerfCounters::shapeSlot('R')));
+
+  // the next ping times the first one
+  out.data.clear();
+  send(parser, "7Q");
+  TEST_ASSERT_TRUE(std::regex_search(out.data, m, std::regex("Q:7 s:(\\d+) e:(\\d+) r:0 d:")));
+  TEST_ASSERT_GREATER_OR_EQUAL(e, (uint32_t)std::stoul(m[1]));
+
+  // the newline after a ping (as tools/latency.py sends) doesn't start the next command
+  send(parser, "\n");
+  uint32_t later = micros();
+  while (micros() - later < 2000) {}
+  out.data.clear();
+  send(parser, "2i 10x 120y 20w 20h R 8Q");
+  TEST_ASSERT_TRUE(std::regex_search(out.data, m, std::regex("Q:8 s:(\\d+) e:")));
+  TEST_ASSERT_GREATER_OR_EQUAL(later, (uint32_t)std::stoul(m[1]));
+}
+
+void test_ping_waits_for_the_pipeline(void) {
+  Canvas565 canvas;
+  TouchManager tm;
+  tm.begin(&canvas);
+  StringPrint out;
+  Pipeline pipeline;
+  RenderLoop renderLoop(pipeline, tm, &canvas);
+  pipeline.sameCore = &renderLoop; //as main.cpp without dualcore, nothing drawn until asked
+  CommandParser parser(tm, &canvas, out);
+  parser.pipeline = &pipeline;
+  uint32_t before = micros();
+  send(parser, "1i 0x 0y 320w 240h #07e0C R 2i 0x 0y 320w 240h #f800C R ");
+  TEST_ASSERT_EQUAL(2, pipeline.commands.size()); //queued, not drawn
+  send(parser, "42Q");
+  uint32_t after = micros();
+  TEST_ASSERT_TRUE(pipeline.idle());
+
+  std::smatch m;
+  TEST_ASSERT_TRUE(std::regex_search(out.data, m, std::regex("Q:42 s:(\\d+) e:(\\d+) r:(\\d+) d:(\\d+)")));
+  uint32_t s = std::stoul(m[1]), e = std::stoul(m[2]), r = std::stoul(m[3]), d = std::stoul(m[4]);
+  TEST_ASSERT_GREATER_OR_EQUAL(before, s);
+  TEST_ASSERT_LESS_OR_EQUAL(e, s);
+  TEST_ASSERT_LESS_OR_EQUAL(d, e);
+  TEST_ASSERT_LESS_OR_EQUAL(after, d);
+  TEST_ASSERT_TRUE(r > 0); //the fill, done after the command was parsed
+  TEST_ASSERT_EQUAL_UINT32(tm.perf.totalRenderUs(), r);
+  TEST_ASSERT_LESS_OR_EQUAL(e - s, r);
+
+  // the next ping times the first, which queued nothing
+  out.data.clear();
+  send(parser, "43Q");
+  TEST_ASSERT_TRUE(std::regex_search(out.data, m, std::regex("Q:43 s:(\\d+) e:(\\d+) r:0 d:")));
+}
+
+void test_time_sync(void) {
+  TouchManager tm;
+  StringPrint out;
+  CommandParser parser(tm, nullptr, out);
+  send(parser, "N");
+  std::smatch m;
+  TEST_ASSERT_TRUE(std::regex_search(out.data, m, std::regex("N:(\\d+)")));
+  TEST_ASSERT_FALSE(parser.timeSynced());
+  TEST_ASSERT_EQUAL_UINT32(1234, parser.hostTime(1234)); // not synced, the device clock
+
+  send(parser, "2147483000N");
+  TEST_ASSERT_TRUE(parser.timeSynced());
+  TEST_ASSERT_EQUAL_UINT32(2147483000 + 100, parser.hostTime(100));
+  TEST_ASSERT_EQUAL_UINT32(352, parser.hostTime(1000)); // wraps at 2^31
+
+  // a bare N asks again, without losing the offset
+  send(parser, "N");
+  TEST_ASSERT_TRUE(parser.timeSynced());
+  TEST_ASSERT_EQUAL_UINT32(2147483100, parser.hostTime(100));
+
+  // 0 is an offset too, back to the device clock
+  send(parser, "0N");
+  TEST_ASSERT_TRUE(parser.timeSynced());
+  TEST_ASSERT_EQUAL_UINT32(100, parser.hostTime(100));
+
+  // digits taken by an attribute aren't the offset
+  send(parser, "5x N");
+  TEST_ASSERT_EQUAL_UINT32(100, parser.hostTime(100));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_ping_times_last_command);
+  RUN_TEST(test_ping_waits_for_the_pipeline);
+  RUN_TEST(test_time_sync);
+  return UNITY_END();
+}
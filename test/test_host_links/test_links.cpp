@@ -0,0 +1,195 @@
+/*
+ * Several host links on one display (src/HostLinks.h): bytes interleaved
+ * between links don't mix, group IDs can be kept apart, and touches and
+ * errors go back to the link they belong to.
+ * Run on the PC: pio test -e native
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "HostLinks.h"
+#include "Canvas565.h"
+
+#include <string>
+
+/**
+ * @brief A link fed from a string, one byte per available() at most
+ * `trickle` at a time, so links take turns mid command.
+ */
+class StringTransport : public Transport {
+public:
+  std::string in, out;
+  size_t pos = 0;
+
+  const char* name() const override { return "string"; }
+  int available() override { return in.size() - pos; }
+  int read() override { return pos < in.size() ? (uint8_t)in[pos++] : -1; }
+  int peek() override { return pos < in.size() ? (uint8_t)in[pos] : -1; }
+  size_t write(uint8_t b) override { out += (char)b; return 1; }
+  using Print::write;
+};
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// A scene on one half of the screen, with groups 1 to 3 and a binary packet for graph 4
+static std::string scene(int x0) {
+  std::string s;
+  for (int i = 0; i < 3; i++) {
+    s += std::to_string(i + 1) + "i " + std::to_string(x0 + 10 + 40 * i) + "x 20y 30w 30h #f800C R ";
+    s += std::to_string(x0 + 25 + 40 * i) + "x 90y 12d #7e0C O ";
+    s += "\"label " + std::to_string(x0) + "\" T ";
+  }
+  s += "4i " + std::to_string(x0 + 10) + "x 130y 120w 80h #ffe0C V";
+  const uint8_t packet[] = {0, 2, 3, 0, 10, 0, 200, 0, 30, 0, 180, 0, 60, 0, 150, 0};
+  s.append((const char*)packet, sizeof(packet));
+  return s + " ";
+}
+
+static void run(HostLinks& links) {
+  while (links.available()) links.feed(1);
+  links.poll();
+}
+
+void test_interleaved_links_dont_mix(void) {
+  for (bool pipelined : {false, true}) {
+    Canvas565 alone;
+    alone.setRotation(1);
+    TouchManager tm1;
+    tm1.begin(&alone);
+    HostLinks one(tm1, &alone);
+    StringTransport a1, b1;
+    a1.in = scene(0);
+    b1.in = scene(160);
+    one.add(a1);
+    run(one);
+    one.add(b1, true);
+    run(one);
+
+    Canvas565 together;
+    together.setRotation(1);
+    TouchManager tm2;
+    tm2.begin(&together);
+    HostLinks two(tm2, &together);
+    StringTransport a2, b2;
+    a2.in = a1.in;
+    b2.in = b1.in;
+    two.add(a2);
+    two.add(b2, true);
+    Pipeline pipeline;
+    RenderLoop render(pipeline, tm2, &together);
+    if (pipelined) {
+      pipeline.sameCore = &render;
+      two.setPipeline(&pipeline);
+    }
+    run(two); //a byte from each in turn
+    pipeline.drain();
+
+    TEST_ASSERT_EQUAL(tm1.shapes().size(), tm2.shapes().size());
+    TEST_ASSERT_TRUE(alone.hash() == together.hash());
+    TEST_ASSERT_EQUAL_STRING(a1.out.c_str(), a2.out.c_str()); //the echo
+    TEST_ASSERT_EQUAL_STRING(b1.out.c_str(), b2.out.c_str());
+  }
+}
+
+void test_touches_go_to_the_owner(void) {
+  TouchManager tm;
+  HostLinks links(tm, nullptr);
+  StringTransport plc, laptop;
+  plc.in = "1i 0x 0y 50w 50h R ";
+  laptop.in = "1i 100x 0y 50w 50h R 2i 200x 0y 50w 50h R ";
+  links.add(plc);
+  links.add(laptop, true);
+  run(links);
+
+  for (int x : {10, 110, 210, 300}) {
+    int id = tm.findGroupIDAt(x, 10);
+    links.touch(id, x, 10, 0);
+  }
+  TEST_ASSERT_EQUAL_STRING("1@ X:10Y:10\r\n-1@ X:300Y:10\r\n", plc.out.c_str() + plc.in.size());
+  TEST_ASSERT_EQUAL_STRING("1@ X:110Y:10\r\n2@ X:210Y:10\r\n-1@ X:300Y:10\r\n",
+                           laptop.out.c_str() + laptop.in.size());
+  TEST_ASSERT_EQUAL(1, links.owner(tm.findGroupIDAt(110, 10)));
+  TEST_ASSERT_EQUAL(-1, links.owner(tm.findGroupIDAt(10, 10)));
+}
+
+void test_shared_touches_when_asked(void) {
+  TouchManager tm;
+  HostLinks links(tm, nullptr);
+  StringTransport plc, laptop, tablet;
+  plc.in = "1i 0x 0y 50w 50h R ";
+  links.add(plc);
+  links.add(laptop, true);
+  links.add(tablet, true, true);
+  run(links);
+
+  links.touch(tm.findGroupIDAt(10, 10), 10, 10, 0);
+  TEST_ASSERT_EQUAL_STRING("1@ X:10Y:10\r\n", plc.out.c_str() + plc.in.size());
+  TEST_ASSERT_EQUAL_STRING("", laptop.out.c_str());
+  TEST_ASSERT_EQUAL_STRING("1@ X:10Y:10\r\n", tablet.out.c_str());
+}
+
+void test_ids_past_the_namespace_are_refused(void) {
+  TouchManager tm;
+  HostLinks links(tm, nullptr);
+  StringTransport plc, laptop;
+  plc.in = "10005i 0x 0y 50w 50h R ";
+  laptop.in = "10001i 100x 0y 50w 50h R ";
+  links.add(plc);
+  links.add(laptop, true);
+  run(links);
+
+  TEST_ASSERT_TRUE(plc.out.find("Error: group id over 9999") != std::string::npos);
+  TEST_ASSERT_TRUE(laptop.out.find("Error: group id over 9999") != std::string::npos);
+  TEST_ASSERT_EQUAL(2, tm.shapes().size());
+  TEST_ASSERT_EQUAL(-1, tm.findGroupIDAt(10, 10)); //drawn, without a group
+  TEST_ASSERT_EQUAL(-1, tm.findGroupIDAt(110, 10)); //not 2 * GROUP_NAMESPACE + 1, no other link's
+  plc.out.clear();
+  laptop.out.clear();
+  links.touch(tm.findGroupIDAt(10, 10), 10, 10, 0);
+  TEST_ASSERT_EQUAL_STRING("-1@ X:10Y:10\r\n", plc.out.c_str());
+  TEST_ASSERT_EQUAL_STRING("-1@ X:10Y:10\r\n", laptop.out.c_str()); //nothing there, every link
+}
+
+void test_errors_go_back_to_the_sender(void) {
+  TouchManager tm;
+  HostLinks links(tm, nullptr);
+  StringTransport a, b;
+  a.in = "5i 10x 10y 50w 50h 1,2G ";
+  b.in = "5i 0n 2m U 9i 1n U ";
+  links.add(a);
+  links.add(b, true);
+  Pipeline pipeline;
+  RenderLoop render(pipeline, tm, nullptr);
+  pipeline.sameCore = &render;
+  links.setPipeline(&pipeline);
+  run(links);
+  pipeline.drain();
+  links.poll();
+  // 5 is a graph for a, not for b, and there is no 9
+  TEST_ASSERT_TRUE(a.out.find("Error") == std::string::npos);
+  size_t first = b.out.find("Error: U needs a graph id");
+  TEST_ASSERT_TRUE(first != std::string::npos);
+  TEST_ASSERT_TRUE(b.out.find("Error: U needs a graph id", first + 1) != std::string::npos);
+}
+
+void test_link_limit(void) {
+  TouchManager tm;
+  HostLinks links(tm, nullptr);
+  StringTransport t[PIPELINE_LINKS + 1];
+  for (int i = 0; i < PIPELINE_LINKS; i++) TEST_ASSERT_NOT_NULL(links.add(t[i], i % 2));
+  TEST_ASSERT_NULL(links.add(t[PIPELINE_LINKS]));
+  TEST_ASSERT_EQUAL(2 * GROUP_NAMESPACE, links.parser(3).groupBase);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_interleaved_links_dont_mix);
+  RUN_TEST(test_touches_go_to_the_owner);
+  RUN_TEST(test_shared_touches_when_asked);
+  RUN_TEST(test_ids_past_the_namespace_are_refused);
+  RUN_TEST(test_errors_go_back_to_the_sender);
+  RUN_TEST(test_link_limit);
+  return UNITY_END();
+}
@@ -0,0 +1,85 @@
+/*
+ * Checks the per pixel and per shape accounting of host/OverdrawCanvas.h.
+ * Run on the PC: pio test -e native
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "OverdrawCanvas.h"
+#include "TouchManager.h"
+
+TouchManager* manager;
+OverdrawCanvas* canvas;
+
+void setUp(void) {
+  manager = new TouchManager();
+  canvas = new OverdrawCanvas();
+  canvas->setRotation(1);
+  manager->observer = canvas;
+
+  manager->addRect(10, 10, 50, 50, C565_GREEN, true, 1);   // 2500 pixels
+  manager->addRect(30, 30, 10, 10, C565_RED, true, 2);     // all on top of 1
+  manager->addRect(200, 100, 20, 20, C565_BLUE, true, 3);  // on its own
+}
+
+void tearDown(void) {
+  delete manager;
+  delete canvas;
+}
+
+void test_counts(void) {
+  manager->drawAll(canvas);
+  TEST_ASSERT_EQUAL(1, canvas->count(10, 10));
+  TEST_ASSERT_EQUAL(2, canvas->count(35, 35));
+  TEST_ASSERT_EQUAL(0, canvas->count(100, 10));
+  TEST_ASSERT_EQUAL_UINT64(2500 + 400, canvas->pixelsWritten(1));
+  TEST_ASSERT_EQUAL_UINT64(100, canvas->pixelsWritten(2));
+  TEST_ASSERT_EQUAL(2, canvas->maxCount());
+}
+
+void test_ranking(void) {
+  manager->drawAll(canvas);
+  std::vector<ShapeWrites> ranked = canvas->ranking();
+  TEST_ASSERT_EQUAL(3, ranked.size());
+  TEST_ASSERT_EQUAL(1, ranked[0].id); // the one underneath lost 100 pixels
+  TEST_ASSERT_EQUAL('R', ranked[0].type);
+  TEST_ASSERT_EQUAL_UINT64(2500, ranked[0].written);
+  TEST_ASSERT_EQUAL_UINT64(2400, ranked[0].visible);
+  TEST_ASSERT_EQUAL_UINT64(100, ranked[0].wasted());
+  TEST_ASSERT_EQUAL_UINT64(0, ranked[1].wasted());
+  TEST_ASSERT_EQUAL(10, ranked[0].x0);
+  TEST_ASSERT_EQUAL(59, ranked[0].y1);
+}
+
+void test_regions(void) {
+  manager->begin(canvas);
+  canvas->beginRegion();
+  manager->addRect(0, 0, 20, 20, C565_WHITE, true, 4); // over the corner of 1
+  TEST_ASSERT_EQUAL_UINT64(400, canvas->regionWrites);
+  TEST_ASSERT_EQUAL_UINT64(400, canvas->regionPixels);
+  TEST_ASSERT_EQUAL(19, canvas->regionX1);
+  canvas->beginRegion();
+  canvas->fillRect(5, 5, 10, 10, C565_BLACK);
+  canvas->fillRect(5, 5, 10, 10, C565_BLACK);
+  TEST_ASSERT_EQUAL_UINT64(200, canvas->regionWrites);
+  TEST_ASSERT_EQUAL_UINT64(100, canvas->regionPixels);
+}
+
+void test_graph_observed(void) {
+  manager->begin(canvas);
+  manager->addGraph(100, 150, 50, 40, C565_GREEN, true, 9, {1, 2}, 0);
+  const std::vector<ShapeWrites>& shapes = canvas->finish();
+  TEST_ASSERT_EQUAL('G', shapes.back().type);
+  TEST_ASSERT_EQUAL(9, shapes.back().id);
+  TEST_ASSERT_GREATER_THAN(0, shapes.back().written);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_counts);
+  RUN_TEST(test_ranking);
+  RUN_TEST(test_regions);
+  RUN_TEST(test_graph_observed);
+  return UNITY_END();
+}
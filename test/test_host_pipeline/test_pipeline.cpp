@@ -0,0 +1,241 @@
+/*
+ * The dual core pipeline (src/Pipeline.h), with a std::thread for core 1:
+ * the queue keeps order under load, and a stream drawn through the pipeline
+ * gives the same frame and replies as one drawn on a single core, also with
+ * the render side on the same thread; the drawing counted on the core that
+ * drew.
+ * Run on the PC: pio test -e native
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "CommandParser.h"
+#include "Canvas565.h"
+#include "PrintSinks.h"
+
+#include <string>
+#include <thread>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_queue_keeps_order(void) {
+  SpscQueue<uint32_t, 64> queue;
+  const uint32_t count = 500000;
+  std::thread producer([&]() {
+    uint32_t next = 0, batch[7];
+    while (next < count) {
+      size_t n = 1 + next % 7;
+      if (n > count - next) n = count - next;
+      for (size_t i = 0; i < n; i++) batch[i] = next + i;
+      if (queue.write(batch, n)) {
+        next += n;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+  uint32_t expected = 0, wrong = 0, v;
+  while (expected < count) {
+    if (queue.pop(v)) {
+      if (v != expected) wrong++;
+      expected++;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+  TEST_ASSERT_EQUAL(0, wrong);
+  TEST_ASSERT_EQUAL(0, queue.size());
+}
+
+// Every command that goes through the pipeline, and failures to send back
+static std::string stream() {
+  std::string s = "Z ";
+  for (int i = 0; i < 300; i++) {
+    s += std::to_string(1 + i % 30) + "i " + std::to_string((i * 37) % 300) + "x " +
+         std::to_string((i * 53) % 220) + "y ";
+    switch (i % 5) {
+      case 0: s += "20w 10h #f800C R "; break;
+      case 1: s += "12d #7e0C O "; break;
+      case 2: s += "P 40x P 30y P #ffe0C S "; break;
+      case 3: s += "\"label " + std::to_string(i) + "\" T "; break;
+      default: s += "P 60x 200y P L "; break;
+    }
+  }
+  s += "50i 10x 10y 200w 80h #7e0C 10a 1,20G 2,30G 3,40G 50i 1n #1fC 2m 9v U 77i U ";
+  s += "51i 120x 100y 100w 40h 1k 50l 4p K 51i 10G 90G 20G 0w 52i K ";
+  s += "53i 10x 170y 80w 30h V";
+  const uint8_t packet[] = {1, 2, 3, 0, 10, 246, 5, 5, 250, 6};
+  s.append((const char*)packet, sizeof(packet));
+  s += " 1?";
+  return s;
+}
+
+void test_same_frame_as_one_core(void) {
+  const std::string cmds = stream();
+
+  Canvas565 single;
+  single.setRotation(1);
+  TouchManager tm1;
+  tm1.begin(&single);
+  StringPrint out1;
+  CommandParser parser1(tm1, &single, out1);
+  for (unsigned char ch : cmds) parser1.feed(ch);
+
+  Canvas565 dual;
+  dual.setRotation(1);
+  TouchManager tm2;
+  tm2.begin(&dual);
+  StringPrint out2;
+  CommandParser parser2(tm2, &dual, out2);
+  Pipeline pipeline;
+  parser2.pipeline = &pipeline;
+  RenderLoop render(pipeline, tm2, &dual);
+  std::atomic<bool> stop(false);
+  std::thread core1([&]() { render.run(stop); });
+  uint32_t t0 = micros();
+  for (unsigned char ch : cmds) parser2.feed(ch);
+  pipeline.drain();
+  stop = true;
+  core1.join();
+  uint32_t elapsed = micros() - t0;
+  parser2.poll();
+
+  TEST_ASSERT_EQUAL(tm1.shapes().size(), tm2.shapes().size());
+  TEST_ASSERT_TRUE(single.hash() == dual.hash());
+  TEST_ASSERT_TRUE(pipeline.idle());
+  for (const char* error : {"Error: U needs a graph id", "Error: K needs a group id and width"}) {
+    TEST_ASSERT_TRUE(out1.data.find(error) != std::string::npos);
+    TEST_ASSERT_TRUE(out2.data.find(error) != std::string::npos);
+  }
+  // the drawing is counted on core 1, and not taken off core 0's parse time
+  for (int i = 0; i < PerfCounters::SHAPES; i++) {
+    TEST_ASSERT_EQUAL(tm1.perf.renders(i), tm2.perf.renders(i));
+    TEST_ASSERT_EQUAL(0, tm2.perf.drawing[0].renders[i]);
+  }
+  TEST_ASSERT_GREATER_THAN(0, tm2.perf.coreRenderUs(1));
+  TEST_ASSERT_LESS_OR_EQUAL(elapsed, tm2.perf.parseUs);
+}
+
+// Core 1 finishes a long shape while core 0 is in the middle of a byte.
+class Core1Draws : public Print {
+ public:
+  explicit Core1Draws(TouchManager& tm) : tm(tm) {}
+  size_t write(uint8_t) override {
+    if (!drawn) {
+      drawn = true;
+      std::thread core1([this]() {
+        setThisCore(1);
+        tm.perf.render('R', 1000000);
+      });
+      core1.join();
+    }
+    return 1;
+  }
+  using Print::write;
+  TouchManager& tm;
+  bool drawn = false;
+};
+
+void test_parse_time_leaves_core1_alone(void) {
+  TouchManager tm;
+  Core1Draws out(tm);
+  CommandParser parser(tm, nullptr, out);
+  uint32_t t0 = micros();
+  for (const char* c = "1?"; *c; c++) parser.feed(*c);
+  uint32_t elapsed = micros() - t0;
+  TEST_ASSERT_TRUE(out.drawn);
+  TEST_ASSERT_EQUAL_UINT32(1000000, tm.perf.coreRenderUs(1));
+  TEST_ASSERT_LESS_OR_EQUAL(elapsed, tm.perf.parseUs); //none of it taken off, no wrap
+}
+
+void test_trace_ring_per_core(void) {
+  traceBuffer(0).clear(); //of anything traced above, with MERGIF_TRACE
+  traceBuffer(1).clear();
+  traceBuffer(0).record(TRACE_PARSE, 'R', 10, 20);
+  std::thread core1([]() {
+    setThisCore(1);
+    TraceScope draw(TRACE_DRAW, 'R');
+  });
+  core1.join();
+  TEST_ASSERT_EQUAL_UINT32(1, traceBuffer(0).size());
+  TEST_ASSERT_EQUAL_UINT32(1, traceBuffer(1).size());
+  StringPrint out;
+  traceDump(out);
+  TEST_ASSERT_EQUAL(6 + 2 * 10, out.data.size());
+  TEST_ASSERT_EQUAL_STRING("MTRC", out.data.substr(0, 4).c_str());
+  TEST_ASSERT_EQUAL(2, out.data[4]);
+  TEST_ASSERT_EQUAL(TRACE_PARSE, out.data[6 + 8]);
+  TEST_ASSERT_EQUAL(TRACE_DRAW | TRACE_CORE1, (uint8_t)out.data[16 + 8]);
+  TEST_ASSERT_EQUAL_UINT32(0, traceBuffer(0).size() + traceBuffer(1).size());
+}
+
+void test_too_long_is_refused(void) {
+  TouchManager tm;
+  StringPrint out;
+  CommandParser parser(tm, nullptr, out);
+  Pipeline pipeline;
+  parser.pipeline = &pipeline;
+  RenderLoop render(pipeline, tm, nullptr);
+  std::string s = "1i \"" + std::string(PIPELINE_PAYLOAD + 100, 'x') + "\" T ";
+  for (size_t i = 0; i <= PIPELINE_PAYLOAD / sizeof(GFXPoint); i++) s += "P";
+  s += "2i S 3i \"ok\" T ";
+  std::atomic<bool> stop(false);
+  std::thread core1([&]() { render.run(stop); });
+  for (unsigned char ch : s) parser.feed(ch);
+  pipeline.drain();
+  stop = true;
+  core1.join();
+  TEST_ASSERT_TRUE(out.data.find("Error: T too long") != std::string::npos);
+  TEST_ASSERT_TRUE(out.data.find("Error: S too long") != std::string::npos);
+  TEST_ASSERT_EQUAL(1, tm.shapes().size()); //only what came after
+  const TouchText& text = static_cast<const TouchText&>(*tm.shapes()[0]);
+  TEST_ASSERT_EQUAL_STRING("ok", text.text.c_str());
+}
+
+void test_same_core(void) {
+  // one thread, the render side stepped by the parser when the queues fill
+  const std::string cmds = stream();
+  Canvas565 single;
+  single.setRotation(1);
+  TouchManager tm1;
+  tm1.begin(&single);
+  StringPrint out1;
+  CommandParser parser1(tm1, &single, out1);
+  for (unsigned char ch : cmds) parser1.feed(ch);
+
+  Canvas565 queued;
+  queued.setRotation(1);
+  TouchManager tm2;
+  tm2.begin(&queued);
+  StringPrint out2;
+  CommandParser parser2(tm2, &queued, out2);
+  Pipeline pipeline;
+  RenderLoop render(pipeline, tm2, &queued);
+  pipeline.sameCore = &render;
+  parser2.pipeline = &pipeline;
+  for (unsigned char ch : cmds) {
+    parser2.feed(ch);
+    if (ch == 'R') render.step(); //now and then, as the render task does
+  }
+  pipeline.drain();
+  parser2.poll();
+
+  TEST_ASSERT_GREATER_THAN(0, pipeline.stalls);
+  TEST_ASSERT_TRUE(pipeline.idle());
+  TEST_ASSERT_TRUE(single.hash() == queued.hash());
+  TEST_ASSERT_TRUE(out2.data.find("Error: U needs a graph id") != std::string::npos);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_queue_keeps_order);
+  RUN_TEST(test_same_frame_as_one_core);
+  RUN_TEST(test_parse_time_leaves_core1_alone);
+  RUN_TEST(test_trace_ring_per_core);
+  RUN_TEST(test_too_long_is_refused);
+  RUN_TEST(test_same_core);
+  return UNITY_END();
+}
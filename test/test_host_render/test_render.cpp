@@ -0,0 +1,139 @@
+/*
+ * Golden image tests: command streams are rendered into a RAM canvas on the
+ * host, and each frame is compared with the hash of a known good one.
+ * Run on the PC: pio test -e native
+ *
+ * When a drawing change is meant to change a frame, look at it with
+ *   .pio/build/render/program -o frame.png   (see README, Host rendering)
+ * and, if it is right, paste the new hash and pixel count below.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "Canvas565.h"
+#include "TouchManager.h"
+#include "CommandParser.h"
+#include "PrintSinks.h"
+
+struct Golden {
+  const char* name;
+  const char* stream;
+  uint64_t hash;   // Canvas565::hash() of the frame
+  uint64_t writes; // pixels written
+};
+
+static const Golden goldens[] = {
+  {"rect", "1i 10x 10y 50w 40h #07e0C R",
+    0x192d7c957438af65ull, 2000},
+  {"circles", "2i 100x 120y 40d #001fC O 3i 130x 120y 25d #f800C O",
+    0xb5e6284cf369e5cdull, 1802},
+  {"polygon", "4i 200x 20y P 300x 60y P 220x 110y P #ffe0C S 0i 10x 200y P 300x 230y P #ffffC L",
+    0x297b86a925794777ull, 564},
+  {"text", "5i 20x 150y 1h #ffffC \"Hello MERGIF\" T",
+    0xea10475df36d56d5ull, 808},
+  {"graph", "6i 10x 10y 100w 60h #07e0C 0,0G 10,40G 20,30G 30,20G 40,10G 50,0G",
+    0x37dad3a5913c4a9dull, 36368},
+  {"scene", "Z 1i 0x 0y 320w 20h #39e7C R 2i 5x 5y 1h #ffffC \"Title\" T "
+            "3i 60x 100y 30d #07e0C O 4i 140x 70y 60w 60h #f800C R 5i 230x 80y P 300x 80y P 265x 140y P #001fC S",
+    0xb9e64fc7d2c6fdc8ull, 88106},
+};
+
+static void render(const Golden& g, Canvas565& canvas) {
+  canvas.setRotation(1);
+  TouchManager manager;
+  manager.begin(&canvas);
+  NullPrint echo;
+  CommandParser parser(manager, &canvas, echo, 1);
+  for (const char* s = g.stream; *s; s++) parser.feed(*s);
+  parser.feed('\n');
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_goldens(void) {
+  bool ok = true;
+  for (const Golden& g : goldens) {
+    Canvas565 canvas;
+    render(g, canvas);
+    if (canvas.hash() != g.hash || canvas.writes != g.writes) {
+      std::string file = std::string("render_") + g.name + ".ppm";
+      canvas.writePPM(file.c_str());
+      printf("%s: hash 0x%016llx writes %llu (golden 0x%016llx, %llu), saved %s\n", g.name,
+             (unsigned long long)canvas.hash(), (unsigned long long)canvas.writes,
+             (unsigned long long)g.hash, (unsigned long long)g.writes, file.c_str());
+      ok = false;
+    }
+  }
+  TEST_ASSERT_TRUE_MESSAGE(ok, "frames differ from the goldens");
+}
+
+void test_rect_pixels(void) {
+  Canvas565 canvas;
+  render(goldens[0], canvas);
+  TEST_ASSERT_EQUAL_HEX16(C565_GREEN, canvas.getPixel(10, 10));
+  TEST_ASSERT_EQUAL_HEX16(C565_GREEN, canvas.getPixel(59, 49));
+  TEST_ASSERT_EQUAL_HEX16(0, canvas.getPixel(60, 50));
+  TEST_ASSERT_EQUAL_HEX16(0, canvas.getPixel(9, 10));
+}
+
+void test_rotation(void) {
+  Canvas565 canvas;
+  canvas.setRotation(1); // landscape, as main.cpp
+  TEST_ASSERT_EQUAL(320, canvas.width());
+  canvas.drawPixel(0, 0, 0x1234);
+  TEST_ASSERT_EQUAL_HEX16(0x1234, canvas.getBuffer()[239]); // top right of display memory
+  canvas.drawPixel(320, 0, 0xFFFF); // off screen
+  TEST_ASSERT_EQUAL_UINT64(1, canvas.writes);
+}
+
+void test_clipped_fill_counts(void) {
+  Canvas565 canvas;
+  canvas.setRotation(1);
+  canvas.fillRect(-10, -10, 20, 20, C565_WHITE);
+  TEST_ASSERT_EQUAL_UINT64(100, canvas.writes);
+  canvas.fillScreen(C565_BLACK);
+  TEST_ASSERT_EQUAL_UINT64(100 + 320 * 240, canvas.writes);
+}
+
+void test_z_attribute(void) {
+  // 'z' is the last letter, it must not run past attr into the parser's state
+  Canvas565 canvas;
+  canvas.setRotation(1);
+  TouchManager manager;
+  manager.begin(&canvas);
+  NullPrint echo;
+  CommandParser parser(manager, &canvas, echo, 1);
+  for (const char* s = "7z "; *s; s++) parser.feed(*s);
+  TEST_ASSERT_EQUAL(7, parser.attr[LTR('z')]);
+  TEST_ASSERT_FALSE(parser.quoting);
+  for (const char* s = goldens[3].stream; *s; s++) parser.feed(*s); // text, so quoting still works
+  parser.feed('\n');
+  TEST_ASSERT_EQUAL_HEX64(goldens[3].hash, canvas.hash());
+}
+
+void test_save(void) {
+  Canvas565 canvas;
+  canvas.setRotation(1);
+  TEST_ASSERT_TRUE(canvas.save("render_test.ppm"));
+  TEST_ASSERT_TRUE(canvas.save("render_test.png"));
+  FILE* f = fopen("render_test.ppm", "rb");
+  TEST_ASSERT_NOT_NULL(f);
+  fseek(f, 0, SEEK_END);
+  TEST_ASSERT_EQUAL(15 + 320 * 240 * 3, ftell(f)); // "P6\n320 240\n255\n"
+  fclose(f);
+  remove("render_test.ppm");
+  remove("render_test.png");
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_goldens);
+  RUN_TEST(test_rect_pixels);
+  RUN_TEST(test_rotation);
+  RUN_TEST(test_clipped_fill_counts);
+  RUN_TEST(test_z_attribute);
+  RUN_TEST(test_save);
+  return UNITY_END();
+}
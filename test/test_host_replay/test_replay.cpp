@@ -0,0 +1,81 @@
+/*
+ * Records a session with the device's SessionRecorder, then replays it
+ * with host/Replay.h. Run on the PC: pio test -e native
+ */
+
+#define MERGIF_RECORD
+#define RECORD_BYTES 96 // small, to see old records dropped
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "SessionRecorder.h"
+#include "Replay.h"
+#include "PrintSinks.h"
+
+static const char* scene = "1i 10x 10y 50w 40h #07e0C R";
+
+void setUp(void) {
+  sessionRecorder().clear();
+}
+
+void tearDown(void) {}
+
+void test_round_trip(void) {
+  for (const char* s = scene; *s; s++) RECORD_RX(*s);
+  RECORD_TOUCH(20, 300);
+  StringPrint out;
+  out.print("log before the dump ");
+  sessionRecorder().dump(out);
+
+  Capture capture;
+  TEST_ASSERT_TRUE(capture.load(out.data));
+  TEST_ASSERT_EQUAL(2, capture.records.size()); // the bytes came in together, so one record
+  TEST_ASSERT_EQUAL('R', capture.records[0].type);
+  TEST_ASSERT_EQUAL_STRING(scene, capture.records[0].data.c_str());
+  TEST_ASSERT_EQUAL('t', capture.records[1].type);
+  TEST_ASSERT_EQUAL(4, capture.records[1].data.size());
+  TEST_ASSERT_EQUAL(300, (uint8_t)capture.records[1].data[2] | ((uint8_t)capture.records[1].data[3] << 8));
+}
+
+void test_ring_drops_oldest(void) {
+  for (int i = 0; i < 30; i++) RECORD_TOUCH(i, i); // 10 bytes each
+  TEST_ASSERT_EQUAL(21, sessionRecorder().dropped);
+  StringPrint out;
+  sessionRecorder().dump(out);
+  Capture capture;
+  TEST_ASSERT_TRUE(capture.load(out.data));
+  TEST_ASSERT_EQUAL(9, capture.records.size());
+  TEST_ASSERT_EQUAL(21, (uint8_t)capture.records[0].data[0]); // whole records, oldest first
+}
+
+void test_cut_short(void) {
+  RECORD_TOUCH(1, 2);
+  StringPrint out;
+  sessionRecorder().dump(out);
+  Capture capture;
+  std::string error;
+  TEST_ASSERT_FALSE(capture.load(out.data.substr(0, out.data.size() - 1), &error));
+}
+
+void test_replay_matches(void) {
+  Capture capture;
+  capture.load(std::string(scene) + " 2i 100x 100y 20d #f800C O");
+  Canvas565 first, second;
+  ReplayResult a = replay(capture, first);
+  ReplayResult b = replay(capture, second);
+  TEST_ASSERT_EQUAL(4, a.commands); // C R C O
+  TEST_ASSERT_EQUAL_UINT64(a.hash, b.hash);
+  TEST_ASSERT_EQUAL_UINT64(a.pixels, b.pixels);
+  TEST_ASSERT_EQUAL_HEX16(C565_GREEN, first.getPixel(20, 20));
+  TEST_ASSERT_EQUAL(1, a.commandLatency['R'].us.size());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_ring_drops_oldest);
+  RUN_TEST(test_cut_short);
+  RUN_TEST(test_replay_matches);
+  return UNITY_END();
+}
@@ -0,0 +1,115 @@
+/*
+ * The cooperative scheduler loop() runs on (src/Scheduler.h), on a fake clock:
+ * tasks run on their period, when ready or when woken, in order, and idle
+ * knows how long it may sleep.
+ * Run on the PC: pio test -e native
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "Scheduler.h"
+
+#include <string>
+
+static uint32_t fakeUs;
+static uint32_t fakeClock() { return fakeUs; }
+
+static std::string ran;
+static int bytesWaiting;
+
+void setUp(void) {
+  fakeUs = 0;
+  ran.clear();
+  bytesWaiting = 0;
+}
+void tearDown(void) {}
+
+void test_periodic_tasks(void) {
+  Scheduler s(fakeClock);
+  s.add("fast", []() { ran += 'f'; }, 10);
+  s.add("slow", []() { ran += 's'; }, 25);
+  for (fakeUs = 0; fakeUs <= 50; fakeUs++) s.runOnce();
+  TEST_ASSERT_EQUAL_STRING("ffsfffs", ran.c_str()); //at 10 20 25 30 40 50 50, fast first
+  TEST_ASSERT_EQUAL(5, s.task(0).runs);
+  TEST_ASSERT_EQUAL(2, s.task(1).runs);
+}
+
+void test_no_burst_after_falling_behind(void) {
+  Scheduler s(fakeClock);
+  s.add("fast", []() { ran += 'f'; }, 10);
+  fakeUs = 95; //a long task elsewhere
+  s.runOnce();
+  s.runOnce();
+  TEST_ASSERT_EQUAL_STRING("f", ran.c_str());
+  TEST_ASSERT_EQUAL(10, s.untilDue());
+  fakeUs = 105;
+  s.runOnce();
+  TEST_ASSERT_EQUAL_STRING("ff", ran.c_str());
+}
+
+void test_ready_and_woken(void) {
+  Scheduler s(fakeClock);
+  s.add("ingest", []() { ran += 'i'; bytesWaiting = 0; }, 0, []() { return bytesWaiting > 0; });
+  int touch = s.add("touch", []() { ran += 't'; }, 0);
+  TEST_ASSERT_FALSE(s.runOnce());
+  TEST_ASSERT_FALSE(s.pending());
+  bytesWaiting = 3;
+  s.wake(touch);
+  TEST_ASSERT_TRUE(s.pending());
+  TEST_ASSERT_TRUE(s.runOnce());
+  TEST_ASSERT_FALSE(s.runOnce());
+  TEST_ASSERT_EQUAL_STRING("it", ran.c_str());
+  TEST_ASSERT_EQUAL(0xFFFFFFFF, s.untilDue());
+}
+
+void test_idle_sleeps_until_due(void) {
+  Scheduler s(fakeClock);
+  s.add("touch", []() { ran += 't'; }, 10000);
+  s.add("telemetry", []() { ran += 'm'; }, 100000);
+  fakeUs = 4000;
+  TEST_ASSERT_EQUAL(6000, s.untilDue());
+  s.loop(); //nothing to do: sleeps (on the PC, only counts)
+  TEST_ASSERT_EQUAL(1, s.sleeps);
+  fakeUs = 10000;
+  TEST_ASSERT_EQUAL(0, s.untilDue());
+  s.loop();
+  TEST_ASSERT_EQUAL_STRING("t", ran.c_str());
+  TEST_ASSERT_EQUAL(1, s.sleeps);
+  fakeUs = 19990; //too close to sleep
+  s.idle();
+  TEST_ASSERT_EQUAL(1, s.sleeps);
+}
+
+void test_idle_checks_ready_first(void) {
+  Scheduler s(fakeClock);
+  static int checks;
+  checks = 0;
+  s.add("ingest", []() { ran += 'i'; }, 0, []() { checks++; return bytesWaiting > 0; });
+  s.add("touch", []() { ran += 't'; }, 10000);
+  bytesWaiting = 1; //came in after the pass
+  s.idle();
+  TEST_ASSERT_EQUAL(0, s.sleeps); //doesn't sleep on it
+  TEST_ASSERT_EQUAL(1, checks);
+  bytesWaiting = 0;
+  s.idle();
+  TEST_ASSERT_EQUAL(1, s.sleeps);
+  TEST_ASSERT_FALSE(s.woken());
+}
+
+void test_task_limit(void) {
+  Scheduler s(fakeClock);
+  for (int i = 0; i < SCHEDULER_TASKS; i++) TEST_ASSERT_EQUAL(i, s.add("t", []() {}, 10));
+  TEST_ASSERT_EQUAL(-1, s.add("one too many", []() {}, 10));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_periodic_tasks);
+  RUN_TEST(test_no_burst_after_falling_behind);
+  RUN_TEST(test_ready_and_woken);
+  RUN_TEST(test_idle_sleeps_until_due);
+  RUN_TEST(test_idle_checks_ready_first);
+  RUN_TEST(test_task_limit);
+  return UNITY_END();
+}
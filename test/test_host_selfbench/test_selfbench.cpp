@@ -0,0 +1,61 @@
+/*
+ * Runs the 'J' self benchmark against a RAM canvas: it must print its
+ * result line and leave the screen and performance counters as they were.
+ * Run on the PC: pio test -e native
+ */
+
+#define MERGIF_RECORD
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "CommandParser.h"
+#include "Canvas565.h"
+#include "PrintSinks.h"
+
+#include <regex>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void send(CommandParser& parser, const char* s) {
+  while (*s) parser.feed(*s++);
+}
+
+void test_result_line(void) {
+  Canvas565 canvas;
+  canvas.setRotation(1);
+  TouchManager tm;
+  tm.begin(&canvas);
+  StringPrint out;
+  CommandParser parser(tm, &canvas, out);
+  send(parser, "1i 10x 10y 50w 40h #f800C R 2i 100x 80y 30d #07e0C O ");
+  uint64_t frame = canvas.hash();
+  uint32_t commands = tm.perf.commands[PerfCounters::opcodeSlot('R')];
+  uint32_t renders = tm.perf.renders(PerfCounters::shapeSlot('O'));
+  sessionRecorder().clear();
+
+  out.data.clear();
+  send(parser, "J");
+  std::smatch m;
+  TEST_ASSERT_TRUE(std::regex_search(out.data, m, std::regex(
+    "J:1 n:(\\d+) ins:(\\d+) draw:(\\d+) px:(\\d+) spi:(\\d+) hit:(\\d+) parse:(\\d+)\r?\n")));
+  TEST_ASSERT_EQUAL(78, std::stoi(m[1])); // 40 rects, 20 circles, 8 polygons, 8 labels, 2 graphs
+  TEST_ASSERT_GREATER_THAN(0, std::stoul(m[7]));
+
+  TEST_ASSERT_EQUAL_HEX64(frame, canvas.hash()); // the scene is back
+  TEST_ASSERT_EQUAL(2, tm.shapes().size());
+  TEST_ASSERT_EQUAL(commands, tm.perf.commands[PerfCounters::opcodeSlot('R')]);
+  TEST_ASSERT_EQUAL(renders, tm.perf.renders(PerfCounters::shapeSlot('O')));
+
+  // only the 'J' was received, the sample stream is not
+  StringPrint dump;
+  sessionRecorder().dump(dump);
+  TEST_ASSERT_LESS_THAN(32, dump.data.size());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_result_line);
+  return UNITY_END();
+}
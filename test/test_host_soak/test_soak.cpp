@@ -0,0 +1,90 @@
+/*
+ * Checks the host heap model (host/HeapShim.h) keeps its books straight,
+ * and runs a few windows of the soak test against it.
+ * Run on the PC: pio test -e native
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "HeapShim.h"
+#include "Soak.h"
+#include "PrintSinks.h"
+
+#include <cstring>
+#include <vector>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_blocks_dont_overlap(void) {
+  const size_t arena = 64 * 1024;
+  HeapShim heap(arena);
+  HeapStats empty = heap.stats();
+  TEST_ASSERT_EQUAL(1, empty.freeChunks);
+
+  struct Block { uint8_t* p; size_t n; uint8_t fill; };
+  std::vector<Block> live;
+  uint32_t rng = 5;
+  for (int i = 0; i < 20000; i++) {
+    rng = rng * 1664525u + 1013904223u;
+    if (live.empty() || (rng >> 16) % 3) {
+      size_t n = 1 + (rng >> 8) % 700;
+      uint8_t* p = (uint8_t*)heap.alloc(n);
+      if (!p) continue;
+      TEST_ASSERT_EQUAL(0, (uintptr_t)p % 16);
+      TEST_ASSERT_TRUE(heap.owns(p) && heap.owns(p + n - 1));
+      memset(p, i & 0xFF, n);
+      live.push_back({p, n, (uint8_t)(i & 0xFF)});
+    } else {
+      size_t k = (rng >> 4) % live.size();
+      Block b = live[k];
+      for (size_t j = 0; j < b.n; j++) {
+        if (b.p[j] != b.fill) TEST_FAIL_MESSAGE("a block was overwritten");
+      }
+      heap.release(b.p);
+      live[k] = live.back();
+      live.pop_back();
+    }
+    HeapStats s = heap.stats();
+    TEST_ASSERT_EQUAL(empty.freeBytes, s.freeBytes + s.liveBytes);
+    TEST_ASSERT_LESS_OR_EQUAL(s.freeBytes, s.largestFree);
+  }
+  TEST_ASSERT_GREATER_THAN(0, heap.failed); // it did fill up
+
+  for (auto& b : live) heap.release(b.p);
+  HeapStats s = heap.stats();
+  TEST_ASSERT_EQUAL(1, s.freeChunks); // all merged back into one
+  TEST_ASSERT_EQUAL(empty.largestFree, s.largestFree);
+  TEST_ASSERT_EQUAL(heap.allocs, heap.frees);
+}
+
+static HeapShim* statsFrom;
+static HeapStats shimStats() { return statsFrom->stats(); }
+
+void test_soak_windows(void) {
+  HeapShim heap(16 * 1024);
+  statsFrom = &heap;
+  TouchManager tm;
+  StringPrint out;
+  SoakTest soak(tm, nullptr, out, shimStats, 3);
+  int reports = 0;
+  while (soak.ops() < 5 * SOAK_WINDOW) {
+    reports += soak.step();
+    TEST_ASSERT_LESS_OR_EQUAL(SOAK_MAX_SHAPES, tm.shapes().size());
+  }
+  TEST_ASSERT_EQUAL(5, reports);
+  size_t lines = 0;
+  for (size_t at = 0; (at = out.data.find("#soak ops=", at)) != std::string::npos; at++) lines++;
+  TEST_ASSERT_EQUAL(5, lines);
+  TEST_ASSERT_TRUE(out.data.find("#soak ops=5000 ") != std::string::npos);
+  TEST_ASSERT_LESS_OR_EQUAL(soak.maxUs, soak.p99);
+  TEST_ASSERT_LESS_OR_EQUAL(soak.p99, soak.p50);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_blocks_dont_overlap);
+  RUN_TEST(test_soak_windows);
+  return UNITY_END();
+}
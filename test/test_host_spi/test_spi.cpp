@@ -0,0 +1,85 @@
+/*
+ * Checks the SPI cost model of the mock ILI9341 (host/MockILI9341.h)
+ * against what Adafruit_ILI9341 sends for the same calls.
+ * Run on the PC: pio test -e native
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "MockILI9341.h"
+#include "TouchManager.h"
+#include "CommandParser.h"
+#include "PrintSinks.h"
+
+MockILI9341* tft;
+
+void setUp(void) {
+  tft = new MockILI9341();
+  tft->setRotation(1);
+}
+
+void tearDown(void) {
+  delete tft;
+}
+
+void test_fill_rect(void) {
+  tft->fillRect(10, 10, 10, 10, C565_WHITE);
+  TEST_ASSERT_EQUAL_UINT64(3, tft->spi.commandBytes); // CASET, PASET, RAMWR
+  TEST_ASSERT_EQUAL_UINT64(8, tft->spi.dataBytes);
+  TEST_ASSERT_EQUAL_UINT64(200, tft->spi.pixelBytes);
+  TEST_ASSERT_EQUAL_UINT64(2, tft->spi.csToggles);
+  TEST_ASSERT_EQUAL_UINT64(6, tft->spi.dcToggles);
+  TEST_ASSERT_EQUAL_UINT64(1, tft->spi.windows);
+}
+
+void test_window_reuse(void) {
+  tft->fillRect(10, 10, 10, 10, C565_WHITE);
+  tft->fillRect(10, 30, 10, 10, C565_WHITE); // same columns, CASET is skipped
+  TEST_ASSERT_EQUAL_UINT64(5, tft->spi.commandBytes);
+  TEST_ASSERT_EQUAL_UINT64(12, tft->spi.dataBytes);
+  tft->drawPixel(5, 5, C565_RED);
+  tft->drawPixel(5, 5, C565_BLUE); // same window, only RAMWR
+  TEST_ASSERT_EQUAL_UINT64(5 + 3 + 1, tft->spi.commandBytes);
+  TEST_ASSERT_EQUAL_UINT64(12 + 8, tft->spi.dataBytes);
+  TEST_ASSERT_EQUAL_UINT64(200 + 200 + 4, tft->spi.pixelBytes);
+}
+
+void test_off_screen(void) {
+  tft->fillRect(400, 10, 10, 10, C565_WHITE);
+  tft->drawFastHLine(-20, 5, 10, C565_WHITE);
+  tft->drawPixel(-1, 0, C565_WHITE);
+  TEST_ASSERT_EQUAL_UINT64(0, tft->spi.bytes());
+  TEST_ASSERT_EQUAL_UINT64(0, tft->spi.csToggles);
+  tft->fillRect(-5, -5, 10, 10, C565_WHITE); // clipped to 5x5
+  TEST_ASSERT_EQUAL_UINT64(50, tft->spi.pixelBytes);
+}
+
+void test_bitmap(void) {
+  uint16_t pixels[4 * 3];
+  for (int i = 0; i < 12; i++) pixels[i] = i;
+  tft->drawRGBBitmap(100, 50, pixels, 4, 3);
+  TEST_ASSERT_EQUAL_UINT64(11 + 24, tft->spi.bytes());
+  TEST_ASSERT_EQUAL_HEX16(5, tft->getPixel(101, 51));
+  TEST_ASSERT_EQUAL_UINT64(11 + 24, tft->damageAsBitmap().bytes());
+}
+
+void test_parsed_rect(void) {
+  TouchManager manager;
+  manager.begin(tft);
+  NullPrint echo;
+  CommandParser parser(manager, tft, echo, 1);
+  for (const char* s = "1i 10x 10y 50w 40h #07e0C R"; *s; s++) parser.feed(*s);
+  TEST_ASSERT_EQUAL_UINT64(11 + 2 * 50 * 40, tft->spi.bytes());
+  TEST_ASSERT_EQUAL_HEX16(C565_GREEN, tft->getPixel(30, 30));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_fill_rect);
+  RUN_TEST(test_window_reuse);
+  RUN_TEST(test_off_screen);
+  RUN_TEST(test_bitmap);
+  RUN_TEST(test_parsed_rect);
+  return UNITY_END();
+}
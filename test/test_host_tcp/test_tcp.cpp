@@ -0,0 +1,270 @@
+/*
+ * The TCP link (src/TcpTransport.h) over loopback, on the POSIX sockets in
+ * host/SocketTcp.h: a stream gives the same frame as one fed straight in,
+ * a parser that falls behind holds the host back without losing bytes, and
+ * hosts take turns.
+ * Run on the PC: pio test -e native
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "CommandParser.h"
+#include "Canvas565.h"
+#include "HostLinks.h"
+#include "SocketTcp.h"
+#include "TcpTransport.h"
+#include "PrintSinks.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+typedef TcpTransport<PosixServer, PosixClient> Tcp;
+
+/**
+ * @brief A host that takes replies only as fast as room says.
+ */
+static std::atomic<int> room;
+
+class FakeClient {
+public:
+  FakeClient(bool open = false) : m_open(open) {}
+  explicit operator bool() const { return m_open; }
+  bool connected() { return m_open; }
+  int available() { return 0; }
+  int read(uint8_t*, size_t) { return -1; }
+  int availableForWrite() { return room.load(); }
+  size_t write(const uint8_t*, size_t size) {
+    size_t n = size < (size_t)room.load() ? size : room.load();
+    room -= n;
+    return n;
+  }
+  void stop() { m_open = false; }
+
+private:
+  bool m_open;
+};
+
+class FakeServer {
+public:
+  void begin() {}
+  FakeClient accept() { return FakeClient(!m_given++); }
+
+private:
+  int m_given = 0;
+};
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void sendAll(PosixClient& c, const std::string& data) {
+  for (size_t done = 0; done < data.size();) {
+    size_t n = c.write((const uint8_t*)data.data() + done, data.size() - done);
+    if (!n) std::this_thread::yield();
+    done += n;
+  }
+}
+
+void test_byte_ring(void) {
+  ByteRing<8> ring;
+  const uint8_t data[] = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+  TEST_ASSERT_EQUAL(6, ring.write(data, 6));
+  for (int i = 0; i < 5; i++) TEST_ASSERT_EQUAL(i + 1, ring.read());
+  TEST_ASSERT_EQUAL(7, ring.write(data, 9)); //room for 7, around the end
+  size_t n;
+  ring.front(n);
+  TEST_ASSERT_EQUAL(3, n); //6, 1, 2 before the end
+  ring.drop(3);
+  TEST_ASSERT_EQUAL(3, ring.read());
+  ring.back(n);
+  TEST_ASSERT_EQUAL(3, n); //4 free, 3 of them before the end
+  TEST_ASSERT_EQUAL(4, ring.size());
+}
+
+void test_same_frame_over_loopback(void) {
+  std::string cmds = "Z ";
+  for (int i = 0; i < 3000; i++) {
+    cmds += std::to_string(1 + i % 30) + "i " + std::to_string((i * 37) % 300) + "x " +
+            std::to_string((i * 53) % 220) + "y " + (i % 2 ? "20w 10h #f800C R " : "12d #7e0C O ");
+  }
+  cmds += "7Q ";
+
+  Canvas565 direct;
+  direct.setRotation(1);
+  TouchManager tm1;
+  tm1.begin(&direct);
+  NullPrint out;
+  CommandParser parser1(tm1, &direct, out);
+  for (unsigned char ch : cmds) parser1.feed(ch);
+
+  PosixServer server(0);
+  TEST_ASSERT_TRUE(server.begin());
+  Tcp link(server);
+  Canvas565 canvas;
+  canvas.setRotation(1);
+  TouchManager tm2;
+  tm2.begin(&canvas);
+  CommandParser parser2(tm2, &canvas, link);
+
+  std::string replies;
+  std::thread host([&]() {
+    PosixClient c = PosixClient::connect("127.0.0.1", server.port());
+    std::thread writer([&]() { sendAll(c, cmds); });
+    uint8_t buf[4096];
+    while (replies.find("Q:7") == std::string::npos) {
+      int n = c.read(buf, sizeof(buf));
+      if (n > 0) replies.append((const char*)buf, n);
+      else std::this_thread::yield();
+    }
+    writer.join();
+  });
+  while (link.bytesIn < cmds.size()) {
+    if (!parser2.feed(link, 64)) std::this_thread::yield();
+  }
+  link.flush();
+  host.join();
+
+  TEST_ASSERT_TRUE(direct.hash() == canvas.hash());
+  TEST_ASSERT_TRUE(replies.find("Q:7 s:") != std::string::npos);
+  TEST_ASSERT_EQUAL(0, link.txDropped);
+  TEST_ASSERT_EQUAL(1, link.connections);
+}
+
+void test_slow_parser_holds_the_host_back(void) {
+  PosixServer server(0);
+  TEST_ASSERT_TRUE(server.begin());
+  Tcp link(server);
+  std::string data;
+  for (int i = 0; i < 400000; i++) data += (char)('a' + i % 26);
+
+  std::thread host([&]() {
+    PosixClient c = PosixClient::connect("127.0.0.1", server.port());
+    sendAll(c, data); //waits while the device isn't reading
+  });
+  while (!link.connected()) link.service();
+  for (int i = 0; i < 1000; i++) {
+    link.service(); //the parser is busy: nothing read
+    std::this_thread::yield();
+  }
+  TEST_ASSERT_EQUAL(TCP_RX_BUFFER, link.available()); //the rest waits in the socket
+  std::string got;
+  while (got.size() < data.size()) {
+    if (link.available()) got += (char)link.read();
+    else std::this_thread::yield();
+  }
+  host.join();
+  TEST_ASSERT_TRUE(got == data);
+}
+
+void test_hosts_take_turns(void) {
+  PosixServer server(0);
+  TEST_ASSERT_TRUE(server.begin());
+  Tcp link(server);
+  auto session = [&](const char* send, std::string& reply) {
+    PosixClient c = PosixClient::connect("127.0.0.1", server.port());
+    sendAll(c, send);
+    uint8_t buf[64];
+    while (reply.empty()) {
+      int n = c.read(buf, sizeof(buf));
+      if (n > 0) reply.append((const char*)buf, n);
+      else std::this_thread::yield();
+    }
+  };
+  std::string first, second;
+  std::thread a([&]() { session("A", first); });
+  while (link.available() < 1) std::this_thread::yield();
+  TEST_ASSERT_EQUAL('A', link.read());
+  std::thread b([&]() { session("B", second); }); //waits for a to go
+  link.print("to a");
+  link.flush();
+  a.join();
+  while (link.available() < 1) std::this_thread::yield();
+  TEST_ASSERT_EQUAL('B', link.read());
+  link.print("to b");
+  link.flush();
+  b.join();
+  TEST_ASSERT_EQUAL_STRING("to a", first.c_str());
+  TEST_ASSERT_EQUAL_STRING("to b", second.c_str());
+  TEST_ASSERT_EQUAL(2, link.connections);
+}
+
+void test_new_host_starts_afresh(void) {
+  // a host that goes away in the middle of a label, a number, and a 'V' packet
+  const std::string cut[] = {"\"half a lab", "12", std::string("3i 10x 10y 100w 50h V\0\2", 24)};
+  for (const std::string& first : cut) {
+    PosixServer server(0);
+    TEST_ASSERT_TRUE(server.begin());
+    Tcp link(server);
+    TouchManager tm;
+    HostLinks links(tm, nullptr);
+    links.add(link, true);
+    std::string reply;
+    std::atomic<bool> done(false);
+    std::thread hosts([&]() {
+      {
+        PosixClient a = PosixClient::connect("127.0.0.1", server.port());
+        sendAll(a, first);
+      } //closed
+      PosixClient b = PosixClient::connect("127.0.0.1", server.port());
+      sendAll(b, "7Q ");
+      uint8_t buf[256];
+      uint32_t start = millis();
+      while (reply.find("\r\n", reply.find("Q:")) == std::string::npos && millis() - start < 5000) {
+        int n = b.read(buf, sizeof(buf));
+        if (n > 0) reply.append((const char*)buf, n);
+        else std::this_thread::yield();
+      }
+      done = true;
+    });
+    while (!done) {
+      if (!links.feed(64)) std::this_thread::yield();
+    }
+    hosts.join();
+    TEST_ASSERT_EQUAL(2, link.connections);
+    TEST_ASSERT_TRUE(reply.find("Q:7 s:") != std::string::npos);
+  }
+}
+
+void test_replies_wait_then_drop(void) {
+  FakeServer server;
+  TcpTransport<FakeServer, FakeClient> link(server);
+  link.service();
+  TEST_ASSERT_TRUE(link.connected());
+  uint8_t data[3000] = {};
+
+  room = 0; //the host reads after a while
+  std::thread reader([]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    room = 100000;
+  });
+  TEST_ASSERT_EQUAL(sizeof(data), link.write(data, sizeof(data))); //waited, as on a UART
+  reader.join();
+  TEST_ASSERT_EQUAL(0, link.txDropped);
+
+  link.flush();
+  TEST_ASSERT_TRUE(link.connected());
+  room = 0; //the host stops reading
+  uint32_t start = micros();
+  TEST_ASSERT_EQUAL(TCP_TX_BUFFER, link.write(data, sizeof(data)));
+  TEST_ASSERT_GREATER_OR_EQUAL(TCP_TX_WAIT_US, micros() - start);
+  TEST_ASSERT_EQUAL(sizeof(data) - TCP_TX_BUFFER, link.txDropped);
+  start = micros();
+  TEST_ASSERT_EQUAL(0, link.write(data, 10)); //doesn't wait again
+  TEST_ASSERT_LESS_THAN(TCP_TX_WAIT_US / 2, micros() - start);
+
+  room = 100000; //reading again
+  link.service();
+  TEST_ASSERT_EQUAL(10, link.write(data, 10));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_byte_ring);
+  RUN_TEST(test_same_frame_over_loopback);
+  RUN_TEST(test_slow_parser_holds_the_host_back);
+  RUN_TEST(test_hosts_take_turns);
+  RUN_TEST(test_new_host_starts_afresh);
+  RUN_TEST(test_replies_wait_then_drop);
+  return UNITY_END();
+}
@@ -0,0 +1,128 @@
+/*
+ * Host links (src/Transport.h, host/FdTransport.h): a stream sent through a
+ * pipe or a pseudo terminal gives the same frame as one fed straight in, and
+ * the replies come back out the other end.
+ * Run on the PC: pio test -e native
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "CommandParser.h"
+#include "Canvas565.h"
+#include "FdTransport.h"
+#include "PrintSinks.h"
+
+#include <string>
+#include <thread>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static std::string stream() {
+  std::string s = "Z ";
+  for (int i = 0; i < 2000; i++) {
+    s += std::to_string(1 + i % 30) + "i " + std::to_string((i * 37) % 300) + "x " +
+         std::to_string((i * 53) % 220) + "y ";
+    s += i % 2 ? "20w 10h #f800C R " : "12d #7e0C O ";
+  }
+  return s + "\"done\" T 7Q ";
+}
+
+static uint64_t directHash(const std::string& cmds) {
+  Canvas565 canvas;
+  canvas.setRotation(1);
+  TouchManager tm;
+  tm.begin(&canvas);
+  NullPrint out;
+  CommandParser parser(tm, &canvas, out);
+  for (unsigned char ch : cmds) parser.feed(ch);
+  return canvas.hash();
+}
+
+// Sends cmds into to, and reads what comes back from until the ping's reply
+static void host(int to, int from, const std::string& cmds, std::string& replies) {
+  std::thread writer([&]() {
+    for (size_t done = 0; done < cmds.size();) {
+      ssize_t n = ::write(to, cmds.data() + done, cmds.size() - done);
+      if (n > 0) done += n;
+      else std::this_thread::yield();
+    }
+  });
+  char buf[4096];
+  while (replies.find("Q:7") == std::string::npos) {
+    ssize_t n = ::read(from, buf, sizeof(buf));
+    if (n > 0) replies.append(buf, n);
+    else std::this_thread::yield();
+  }
+  writer.join();
+}
+
+// The device side: polls the link as loop() does, until the ping
+static uint64_t device(Transport& link, size_t expected) {
+  Canvas565 canvas;
+  canvas.setRotation(1);
+  TouchManager tm;
+  tm.begin(&canvas);
+  CommandParser parser(tm, &canvas, link);
+  for (size_t taken = 0; taken < expected;) {
+    size_t n = parser.feed(link, 64);
+    if (!n) std::this_thread::yield();
+    taken += n;
+  }
+  link.flush();
+  return canvas.hash();
+}
+
+void test_pipe(void) {
+  const std::string cmds = stream();
+  int in[2], out[2];
+  TEST_ASSERT_EQUAL(0, pipe(in));
+  TEST_ASSERT_EQUAL(0, pipe(out));
+  FdTransport link(in[0], out[1], "pipe");
+  std::string replies;
+  std::thread pc([&]() { host(in[1], out[0], cmds, replies); });
+  uint64_t hash = device(link, cmds.size());
+  pc.join();
+  TEST_ASSERT_TRUE(hash == directHash(cmds));
+  TEST_ASSERT_EQUAL(cmds.size(), link.bytesIn);
+  TEST_ASSERT_TRUE(replies.find("Q:7 s:") != std::string::npos);
+  TEST_ASSERT_FALSE(link.eof());
+  close(in[1]); //the host goes away
+  TEST_ASSERT_EQUAL(0, link.available());
+  TEST_ASSERT_TRUE(link.eof());
+  for (int fd : {in[0], out[0], out[1]}) close(fd);
+}
+
+void test_pty(void) {
+  const std::string cmds = stream();
+  PtyTransport link;
+  TEST_ASSERT_NOT_NULL(link.slaveName());
+  TEST_ASSERT_EQUAL(0, link.available()); //nobody there yet, but not the end
+  TEST_ASSERT_FALSE(link.eof());
+  int fd = open(link.slaveName(), O_RDWR | O_NOCTTY);
+  TEST_ASSERT_TRUE(fd >= 0);
+  termios raw;
+  tcgetattr(fd, &raw);
+  cfmakeraw(&raw);
+  tcsetattr(fd, TCSANOW, &raw);
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  std::string replies;
+  std::thread pc([&]() { host(fd, fd, cmds, replies); });
+  uint64_t hash = device(link, cmds.size());
+  pc.join();
+  TEST_ASSERT_TRUE(link.connected());
+  TEST_ASSERT_TRUE(hash == directHash(cmds));
+  TEST_ASSERT_TRUE(replies.find("Q:7 s:") != std::string::npos);
+  TEST_ASSERT_TRUE(replies.find("\"done\" T") != std::string::npos); //the echo, unchanged by the terminal
+  close(fd);
+  TEST_ASSERT_EQUAL(0, link.available());
+  TEST_ASSERT_TRUE(link.eof());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_pipe);
+  RUN_TEST(test_pty);
+  return UNITY_END();
+}
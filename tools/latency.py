@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""
+Breaks the delay between sending a command and it showing on the display into
+where it goes, using the `Q` ping and `N` time sync commands.
+
+First it syncs the device to this host's clock: a few bare `N` exchanges, the
+fastest one gives the offset, which is then sent back with `<offset>N`. After
+that, touch reports carry host times (" T:") and so do the ping replies.
+
+Then it sends the probe command followed by a ping, `<command> <token>Q`, over
+and over. Each reply says when the device started taking in the command (s),
+when it finished it (e), how much of that was drawing (r) and when it replied
+(d), so for each probe:
+
+  rtt     sent until the reply came back
+  queue   sent until the device started on the command (link, serial buffer, loop)
+  parse   taking in the command, less drawing
+  render  drawing
+  reply   the device replying until it got here
+
+Touches made during the run are reported as well: how long the touch took to
+reach the host.
+
+  python3 tools/latency.py --port /dev/ttyACM0 [-n 200] [--command "..."]
+
+Needs pyserial.
+"""
+
+import argparse
+import re
+import time
+
+WRAP = 1 << 31  # the device gives host times modulo 2^31 microseconds
+
+PING = re.compile(rb"Q:(\d+) s:(\d+) e:(\d+) r:(\d+) d:(\d+)")
+SYNC = re.compile(rb"N:(\d+)")
+TOUCH = re.compile(rb"(-?\d+)@ X:(-?\d+)Y:(-?\d+) T:(\d+)")
+
+
+class Clock:
+    """This host's clock in microseconds, as the device is synced to."""
+
+    def __init__(self):
+        self.start = time.monotonic()
+
+    def now(self):
+        return int((time.monotonic() - self.start) * 1e6)
+
+    def unwrap(self, t, near):
+        """Takes a host time modulo 2^31 back to the full one closest to near."""
+        full = near - (near % WRAP) + t
+        if full - near > WRAP // 2:
+            full -= WRAP
+        elif near - full > WRAP // 2:
+            full += WRAP
+        return full
+
+
+class Link:
+    def __init__(self, port, clock):
+        self.port = port
+        self.clock = clock
+        self.pending = b""
+        self.touches = []  # (host time the touch was made, host time it arrived)
+
+    def send(self, data):
+        t = self.clock.now()
+        self.port.write(data)
+        self.port.flush()
+        return t
+
+    def wait_for(self, pattern, timeout=5.0, check=None):
+        """Reads until pattern matches (and check(match) is true), noting touches on the way."""
+        end = time.monotonic() + timeout
+        while time.monotonic() < end:
+            self.pending += self.port.read(self.port.in_waiting or 1)
+            arrived = self.clock.now()
+            for touch in TOUCH.finditer(self.pending):
+                self.touches.append((self.clock.unwrap(int(touch.group(4)), arrived), arrived))
+            self.pending = TOUCH.sub(b"", self.pending)
+            for match in pattern.finditer(self.pending):
+                if check is None or check(match):
+                    self.pending = self.pending[match.end():]
+                    return match, arrived
+            self.pending = self.pending[-256:]
+        return None, self.clock.now()
+
+
+def sync(link, clock, rounds):
+    best = None
+    for _ in range(rounds):
+        sent = link.send(b"N")
+        match, arrived = link.wait_for(SYNC)
+        if not match:
+            raise SystemExit("no reply to N, is it a build with the N command?")
+        if best is None or arrived - sent < best[0]:
+            best = (arrived - sent, (sent + arrived) // 2 - int(match.group(1)))
+    rtt, offset = best
+    offset %= WRAP
+    link.send(b"%dN" % (offset or 1))  # 0 would only ask
+    link.wait_for(SYNC)
+    return rtt
+
+
+def percentile(values, p):
+    """Nearest rank, as host/Replay.h."""
+    if not values:
+        return 0
+    values = sorted(values)
+    rank = max(1, -(-len(values) * p // 100))
+    return values[int(rank) - 1]
+
+
+def report(name, values):
+    values = [v / 1000.0 for v in values]
+    print("%-8s %8.2f %8.2f %8.2f %8.2f %8.2f" % (
+        name, percentile(values, 50), percentile(values, 90), percentile(values, 99),
+        max(values) if values else 0, sum(values) / len(values) if values else 0))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--port", required=True, help="serial port of the display")
+    ap.add_argument("--baud", type=int, default=115200)
+    ap.add_argument("-n", "--count", type=int, default=100, help="probes to send")
+    ap.add_argument("--command", default="1i 10x 10y 100w 60h #07e0C R",
+                    help="command to time, empty to time the ping alone")
+    ap.add_argument("--interval", type=float, default=0.05, help="seconds between probes")
+    ap.add_argument("--sync-rounds", type=int, default=16)
+    args = ap.parse_args()
+
+    import serial  # pyserial
+
+    clock = Clock()
+    with serial.Serial(args.port, args.baud, timeout=0.05) as port:
+        port.reset_input_buffer()
+        link = Link(port, clock)
+        print("synced, best N round trip %.2f ms" % (sync(link, clock, args.sync_rounds) / 1000.0))
+
+        rows = {k: [] for k in ("rtt", "queue", "parse", "render", "reply")}
+        lost = 0
+        for token in range(1, args.count + 1):
+            line = ("%s %dQ\n" % (args.command, token)).encode()
+            sent = link.send(line)
+            match, arrived = link.wait_for(PING, check=lambda m, t=token: int(m.group(1)) == t)
+            if not match:
+                lost += 1
+                continue
+            s, e, d = (clock.unwrap(int(match.group(k)), arrived) for k in (2, 3, 5))
+            render = int(match.group(4))  # a duration, not a time
+            rows["rtt"].append(arrived - sent)
+            rows["queue"].append(s - sent)
+            rows["parse"].append(e - s - render)
+            rows["render"].append(render)
+            rows["reply"].append(arrived - d)
+            time.sleep(args.interval)
+
+    print("%d probes, %d lost. Milliseconds:" % (args.count, lost))
+    print("%-8s %8s %8s %8s %8s %8s" % ("", "p50", "p90", "p99", "max", "mean"))
+    for name, values in rows.items():
+        report(name, values)
+    if link.touches:
+        report("touch", [arrived - made for made, arrived in link.touches])
+
+
+if __name__ == "__main__":
+    main()
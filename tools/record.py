@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""
+Makes session captures (the format of src/SessionRecorder.h) for host/replay.cpp.
+
+Host side: sends a command stream to the display, recording when each line went
+out, and the touches it reports back:
+
+  python3 tools/record.py --port /dev/ttyACM0 -o capture.bin scene.txt
+  some_program | python3 tools/record.py --port /dev/ttyACM0 -o capture.bin
+
+From the device (built with -D MERGIF_RECORD): asks for its recording with `4?`
+
+  python3 tools/record.py --port /dev/ttyACM0 --dump -o capture.bin
+
+Needs pyserial.
+"""
+
+import argparse
+import re
+import struct
+import sys
+import threading
+import time
+
+TOUCH = re.compile(rb"(-?\d+)@ X:(-?\d+)Y:(-?\d+)")
+
+
+class Capture:
+    def __init__(self):
+        self.start = time.monotonic()
+        self.records = []
+        self.lock = threading.Lock()
+
+    def add(self, kind, data):
+        t = int((time.monotonic() - self.start) * 1e6) & 0xFFFFFFFF
+        with self.lock:
+            for at in range(0, len(data), 255):
+                chunk = data[at:at + 255]
+                self.records.append(struct.pack("<IBB", t, ord(kind), len(chunk)) + chunk)
+
+    def save(self, path):
+        body = b"".join(self.records)
+        with open(path, "wb") as f:
+            f.write(b"MREC" + struct.pack("<BI", 1, len(body)) + body)
+
+
+def watch_touches(link, capture, stop):
+    """Records the touches the display reports ("id@ X:x Y:y")."""
+    pending = b""
+    while not stop.is_set():
+        pending += link.read(256)
+        while True:
+            match = TOUCH.search(pending)
+            if not match:
+                break
+            x, y = int(match.group(2)), int(match.group(3))
+            capture.add("t", struct.pack("<hh", x, y))
+            pending = pending[match.end():]
+        pending = pending[-64:]
+
+
+def record(link, source, capture, linger):
+    stop = threading.Event()
+    watcher = threading.Thread(target=watch_touches, args=(link, capture, stop), daemon=True)
+    watcher.start()
+    for line in iter(source.readline, b""):
+        link.write(line)
+        capture.add("R", line)
+    time.sleep(linger)  # for the last touches
+    stop.set()
+    watcher.join()
+
+
+def dump(link):
+    link.reset_input_buffer()
+    link.write(b"4?")
+    data = b""
+    while True:
+        chunk = link.read(4096)
+        if not chunk:
+            break
+        data += chunk
+    at = data.rfind(b"MREC")
+    if at < 0:
+        raise SystemExit("no MREC recording in the reply, was it built with MERGIF_RECORD?")
+    (length,) = struct.unpack_from("<I", data, at + 5)
+    if at + 9 + length > len(data):
+        raise SystemExit("recording is cut short, %d of %d bytes" % (len(data) - at - 9, length))
+    return data[at:at + 9 + length]
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("stream", nargs="?", help="commands to send, stdin if not given")
+    ap.add_argument("--port", required=True, help="serial port of the display")
+    ap.add_argument("--baud", type=int, default=115200)
+    ap.add_argument("--dump", action="store_true", help="get the device's own recording instead")
+    ap.add_argument("--linger", type=float, default=1.0, help="seconds to wait for touches at the end")
+    ap.add_argument("-o", "--output", required=True)
+    args = ap.parse_args()
+
+    import serial  # pyserial
+
+    with serial.Serial(args.port, args.baud, timeout=0.2) as link:
+        if args.dump:
+            with open(args.output, "wb") as f:
+                f.write(dump(link))
+            return
+        capture = Capture()
+        if args.stream:
+            with open(args.stream, "rb") as source:
+                record(link, source, capture, args.linger)
+        else:
+            record(link, sys.stdin.buffer, capture, args.linger)
+        capture.save(args.output)
+
+
+if __name__ == "__main__":
+    main()
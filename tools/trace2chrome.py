@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+"""
+Converts a MERGIF trace dump (`3?`, see src/Trace.h) to Chrome trace JSON,
+for chrome://tracing or https://ui.perfetto.dev
+
+  python3 tools/trace2chrome.py capture.bin > trace.json
+  python3 tools/trace2chrome.py --port /dev/ttyACM0 > trace.json
+
+A capture file can be any raw serial log, the dump is found by its "MTRC" header.
+With --port, `3?` is sent and the reply is read (needs pyserial).
+Each core is a thread of its own in the trace.
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+NAMES = {1: "parse", 2: "draw", 3: "findGroupIDAt", 4: "remapTouchPoint", 5: "serial tx"}
+TX = {ord("e"): "echo", ord("t"): "touch"}
+CORE1 = 0x80  # set on the id of events recorded on core 1
+
+
+def parse(data):
+    """Returns the events in the last dump in data, as (begin, end, id, arg)."""
+    at = data.rfind(b"MTRC")
+    if at < 0:
+        raise ValueError("no MTRC trace dump found")
+    (count,) = struct.unpack_from("<H", data, at + 4)
+    events = []
+    for i in range(count):
+        off = at + 6 + 10 * i
+        if off + 10 > len(data):
+            raise ValueError("trace dump is cut short, %d of %d events" % (i, count))
+        events.append(struct.unpack_from("<IIBB", data, off))
+    return events
+
+
+def to_chrome(events):
+    out = []
+    base = events[0][0] if events else 0
+    # the cores' events follow one another, start from the earliest of either
+    base += min([((e[0] - base + 0x80000000) & 0xFFFFFFFF) - 0x80000000 for e in events] + [0])
+    for begin, end, tagged, arg in events:
+        core = 1 if tagged & CORE1 else 0
+        tid = tagged & ~CORE1
+        name = NAMES.get(tid, "id %d" % tid)
+        if tid in (1, 2) and 32 < arg < 127:
+            name += " " + chr(arg)
+        elif tid == 5:
+            name += " " + TX.get(arg, "?")
+        out.append({
+            "name": name,
+            "cat": NAMES.get(tid, "other"),
+            "ph": "X",
+            # micros() wraps every ~71 minutes, keep times relative to the earliest event
+            "ts": (begin - base) & 0xFFFFFFFF,
+            "dur": (end - begin) & 0xFFFFFFFF,
+            "pid": 1,
+            "tid": core + 1,
+        })
+    return {"traceEvents": out, "displayTimeUnit": "ms"}
+
+
+def read_port(port, baud):
+    import serial  # pyserial
+
+    with serial.Serial(port, baud, timeout=1) as link:
+        link.reset_input_buffer()
+        link.write(b"3?")
+        data = b""
+        while True:
+            chunk = link.read(4096)
+            if not chunk:
+                return data
+            data += chunk
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("capture", nargs="?", help="raw serial capture holding a `3?` dump")
+    ap.add_argument("--port", help="serial port to ask for a dump")
+    ap.add_argument("--baud", type=int, default=115200)
+    args = ap.parse_args()
+
+    if args.port:
+        data = read_port(args.port, args.baud)
+    elif args.capture:
+        with open(args.capture, "rb") as f:
+            data = f.read()
+    else:
+        data = sys.stdin.buffer.read()
+
+    json.dump(to_chrome(parse(data)), sys.stdout, indent=1)
+    sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()